@@ -15,6 +15,8 @@ enum {
 	OPT_VERBOSE = 0x4,
 	OPT_DECOMPRESS = 0x8,
 	OPT_TEST = 0x10,
+/* bunzip2 only: */
+	OPT_JOBS = 0x20,
 };
 
 static
@@ -141,7 +143,7 @@ int FAST_FUNC bbunpack(char **argv,
 	return exitcode;
 }
 
-#if ENABLE_BUNZIP2 || ENABLE_UNLZMA || ENABLE_UNCOMPRESS
+#if ENABLE_BUNZIP2 || ENABLE_UNLZMA || ENABLE_UNXZ || ENABLE_UNCOMPRESS
 
 static
 char* make_new_name_generic(char *filename, const char *expected_ext)
@@ -183,8 +185,14 @@ IF_DESKTOP(long long) int unpack_bunzip2(unpack_info_t *info UNUSED_PARAM)
 int bunzip2_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int bunzip2_main(int argc UNUSED_PARAM, char **argv)
 {
-	getopt32(argv, "cfvdt");
+	IF_FEATURE_BUNZIP2_PARALLEL(const char *opt_T;)
+
+	getopt32(argv, "cfvdt" IF_FEATURE_BUNZIP2_PARALLEL("T:", &opt_T));
 	argv += optind;
+#if ENABLE_FEATURE_BUNZIP2_PARALLEL
+	if (option_mask32 & OPT_JOBS)
+		unpack_bz2_jobs = xatou_range(opt_T, 0, 64);
+#endif
 	if (applet_name[2] == 'c')
 		option_mask32 |= OPT_STDOUT;
 
@@ -344,6 +352,42 @@ int unlzma_main(int argc UNUSED_PARAM, char **argv)
 
 #endif
 
+#if ENABLE_UNXZ
+
+static
+char* make_new_name_unxz(char *filename)
+{
+	return make_new_name_generic(filename, "xz");
+}
+
+static
+IF_DESKTOP(long long) int unpack_unxz(unpack_info_t *info UNUSED_PARAM)
+{
+	return unpack_xz_stream_prime(STDIN_FILENO, STDOUT_FILENO);
+}
+
+int unxz_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
+int unxz_main(int argc UNUSED_PARAM, char **argv)
+{
+	IF_FEATURE_XZ_PARALLEL(const char *opt_T;)
+
+	getopt32(argv, "cf" IF_FEATURE_XZ_PARALLEL("T:", &opt_T));
+	argv += optind;
+#if ENABLE_FEATURE_XZ_PARALLEL
+	/* -T is where bbunpack has -v */
+	if (option_mask32 & 0x4)
+		unpack_xz_jobs = xatou_range(opt_T, 0, 64);
+	option_mask32 &= OPT_STDOUT | OPT_FORCE;
+#endif
+	/* xzcat? */
+	if (applet_name[2] == 'c')
+		option_mask32 |= OPT_STDOUT;
+
+	return bbunpack(argv, make_new_name_unxz, unpack_unxz);
+}
+
+#endif
+
 
 /*
  *	Uncompress applet for busybox (c) 2002 Glenn McGrath
@@ -79,6 +79,21 @@ void FAST_FUNC data_extract_all(archive_handle_t *archive_handle)
 				flags,
 				file_header->mode
 				);
+#if ENABLE_FEATURE_TAR_SPARSE
+			if (file_header->tar__sparse) {
+				const off_t *sp = file_header->tar__sparse;
+				unsigned n = file_header->tar__sparse_cnt;
+
+				/* Seek over the holes, they are never written */
+				while (n--) {
+					xlseek(dst_fd, sp[0], SEEK_SET);
+					bb_copyfd_exact_size(archive_handle->src_fd, dst_fd, sp[1]);
+					sp += 2;
+				}
+				if (ftruncate(dst_fd, file_header->tar__sparse_size) != 0)
+					bb_perror_msg_and_die("can't truncate %s", file_header->name);
+			} else
+#endif
 			bb_copyfd_exact_size(archive_handle->src_fd, dst_fd, file_header->size);
 			close(dst_fd);
 			break;
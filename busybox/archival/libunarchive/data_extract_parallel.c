@@ -0,0 +1,338 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Licensed under GPLv2 or later, see file LICENSE in this tarball for details.
+ */
+
+#include "libbb.h"
+#include "unarchive.h"
+
+/* tar --jobs N: the parser keeps reading headers while N writer
+ * processes create the files. Each entry goes down a pipe to the
+ * writer picked by hashing its name, header first and data after it,
+ * and the writer runs data_extract_all() on it. The pipe is the
+ * buffer: small files cost the parser one write, big ones stream.
+ *
+ * Ordering between entries:
+ * - same name, e.g. a file stored twice: same writer, in order;
+ * - directories are made by the parser itself, before anything
+ *   that follows them in the archive reaches a writer;
+ * - hard links wait until all writers are idle, their target may
+ *   be anywhere;
+ * - an entry under a symlink that is still in a writer's queue
+ *   waits for that symlink to exist.
+ * Writers report each entry done with their number on a shared pipe.
+ */
+
+struct job_hdr {
+	off_t size;
+	uid_t uid;
+	gid_t gid;
+	mode_t mode;
+	time_t mtime;
+	dev_t device;
+	unsigned ah_flags;
+	/* name, link_target, uname, gname, NUL terminated, follow.
+	 * 0 offset: NULL */
+	unsigned str_len;
+	unsigned link_ofs;
+#if ENABLE_FEATURE_TAR_UNAME_GNAME
+	unsigned uname_ofs;
+	unsigned gname_ofs;
+#endif
+#if ENABLE_FEATURE_TAR_SPARSE
+	/* then tar__sparse_cnt offset/length pairs */
+	unsigned sparse_cnt;
+	off_t sparse_size;
+#endif
+};
+
+struct writer {
+	int fd;
+	pid_t pid;
+	unsigned sent;
+	unsigned done;
+};
+
+struct pending_link {
+	char *name;
+	unsigned writer;
+	unsigned seq; /* exists once writer's done > seq */
+};
+
+static struct {
+	unsigned cnt;
+	int ack_fd;
+	struct writer *writer;
+	unsigned link_cnt;
+	struct pending_link *link;
+} P;
+
+static void NORETURN writer_main(archive_handle_t *archive_handle,
+		int job_fd, int ack_fd, unsigned char idx)
+{
+	file_header_t *file_header = archive_handle->file_header;
+	struct job_hdr hdr;
+
+	archive_handle->src_fd = job_fd;
+	archive_handle->seek = seek_by_read;
+	while (full_read(job_fd, &hdr, sizeof(hdr)) == sizeof(hdr)) {
+		char *str = xmalloc(hdr.str_len);
+
+		xread(job_fd, str, hdr.str_len);
+		file_header->name = str;
+		file_header->link_target = hdr.link_ofs ? str + hdr.link_ofs : NULL;
+#if ENABLE_FEATURE_TAR_UNAME_GNAME
+		file_header->tar__uname = hdr.uname_ofs ? str + hdr.uname_ofs : NULL;
+		file_header->tar__gname = hdr.gname_ofs ? str + hdr.gname_ofs : NULL;
+#endif
+#if ENABLE_FEATURE_TAR_SPARSE
+		file_header->tar__sparse = NULL;
+		if (hdr.sparse_cnt) {
+			size_t sz = hdr.sparse_cnt * 2 * sizeof(off_t);
+			file_header->tar__sparse = xmalloc(sz);
+			xread(job_fd, file_header->tar__sparse, sz);
+		}
+		file_header->tar__sparse_cnt = hdr.sparse_cnt;
+		file_header->tar__sparse_size = hdr.sparse_size;
+#endif
+		file_header->size = hdr.size;
+		file_header->uid = hdr.uid;
+		file_header->gid = hdr.gid;
+		file_header->mode = hdr.mode;
+		file_header->mtime = hdr.mtime;
+		file_header->device = hdr.device;
+		archive_handle->ah_flags = hdr.ah_flags;
+
+		data_extract_all(archive_handle);
+
+		IF_FEATURE_TAR_SPARSE(free(file_header->tar__sparse);)
+		free(str);
+		xwrite(ack_fd, &idx, 1);
+	}
+	_exit(EXIT_SUCCESS);
+}
+
+void FAST_FUNC data_extract_parallel_start(archive_handle_t *archive_handle, unsigned jobs)
+{
+	struct fd_pair ack;
+	unsigned i;
+
+	P.cnt = jobs;
+	P.writer = xzalloc(jobs * sizeof(P.writer[0]));
+	xpiped_pair(ack);
+	fflush_all(); /* else a writer which dies flushes our stdout too */
+	/* A writer which died has said why, don't die of SIGPIPE
+	 * before we get to exit with an error */
+	signal(SIGPIPE, SIG_IGN);
+	for (i = 0; i < jobs; i++) {
+		struct fd_pair job;
+
+		xpiped_pair(job);
+#ifdef F_SETPIPE_SZ
+		/* Room for more small files in flight */
+		fcntl(job.wr, F_SETPIPE_SZ, 1024 * 1024);
+#endif
+		P.writer[i].pid = fork();
+		if (P.writer[i].pid < 0)
+			bb_perror_msg_and_die("vfork" + 1);
+		if (P.writer[i].pid == 0) {
+			unsigned char idx = i;
+			/* Other writers must see EOF when we close their pipes */
+			while (i)
+				close(P.writer[--i].fd);
+			close(job.wr);
+			close(ack.rd);
+			close(archive_handle->src_fd);
+			writer_main(archive_handle, job.rd, ack.wr, idx);
+		}
+		close(job.rd);
+		P.writer[i].fd = job.wr;
+	}
+	close(ack.wr);
+	P.ack_fd = ack.rd;
+	ndelay_on(P.ack_fd);
+}
+
+/* Note finished entries. With block, wait for at least one */
+static void read_acks(int block)
+{
+	unsigned char buf[256];
+	unsigned i;
+	int n;
+
+	if (block) {
+		struct pollfd pfd[P.cnt + 1];
+
+		/* A dead writer shows up as POLLERR on its pipe */
+		for (i = 0; i < P.cnt; i++) {
+			pfd[i].fd = P.writer[i].fd;
+			pfd[i].events = 0;
+		}
+		pfd[i].fd = P.ack_fd;
+		pfd[i].events = POLLIN;
+		safe_poll(pfd, P.cnt + 1, -1);
+		if (!(pfd[i].revents & POLLIN)) {
+			for (i = 0; i < P.cnt; i++)
+				if (pfd[i].revents)
+					xfunc_die(); /* writer has said why */
+		}
+	}
+	n = safe_read(P.ack_fd, buf, sizeof(buf));
+	for (i = 0; (int)i < n; i++)
+		P.writer[buf[i]].done++;
+}
+
+static void wait_all(void)
+{
+	unsigned i;
+
+	for (i = 0; i < P.cnt; i++)
+		while (P.writer[i].done != P.writer[i].sent)
+			read_acks(1);
+}
+
+/* Wait if name is a pending symlink or goes through one */
+static void wait_for_links(const char *name)
+{
+	unsigned i = 0;
+
+	while (i < P.link_cnt) {
+		struct pending_link *l = &P.link[i];
+		size_t len;
+
+		if ((int)(P.writer[l->writer].done - l->seq) > 0) {
+			free(l->name);
+			*l = P.link[--P.link_cnt];
+			continue;
+		}
+		len = strlen(l->name);
+		if (strncmp(name, l->name, len) == 0
+		 && (name[len] == '\0' || name[len] == '/')
+		) {
+			read_acks(1);
+			continue;
+		}
+		i++;
+	}
+}
+
+static void send_str(char *buf, unsigned *pos, const char *str, unsigned *ofs)
+{
+	unsigned len;
+
+	*ofs = 0;
+	if (!str)
+		return;
+	*ofs = *pos;
+	len = strlen(str) + 1;
+	memcpy(buf + *pos, str, len);
+	*pos += len;
+}
+
+void FAST_FUNC data_extract_parallel(archive_handle_t *archive_handle)
+{
+	file_header_t *file_header = archive_handle->file_header;
+	struct job_hdr *hdr;
+	struct writer *w;
+	const char *p;
+	unsigned hash, len, name_ofs;
+	char *buf;
+
+	read_acks(0);
+	wait_for_links(file_header->name);
+
+	if (S_ISDIR(file_header->mode)
+	 || (S_ISREG(file_header->mode) /* hard link, see data_extract_all */
+	    && file_header->link_target
+	    && file_header->size == 0)
+	) {
+		if (!S_ISDIR(file_header->mode))
+			wait_all();
+		data_extract_all(archive_handle);
+		return;
+	}
+
+	hash = 0;
+	for (p = file_header->name; *p; p++)
+		hash = hash * 31 + (unsigned char)*p;
+	w = &P.writer[hash % P.cnt];
+
+	len = sizeof(*hdr) + strlen(file_header->name) + 1;
+	if (file_header->link_target)
+		len += strlen(file_header->link_target) + 1;
+#if ENABLE_FEATURE_TAR_UNAME_GNAME
+	if (file_header->tar__uname)
+		len += strlen(file_header->tar__uname) + 1;
+	if (file_header->tar__gname)
+		len += strlen(file_header->tar__gname) + 1;
+#endif
+	buf = xzalloc(len);
+	hdr = (void*)buf;
+	hdr->size = file_header->size;
+	hdr->uid = file_header->uid;
+	hdr->gid = file_header->gid;
+	hdr->mode = file_header->mode;
+	hdr->mtime = file_header->mtime;
+	hdr->device = file_header->device;
+	hdr->ah_flags = archive_handle->ah_flags;
+	buf += sizeof(*hdr);
+	len = 0;
+	send_str(buf, &len, file_header->name, &name_ofs);
+	send_str(buf, &len, file_header->link_target, &hdr->link_ofs);
+#if ENABLE_FEATURE_TAR_UNAME_GNAME
+	send_str(buf, &len, file_header->tar__uname, &hdr->uname_ofs);
+	send_str(buf, &len, file_header->tar__gname, &hdr->gname_ofs);
+#endif
+	hdr->str_len = len;
+#if ENABLE_FEATURE_TAR_SPARSE
+	hdr->sparse_cnt = file_header->tar__sparse ? file_header->tar__sparse_cnt : 0;
+	hdr->sparse_size = file_header->tar__sparse_size;
+#endif
+	xwrite(w->fd, hdr, sizeof(*hdr) + len);
+#if ENABLE_FEATURE_TAR_SPARSE
+	if (hdr->sparse_cnt)
+		xwrite(w->fd, file_header->tar__sparse,
+				hdr->sparse_cnt * 2 * sizeof(off_t));
+#endif
+	free(hdr);
+	bb_copyfd_exact_size(archive_handle->src_fd, w->fd, file_header->size);
+
+	if (S_ISLNK(file_header->mode)) {
+		P.link = xrealloc_vector(P.link, 4, P.link_cnt);
+		P.link[P.link_cnt].name = xstrdup(file_header->name);
+		P.link[P.link_cnt].writer = w - P.writer;
+		P.link[P.link_cnt].seq = w->sent;
+		P.link_cnt++;
+	}
+	w->sent++;
+}
+
+/* For a child which is not a writer, e.g. the decompressor: without
+ * our ends of their pipes it does not keep the writers from seeing EOF */
+void FAST_FUNC data_extract_parallel_close(void)
+{
+	unsigned i;
+
+	for (i = 0; i < P.cnt; i++)
+		close(P.writer[i].fd);
+	if (P.cnt)
+		close(P.ack_fd);
+	P.cnt = 0;
+}
+
+/* Returns 0 if all writers have done their work */
+int FAST_FUNC data_extract_parallel_wait(void)
+{
+	int ret = 0;
+	unsigned i;
+
+	for (i = 0; i < P.cnt; i++)
+		close(P.writer[i].fd);
+	for (i = 0; i < P.cnt; i++) {
+		int status;
+		if (safe_waitpid(P.writer[i].pid, &status, 0) < 0 || status != 0)
+			ret = 1;
+	}
+	close(P.ack_fd);
+	return ret;
+}
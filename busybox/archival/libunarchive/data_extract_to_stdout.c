@@ -6,8 +6,41 @@
 #include "libbb.h"
 #include "unarchive.h"
 
+#if ENABLE_FEATURE_TAR_SPARSE
+static void write_zeroes(off_t count)
+{
+	char *zeroes = xzalloc(4 * 1024);
+
+	while (count) {
+		size_t n = count > 4 * 1024 ? 4 * 1024 : count;
+		xwrite(STDOUT_FILENO, zeroes, n);
+		count -= n;
+	}
+	free(zeroes);
+}
+#endif
+
 void FAST_FUNC data_extract_to_stdout(archive_handle_t *archive_handle)
 {
+#if ENABLE_FEATURE_TAR_SPARSE
+	file_header_t *file_header = archive_handle->file_header;
+
+	if (file_header->tar__sparse) {
+		const off_t *sp = file_header->tar__sparse;
+		unsigned n = file_header->tar__sparse_cnt;
+		off_t pos = 0;
+
+		/* A pipe has no holes: fill them in */
+		while (n--) {
+			write_zeroes(sp[0] - pos);
+			bb_copyfd_exact_size(archive_handle->src_fd, STDOUT_FILENO, sp[1]);
+			pos = sp[0] + sp[1];
+			sp += 2;
+		}
+		write_zeroes(file_header->tar__sparse_size - pos);
+		return;
+	}
+#endif
 	bb_copyfd_exact_size(archive_handle->src_fd,
 			STDOUT_FILENO,
 			archive_handle->file_header->size);
@@ -78,6 +78,9 @@ struct bunzip_data {
 	/* The CRC values stored in the block header and calculated from the data */
 	uint32_t headerCRC, totalCRC, writeCRC;
 
+	/* Parallel workers stop after one block (see unpack_bz2_parallel) */
+	IF_FEATURE_BUNZIP2_PARALLEL(smallint one_block;)
+
 	/* Intermediate buffer and its size (in bytes) */
 	unsigned *dbuf, dbufSize;
 
@@ -562,6 +565,12 @@ int FAST_FUNC read_bunzip(bunzip_data *bd, char *outbuf, int len)
 			bd->totalCRC = bd->headerCRC + 1;
 			return RETVAL_LAST_BLOCK;
 		}
+#if ENABLE_FEATURE_BUNZIP2_PARALLEL
+		if (bd->one_block) {
+			bd->writeCount = RETVAL_LAST_BLOCK;
+			return gotcount;
+		}
+#endif
 	}
 
 	/* Refill the intermediate buffer by Huffman-decoding next block of input */
@@ -647,17 +656,15 @@ void FAST_FUNC dealloc_bunzip(bunzip_data *bd)
 }
 
 
-/* Decompress src_fd to dst_fd.  Stops at end of bzip data, not end of file. */
-IF_DESKTOP(long long) int FAST_FUNC
-unpack_bz2_stream(int src_fd, int dst_fd)
+/* Write everything bd decodes to dst_fd, check the stream CRC and free bd.
+ * i is the result of setting up bd (RETVAL_OK or an error). */
+static IF_DESKTOP(long long) int
+bunzip_to_fd(bunzip_data *bd, int i, int dst_fd)
 {
 	IF_DESKTOP(long long total_written = 0;)
 	char *outbuf;
-	bunzip_data *bd;
-	int i;
 
 	outbuf = xmalloc(IOBUF_SIZE);
-	i = start_bunzip(&bd, src_fd, NULL, 0);
 	if (!i) {
 		for (;;) {
 			i = read_bunzip(bd, outbuf, IOBUF_SIZE);
@@ -689,6 +696,411 @@ unpack_bz2_stream(int src_fd, int dst_fd)
 	return i ? i : IF_DESKTOP(total_written) + 0;
 }
 
+#if ENABLE_FEATURE_BUNZIP2_PARALLEL
+/* Parallel decompression.
+ *
+ * Each block starts with the 48-bit magic 0x314159265359, and the stream
+ * ends with 0x177245385090 followed by the combined CRC.  Neither is byte
+ * aligned, so we scan the input bit by bit for them.  Every block found
+ * this way is handed to a forked worker, which inherits the input buffer
+ * and decodes its block into a shared per-worker window.  The parent
+ * emits the windows in order and folds the block CRCs into the stream CRC.
+ *
+ * Compressed data can contain the magic by accident.  Each worker reports
+ * where its block really ended; if that is not where the next block was
+ * found (or anything else goes wrong), the remaining workers are killed
+ * and the serial decoder takes over from the last position we trust.
+ */
+#define BLOCK_MAGIC  0x314159265359ULL
+#define EOS_MAGIC    0x177245385090ULL
+/* Magic + 32-bit CRC, the most we look at when scanning */
+#define MAGIC_BITS   (48 + 32)
+
+enum {
+	MAGIC_NONE = 0,
+	MAGIC_BLOCK,
+	MAGIC_EOS,
+};
+
+struct bz_window {
+	int status;             /* read_bunzip() result, 1 if worker died */
+	unsigned out_len;       /* bytes in the window */
+	unsigned bits;          /* compressed size of the block */
+	uint32_t headerCRC, writeCRC;
+	/* window data follows */
+};
+
+struct bz_job {
+	struct bz_window *win;
+	pid_t pid;
+	int fd;                 /* overflow pipe, EOF when worker is done */
+	unsigned start, next;   /* bit offsets in parent's buffer */
+	smallint next_type;
+};
+
+struct bz_par {
+	unsigned char *buf;
+	unsigned buf_len, buf_size;
+	unsigned start;         /* next block to hand out */
+	unsigned dbufSize, window;
+	int src_fd;
+	smallint eof;
+	unsigned head, count, nworkers;
+	struct bz_job *jobs;
+};
+
+/* Find the next block or end-of-stream magic at bit *bitp or later
+ * which has MAGIC_BITS bits of data available */
+static int find_magic(const unsigned char *buf, unsigned len, unsigned *bitp)
+{
+	unsigned pos = *bitp >> 3;
+	unsigned s = *bitp & 7;
+
+	for (; pos + 7 <= len; pos++, s = 0) {
+		uint64_t v = 0;
+		int i;
+
+		for (i = 0; i < 7; i++)
+			v = (v << 8) | buf[pos + i];
+		for (; s < 8; s++) {
+			uint64_t m = (v >> (8 - s)) & 0xffffffffffffULL;
+			if (m == BLOCK_MAGIC || m == EOS_MAGIC) {
+				*bitp = pos * 8 + s;
+				if (*bitp + MAGIC_BITS > len * 8)
+					return MAGIC_NONE; /* come back with more data */
+				return (m == BLOCK_MAGIC) ? MAGIC_BLOCK : MAGIC_EOS;
+			}
+		}
+	}
+	*bitp = pos * 8;
+	return MAGIC_NONE;
+}
+
+/* Read up to 32 bits at an arbitrary bit offset of buf[] */
+static unsigned get_bits_at(const unsigned char *buf, unsigned bit, int count)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < 5; i++)
+		v = (v << 8) | buf[(bit >> 3) + i];
+	return (v >> (40 - (bit & 7) - count)) & (((uint64_t)1 << count) - 1);
+}
+
+/* Set up a decoder for the data in buf[] starting at the given bit */
+static bunzip_data *bunzip_at(unsigned char *buf, unsigned len, unsigned bit, unsigned dbufSize)
+{
+	bunzip_data *bd;
+
+	bd = xzalloc(sizeof(*bd));
+	bd->in_fd = -1;
+	bd->inbuf = buf;
+	bd->inbufCount = len;
+	bd->inbufPos = bit >> 3;
+	bit &= 7;
+	if (bit) {
+		bd->inbufBits = buf[bd->inbufPos++];
+		bd->inbufBitCount = 8 - bit;
+	}
+	crc32_filltable(bd->crc32Table, 1);
+	bd->dbufSize = dbufSize;
+	bd->dbuf = xmalloc(dbufSize * sizeof(int));
+	return bd;
+}
+
+/* Drop input nobody can need again and read some more.
+ * *scanp is the caller's scan position, it moves with the data. */
+static void bz_fill(struct bz_par *par, unsigned *scanp)
+{
+	unsigned drop, k;
+	int n;
+
+	if (par->buf_size - par->buf_len < IOBUF_SIZE) {
+		drop = (par->count ? par->jobs[par->head].start : par->start) >> 3;
+		par->buf_len -= drop;
+		memmove(par->buf, par->buf + drop, par->buf_len);
+		drop *= 8;
+		for (k = 0; k < par->count; k++) {
+			struct bz_job *job = &par->jobs[(par->head + k) % par->nworkers];
+			job->start -= drop;
+			job->next -= drop;
+		}
+		par->start -= drop;
+		*scanp -= drop;
+	}
+	if (par->buf_size - par->buf_len < IOBUF_SIZE) {
+		par->buf_size *= 2;
+		par->buf = xrealloc(par->buf, par->buf_size);
+	}
+	n = safe_read(par->src_fd, par->buf + par->buf_len, par->buf_size - par->buf_len);
+	if (n <= 0)
+		par->eof = 1;
+	else
+		par->buf_len += n;
+}
+
+static void bz_worker(struct bz_par *par, struct bz_job *job) NORETURN;
+static void bz_worker(struct bz_par *par, struct bz_job *job)
+{
+	struct bz_window *win = job->win;
+	char *out = (char*)(win + 1);
+	bunzip_data *bd;
+	unsigned n = 0;
+	int i;
+
+	bd = bunzip_at(par->buf, par->buf_len, job->start, par->dbufSize);
+	bd->one_block = 1;
+	do {
+		i = read_bunzip(bd, out + n, par->window - n);
+		if (i < 0)
+			goto done;
+		n += i;
+	} while (n < par->window);
+
+	/* Window is full, the rest goes to the pipe */
+	out = xmalloc(IOBUF_SIZE);
+	while ((i = read_bunzip(bd, out, IOBUF_SIZE)) >= 0) {
+		if (i != full_write(job->fd, out, i))
+			_exit(EXIT_FAILURE);
+	}
+ done:
+	win->out_len = n;
+	win->bits = (bd->inbufPos << 3) - bd->inbufBitCount - job->start;
+	win->headerCRC = bd->headerCRC;
+	win->writeCRC = bd->writeCRC;
+	win->status = i;
+	_exit(EXIT_SUCCESS);
+}
+
+static void bz_start_job(struct bz_par *par, unsigned next, int next_type)
+{
+	struct bz_job *job = &par->jobs[(par->head + par->count) % par->nworkers];
+	struct fd_pair pipe;
+
+	job->start = par->start;
+	job->next = next;
+	job->next_type = next_type;
+	job->win->status = 1;
+	xpiped_pair(pipe);
+	job->pid = fork();
+	if (job->pid < 0)
+		bb_perror_msg_and_die("vfork" + 1);
+	if (job->pid == 0) {
+		close(pipe.rd);
+		job->fd = pipe.wr;
+		bz_worker(par, job);
+	}
+	close(pipe.wr);
+	job->fd = pipe.rd;
+	par->count++;
+	par->start = next;
+}
+
+static void bz_kill_jobs(struct bz_par *par)
+{
+	while (par->count) {
+		struct bz_job *job = &par->jobs[par->head];
+		kill(job->pid, SIGKILL);
+		close(job->fd);
+		safe_waitpid(job->pid, NULL, 0);
+		par->head = (par->head + 1) % par->nworkers;
+		par->count--;
+	}
+}
+
+/* Wait for the oldest job and write out its data.
+ * Returns bytes written, or -1 on write error. */
+static off_t bz_collect(struct bz_par *par, struct bz_job *job, int dst_fd)
+{
+	char *out = (char*)(job->win + 1);
+	char buf[256];
+	off_t n;
+	int r;
+
+	par->head = (par->head + 1) % par->nworkers;
+	par->count--;
+
+	/* Anything in the pipe means the window filled up */
+	n = 0;
+	r = safe_read(job->fd, buf, sizeof(buf));
+	if (r > 0) {
+		if (full_write(dst_fd, out, par->window) != par->window
+		 || full_write(dst_fd, buf, r) != r
+		) {
+			n = -1;
+		} else {
+			n = bb_copyfd_eof(job->fd, dst_fd);
+			if (n >= 0)
+				n += par->window + r;
+		}
+	}
+	close(job->fd);
+	safe_waitpid(job->pid, NULL, 0);
+
+	if (n == 0 && job->win->status == RETVAL_LAST_BLOCK) {
+		n = job->win->out_len;
+		if (full_write(dst_fd, out, n) != n)
+			n = -1;
+	}
+	return n;
+}
+
+static IF_DESKTOP(long long) int
+unpack_bz2_parallel(int src_fd, int dst_fd, unsigned nworkers)
+{
+	IF_DESKTOP(long long) int i;
+	IF_DESKTOP(long long total_written = 0;)
+	struct bz_par par;
+	bunzip_data *bd;
+	uint32_t totalCRC = 0;
+	unsigned scan, k;
+	int type;
+
+	memset(&par, 0, sizeof(par));
+	par.src_fd = src_fd;
+	par.nworkers = nworkers;
+	par.buf_size = 1024 * 1024;
+	par.buf = xmalloc(par.buf_size);
+	scan = 0;
+	while (par.buf_len < 2 && !par.eof)
+		bz_fill(&par, &scan);
+	if (par.buf_len < 2 || par.buf[0] != 'h' || (unsigned)(par.buf[1] - '1') > 8) {
+		i = (par.buf_len < 2) ? RETVAL_UNEXPECTED_INPUT_EOF : RETVAL_NOT_BZIP_DATA;
+		bb_error_msg("bunzip error %d", (int)i);
+		free(par.buf);
+		return i;
+	}
+	par.dbufSize = 100000 * (par.buf[1] - '0');
+	/* A block which unpacks to more than this stalls its worker
+	 * until the parent gets to it */
+	par.window = 4 * par.dbufSize;
+	par.jobs = xzalloc(nworkers * sizeof(par.jobs[0]));
+	for (k = 0; k < nworkers; k++) {
+		par.jobs[k].win = mmap(NULL, sizeof(struct bz_window) + par.window,
+				PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (par.jobs[k].win == MAP_FAILED)
+			bb_perror_msg_and_die("mmap");
+	}
+
+	/* The first block (or the end of an empty stream) follows the header */
+	par.start = scan = 16;
+	while ((type = find_magic(par.buf, par.buf_len, &scan)) == MAGIC_NONE && !par.eof)
+		bz_fill(&par, &scan);
+	if (scan != par.start)
+		goto serial;
+
+	for (;;) {
+		struct bz_job *job;
+		unsigned end;
+		off_t n;
+
+		/* Keep all workers busy.  A block is handed out once we know
+		 * where the following one (probably) starts. */
+		while (type == MAGIC_BLOCK && par.count < nworkers) {
+			scan = par.start + 48;
+			while ((type = find_magic(par.buf, par.buf_len, &scan)) == MAGIC_NONE && !par.eof)
+				bz_fill(&par, &scan);
+			if (type == MAGIC_NONE)
+				break; /* truncated stream, the serial decoder will report it */
+			bz_start_job(&par, scan, type);
+		}
+		if (!par.count) {
+			if (type != MAGIC_EOS)
+				goto serial;
+			break;
+		}
+
+		/* Emit the oldest block */
+		job = &par.jobs[par.head];
+		n = bz_collect(&par, job, dst_fd);
+		if (n < 0) {
+			bz_kill_jobs(&par);
+			bb_error_msg("short write");
+			i = RETVAL_SHORT_WRITE;
+			goto ret;
+		}
+		IF_DESKTOP(total_written += n;)
+		if (job->win->status != RETVAL_LAST_BLOCK) {
+			bz_kill_jobs(&par);
+			if (n == 0) {
+				/* Redo it serially, that reports the error */
+				par.start = job->start;
+				goto serial;
+			}
+			bb_error_msg("bunzip error %d", RETVAL_DATA_ERROR);
+			i = RETVAL_DATA_ERROR;
+			goto ret;
+		}
+		if (job->win->writeCRC != job->win->headerCRC) {
+			bz_kill_jobs(&par);
+			bb_error_msg("CRC error");
+			i = RETVAL_LAST_BLOCK;
+			goto ret;
+		}
+		totalCRC = ((totalCRC << 1) | (totalCRC >> 31)) ^ job->win->writeCRC;
+		end = job->start + job->win->bits;
+		if (end != job->next) {
+			/* The next "block" was a false match inside this one */
+			bz_kill_jobs(&par);
+			par.start = end;
+			goto serial;
+		}
+		if (job->next_type == MAGIC_EOS) {
+			par.start = end;
+			break;
+		}
+	}
+
+	/* par.start is at the end-of-stream magic */
+	if (get_bits_at(par.buf, par.start + 48, 32) != totalCRC) {
+		bb_error_msg("CRC error");
+		i = RETVAL_LAST_BLOCK;
+		goto ret;
+	}
+	i = RETVAL_OK;
+	IF_DESKTOP(i = total_written;)
+	goto ret;
+
+ serial:
+	bd = bunzip_at(par.buf, par.buf_len, par.start, par.dbufSize);
+	bd->in_fd = src_fd;
+	bd->totalCRC = totalCRC;
+	i = bunzip_to_fd(bd, RETVAL_OK, dst_fd);
+	IF_DESKTOP(if (i >= 0) i += total_written;)
+ ret:
+	for (k = 0; k < nworkers; k++)
+		munmap(par.jobs[k].win, sizeof(struct bz_window) + par.window);
+	free(par.jobs);
+	free(par.buf);
+	return i;
+}
+#endif
+
+#if ENABLE_FEATURE_BUNZIP2_PARALLEL
+unsigned unpack_bz2_jobs;
+#endif
+
+/* Decompress src_fd to dst_fd.  Stops at end of bzip data, not end of file. */
+IF_DESKTOP(long long) int FAST_FUNC
+unpack_bz2_stream(int src_fd, int dst_fd)
+{
+	bunzip_data *bd;
+	int i;
+
+#if ENABLE_FEATURE_BUNZIP2_PARALLEL
+	i = unpack_bz2_jobs;
+	if (i == 0) {
+		i = sysconf(_SC_NPROCESSORS_ONLN);
+		if (i > 8)
+			i = 8;
+	}
+	if (i > 1)
+		return unpack_bz2_parallel(src_fd, dst_fd, i);
+#endif
+	i = start_bunzip(&bd, src_fd, NULL, 0);
+	return bunzip_to_fd(bd, i, dst_fd);
+}
+
 IF_DESKTOP(long long) int FAST_FUNC
 unpack_bz2_stream_prime(int src_fd, int dst_fd)
 {
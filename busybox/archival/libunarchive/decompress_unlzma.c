@@ -11,6 +11,9 @@
 #include "libbb.h"
 #include "unarchive.h"
 
+/* .xz container code is needed by unxz, seamless .xz and unlzma -> .xz */
+#define XZ_SUPPORT (ENABLE_FEATURE_LZMA_XZ || ENABLE_UNXZ || ENABLE_FEATURE_SEAMLESS_XZ)
+
 #if ENABLE_FEATURE_LZMA_FAST
 #  define speed_inline ALWAYS_INLINE
 #  define size_inline
@@ -33,7 +36,16 @@ typedef struct {
 
 /* Had provisions for variable buffer, but we don't need it here */
 	/* int buffer_size; */
+#if ENABLE_FEATURE_LZMA_FAST
+#define RC_BUFFER_SIZE 0x40000
+	/* Regular files are mmapped instead of read into the buffer */
+	uint8_t *map;
+	size_t map_size;
+#else
 #define RC_BUFFER_SIZE 0x10000
+#endif
+	/* Bytes which went into the buffer so far (see rc_tell) */
+	off_t total_in;
 
 	uint32_t code;
 	uint32_t range;
@@ -45,31 +57,49 @@ typedef struct {
 #define RC_MODEL_TOTAL_BITS 11
 
 
-/* Called twice: once at startup (LZMA_FAST only) and once in rc_normalize() */
-static size_inline void rc_read(rc_t *rc)
+/* Called when the buffer runs dry. Returns 0 on EOF */
+static int rc_try_read(rc_t *rc)
 {
 	int buffer_size = safe_read(rc->fd, RC_BUFFER, RC_BUFFER_SIZE);
-//TODO: return -1 instead
-//This will make unlzma delete broken unpacked file on unpack errors
 	if (buffer_size <= 0)
-		bb_error_msg_and_die("unexpected EOF");
+		return 0;
 	rc->ptr = RC_BUFFER;
 	rc->buffer_end = RC_BUFFER + buffer_size;
+	rc->total_in += buffer_size;
+	return buffer_size;
 }
 
-/* Called twice, but one callsite is in speed_inline'd rc_is_bit_1() */
-static void rc_do_normalize(rc_t *rc)
+static void rc_read(rc_t *rc)
+{
+//TODO: return -1 instead
+//This will make unlzma delete broken unpacked file on unpack errors
+	if (!rc_try_read(rc))
+		bb_error_msg_and_die("unexpected EOF");
+}
+
+static size_inline uint8_t rc_get_byte(rc_t *rc)
 {
 	if (rc->ptr >= rc->buffer_end)
 		rc_read(rc);
+	return *rc->ptr++;
+}
+
+/* Offset of the next input byte from where we started */
+static off_t rc_tell(rc_t *rc)
+{
+	return rc->total_in - (rc->buffer_end - rc->ptr);
+}
+
+/* Called twice, but one callsite is in speed_inline'd rc_is_bit_1() */
+static void rc_do_normalize(rc_t *rc)
+{
 	rc->range <<= 8;
-	rc->code = (rc->code << 8) | *rc->ptr++;
+	rc->code = (rc->code << 8) | rc_get_byte(rc);
 }
 
 /* Called once */
 static ALWAYS_INLINE rc_t* rc_init(int fd) /*, int buffer_size) */
 {
-	int i;
 	rc_t *rc;
 
 	rc = xzalloc(sizeof(*rc) + RC_BUFFER_SIZE);
@@ -77,22 +107,57 @@ static ALWAYS_INLINE rc_t* rc_init(int fd) /*, int buffer_size) */
 	rc->fd = fd;
 	/* rc->ptr = rc->buffer_end; */
 
-	for (i = 0; i < 5; i++) {
 #if ENABLE_FEATURE_LZMA_FAST
-		if (rc->ptr >= rc->buffer_end)
-			rc_read(rc);
-		rc->code = (rc->code << 8) | *rc->ptr++;
-#else
-		rc_do_normalize(rc);
-#endif
+	{
+		struct stat st;
+		off_t pos, start;
+		uint8_t *map;
+
+		pos = lseek(fd, 0, SEEK_CUR);
+		if (pos >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > pos) {
+			start = pos & ~(off_t)(getpagesize() - 1);
+			/* With 32-bit size_t, the length may not fit:
+			 * such files are read() instead */
+			map = MAP_FAILED;
+			if ((uoff_t)(st.st_size - start) <= SIZE_MAX)
+				map = mmap(NULL, st.st_size - start, PROT_READ, MAP_PRIVATE, fd, start);
+			if (map != MAP_FAILED) {
+				madvise(map, st.st_size - start, MADV_SEQUENTIAL);
+				rc->map = map;
+				rc->map_size = st.st_size - start;
+				rc->ptr = map + (pos - start);
+				rc->buffer_end = map + rc->map_size;
+				rc->total_in = st.st_size - pos;
+				/* Reads past the mapping see EOF */
+				xlseek(fd, 0, SEEK_END);
+			}
+		}
 	}
-	rc->range = 0xFFFFFFFF;
+#endif
 	return rc;
 }
 
+/* Start decoding a new range coded stream */
+static void rc_start(rc_t *rc)
+{
+	int i;
+
+	rc->code = 0;
+	for (i = 0; i < 5; i++)
+		rc->code = (rc->code << 8) | rc_get_byte(rc);
+	rc->range = 0xFFFFFFFF;
+}
+
 /* Called once  */
 static ALWAYS_INLINE void rc_free(rc_t *rc)
 {
+#if ENABLE_FEATURE_LZMA_FAST
+	if (rc->map) {
+		/* Leave fd just past what we used, as read() would */
+		lseek(rc->fd, -(off_t)(rc->buffer_end - rc->ptr), SEEK_END);
+		munmap(rc->map, rc->map_size);
+	}
+#endif
 	free(rc);
 }
 
@@ -108,6 +173,21 @@ static speed_inline int rc_is_bit_1(rc_t *rc, uint16_t *p)
 {
 	rc_normalize(rc);
 	rc->bound = *p * (rc->range >> RC_MODEL_TOTAL_BITS);
+#if ENABLE_FEATURE_LZMA_FAST
+	{
+		/* Branchless: the bits are close to random,
+		 * so a conditional jump here mispredicts a lot.
+		 * mask is all ones if the bit is 1. */
+		uint32_t mask = 0 - (uint32_t)(rc->code >= rc->bound);
+		unsigned v = *p;
+
+		rc->range = (rc->bound & ~mask) | ((rc->range - rc->bound) & mask);
+		rc->code -= rc->bound & mask;
+		*p = v + ((((1 << RC_MODEL_TOTAL_BITS) - v) >> RC_MOVE_BITS) & ~mask)
+		       - ((v >> RC_MOVE_BITS) & mask);
+		return mask & 1;
+	}
+#else
 	if (rc->code < rc->bound) {
 		rc->range = rc->bound;
 		*p += ((1 << RC_MODEL_TOTAL_BITS) - *p) >> RC_MOVE_BITS;
@@ -117,6 +197,7 @@ static speed_inline int rc_is_bit_1(rc_t *rc, uint16_t *p)
 	rc->code -= rc->bound;
 	*p -= *p >> RC_MOVE_BITS;
 	return 1;
+#endif
 }
 
 /* Called 4 times in unlzma loop */
@@ -212,59 +293,150 @@ enum {
 };
 
 
-IF_DESKTOP(long long) int FAST_FUNC
-unpack_lzma_stream(int src_fd, int dst_fd)
+static void xz_read(rc_t *rc, uint8_t *buf, unsigned len)
 {
-	IF_DESKTOP(long long total_written = 0;)
-	lzma_header_t header;
-	int lc, pb, lp;
+	while (len--)
+		*buf++ = rc_get_byte(rc);
+}
+
+/* Decoder state. It lives across calls to lzma_decode()
+ * so that .xz can feed it LZMA2 chunks one at a time. */
+typedef struct {
+	uint8_t *buffer;        /* dictionary, which is also the output window */
+	uint32_t dict_size;     /* window size */
+	uint32_t buffer_pos;    /* next byte goes here */
+	uint32_t flushed;       /* buffer[flushed..buffer_pos) is not written yet */
+	uint64_t global_pos;    /* bytes before buffer[0] since dictionary reset */
 	uint32_t pos_state_mask;
 	uint32_t literal_pos_mask;
-	uint16_t *p;
-	int num_bits;
-	int num_probs;
-	rc_t *rc;
-	int i;
-	uint8_t *buffer;
-	uint8_t previous_byte = 0;
-	size_t buffer_pos = 0, global_pos = 0;
-	int len = 0;
-	int state = 0;
-	uint32_t rep0 = 1, rep1 = 1, rep2 = 1, rep3 = 1;
+	int lc, lp;
+	int state;
+	uint32_t rep0, rep1, rep2, rep3;
+	uint32_t len;           /* rest of a match cut short by the output limit */
+	int dst_fd;
+	IF_DESKTOP(long long total_written;)
+#if XZ_SUPPORT
+	struct xz_check *check; /* .xz block check, updated as we write */
+#endif
+	uint16_t p[];           /* probabilities */
+} lzma_t;
 
-	if (full_read(src_fd, &header, sizeof(header)) != sizeof(header)
-	 || header.pos >= (9 * 5 * 5)
-	) {
-		bb_error_msg("bad lzma header");
-		return -1;
+#if XZ_SUPPORT
+struct xz_check;
+static void xz_check_update(struct xz_check *check, const uint8_t *buf, uint32_t len);
+#endif
+
+/* Write out what's pending in the window, wrap around if it is full */
+static int lzma_flush(lzma_t *lz)
+{
+	uint32_t n = lz->buffer_pos - lz->flushed;
+
+	if (n) {
+		uint8_t *data = lz->buffer + lz->flushed;
+#if XZ_SUPPORT
+		if (lz->check)
+			xz_check_update(lz->check, data, n);
+#endif
+		/* dst_fd < 0: parallel xz worker, parent writes the window */
+		if (lz->dst_fd >= 0 && full_write(lz->dst_fd, data, n) != (ssize_t)n)
+			return -1;
+		IF_DESKTOP(lz->total_written += n;)
 	}
+	lz->flushed = lz->buffer_pos;
+	if (lz->buffer_pos == lz->dict_size) {
+		lz->global_pos += lz->dict_size;
+		lz->buffer_pos = lz->flushed = 0;
+	}
+	return 0;
+}
 
-	i = header.pos / 9;
-	lc = header.pos % 9;
-	pb = i / 5;
-	lp = i % 5;
-	pos_state_mask = (1 << pb) - 1;
-	literal_pos_mask = (1 << lp) - 1;
+/* lc + lp can't be more than this in LZMA2, .lzma files may use more */
+#define LZMA2_LCLP_MAX 4
 
-	header.dict_size = SWAP_LE32(header.dict_size);
-	header.dst_size = SWAP_LE64(header.dst_size);
+static lzma_t *lzma_alloc(uint8_t *buffer, uint32_t dict_size, int lc_plus_lp, int dst_fd)
+{
+	lzma_t *lz;
 
-	if (header.dict_size == 0)
-		header.dict_size++;
+	lz = xzalloc(sizeof(*lz) + (LZMA_BASE_SIZE + (LZMA_LIT_SIZE << lc_plus_lp)) * sizeof(lz->p[0]));
+	lz->buffer = buffer ? buffer : xmalloc(dict_size);
+	lz->dict_size = dict_size;
+	lz->dst_fd = dst_fd;
+	return lz;
+}
 
-	buffer = xmalloc(MIN(header.dst_size, header.dict_size));
+static void lzma_free(lzma_t *lz)
+{
+	free(lz->buffer);
+	free(lz);
+}
 
-	num_probs = LZMA_BASE_SIZE + (LZMA_LIT_SIZE << (lc + lp));
-	p = xmalloc(num_probs * sizeof(*p));
-	num_probs += LZMA_LITERAL - LZMA_BASE_SIZE;
+/* Set lc/lp/pb from the properties byte */
+static int lzma_set_props(lzma_t *lz, unsigned props)
+{
+	int i;
+
+	if (props >= (9 * 5 * 5))
+		return -1;
+	i = props / 9;
+	lz->lc = props % 9;
+	lz->lp = i % 5;
+	lz->pos_state_mask = (1 << (i / 5)) - 1;
+	lz->literal_pos_mask = (1 << lz->lp) - 1;
+	return 0;
+}
+
+static void lzma_reset_state(lzma_t *lz)
+{
+	int i, num_probs;
+
+	num_probs = LZMA_BASE_SIZE + (LZMA_LIT_SIZE << (lz->lc + lz->lp));
 	for (i = 0; i < num_probs; i++)
-		p[i] = (1 << RC_MODEL_TOTAL_BITS) >> 1;
+		lz->p[i] = (1 << RC_MODEL_TOTAL_BITS) >> 1;
+	lz->state = 0;
+	lz->rep0 = lz->rep1 = lz->rep2 = lz->rep3 = 1;
+	lz->len = 0;
+}
 
-	rc = rc_init(src_fd); /*, RC_BUFFER_SIZE); */
+/* Decode until there are out_size bytes since the dictionary reset.
+ * Returns 0 when there are, 1 if the end marker came first,
+ * -1 on write error. */
+static int lzma_decode(lzma_t *lz, rc_t *rc, uint64_t out_size)
+{
+	uint16_t *p = lz->p;
+	uint8_t *buffer = lz->buffer;
+	uint32_t dict_size = lz->dict_size;
+	uint32_t buffer_pos = lz->buffer_pos;
+	uint32_t pos_state_mask = lz->pos_state_mask;
+	uint32_t literal_pos_mask = lz->literal_pos_mask;
+	int lc = lz->lc;
+	int state = lz->state;
+	uint32_t rep0 = lz->rep0, rep1 = lz->rep1, rep2 = lz->rep2, rep3 = lz->rep3;
+	uint32_t len = lz->len;
+	uint8_t previous_byte = 0;
+	int num_bits;
+	int ret = 0;
+
+#define WINDOW_FULL() \
+	do { \
+		lz->buffer_pos = buffer_pos; \
+		if (lzma_flush(lz)) { \
+			ret = -1; \
+			goto done; \
+		} \
+		buffer_pos = 0; \
+	} while (0)
 
-	while (global_pos + buffer_pos < header.dst_size) {
-		int pos_state = (buffer_pos + global_pos) & pos_state_mask;
+	if (buffer_pos | lz->global_pos)
+		previous_byte = buffer[(buffer_pos ? buffer_pos : dict_size) - 1];
+	if (len)
+		goto copy_match;
+
+	while (lz->global_pos + buffer_pos < out_size) {
+		int pos_state = (buffer_pos + lz->global_pos) & pos_state_mask;
 		uint16_t *prob = p + LZMA_IS_MATCH + (state << LZMA_NUM_POS_BITS_MAX) + pos_state;
+		int offset;
+		uint16_t *prob2;
+#define prob_len prob2
 
 		if (!rc_is_bit_1(rc, prob)) {
 			static const char next_state[LZMA_NUM_STATES] =
@@ -272,7 +444,7 @@ unpack_lzma_stream(int src_fd, int dst_fd)
 			int mi = 1;
 
 			prob = (p + LZMA_LITERAL
-			        + (LZMA_LIT_SIZE * ((((buffer_pos + global_pos) & literal_pos_mask) << lc)
+			        + (LZMA_LIT_SIZE * ((((buffer_pos + lz->global_pos) & literal_pos_mask) << lc)
 			                            + (previous_byte >> (8 - lc))
 			                           )
 			          )
@@ -282,8 +454,8 @@ unpack_lzma_stream(int src_fd, int dst_fd)
 				int match_byte;
 				uint32_t pos = buffer_pos - rep0;
 
-				while (pos >= header.dict_size)
-					pos += header.dict_size;
+				while (pos >= dict_size)
+					pos += dict_size;
 				match_byte = buffer[pos];
 				do {
 					int bit;
@@ -302,164 +474,883 @@ unpack_lzma_stream(int src_fd, int dst_fd)
 			state = next_state[state];
 
 			previous_byte = (uint8_t) mi;
-#if ENABLE_FEATURE_LZMA_FAST
- one_byte1:
 			buffer[buffer_pos++] = previous_byte;
-			if (buffer_pos == header.dict_size) {
-				buffer_pos = 0;
-				global_pos += header.dict_size;
-				if (full_write(dst_fd, buffer, header.dict_size) != (ssize_t)header.dict_size)
-					goto bad;
-				IF_DESKTOP(total_written += header.dict_size;)
-			}
-#else
-			len = 1;
-			goto one_byte2;
-#endif
-		} else {
-			int offset;
-			uint16_t *prob2;
-#define prob_len prob2
+			if (buffer_pos == dict_size)
+				WINDOW_FULL();
+			continue;
+		}
 
-			prob2 = p + LZMA_IS_REP + state;
+		prob2 = p + LZMA_IS_REP + state;
+		if (!rc_is_bit_1(rc, prob2)) {
+			rep3 = rep2;
+			rep2 = rep1;
+			rep1 = rep0;
+			state = state < LZMA_NUM_LIT_STATES ? 0 : 3;
+			prob2 = p + LZMA_LEN_CODER;
+		} else {
+			prob2 += LZMA_IS_REP_G0 - LZMA_IS_REP;
 			if (!rc_is_bit_1(rc, prob2)) {
-				rep3 = rep2;
-				rep2 = rep1;
-				rep1 = rep0;
-				state = state < LZMA_NUM_LIT_STATES ? 0 : 3;
-				prob2 = p + LZMA_LEN_CODER;
-			} else {
-				prob2 += LZMA_IS_REP_G0 - LZMA_IS_REP;
+				prob2 = (p + LZMA_IS_REP_0_LONG
+				        + (state << LZMA_NUM_POS_BITS_MAX)
+				        + pos_state
+				);
 				if (!rc_is_bit_1(rc, prob2)) {
-					prob2 = (p + LZMA_IS_REP_0_LONG
-					        + (state << LZMA_NUM_POS_BITS_MAX)
-					        + pos_state
-					);
-					if (!rc_is_bit_1(rc, prob2)) {
-#if ENABLE_FEATURE_LZMA_FAST
-						uint32_t pos = buffer_pos - rep0;
-						state = state < LZMA_NUM_LIT_STATES ? 9 : 11;
-						while (pos >= header.dict_size)
-							pos += header.dict_size;
-						previous_byte = buffer[pos];
-						goto one_byte1;
-#else
-						state = state < LZMA_NUM_LIT_STATES ? 9 : 11;
-						len = 1;
-						goto string;
-#endif
-					}
-				} else {
-					uint32_t distance;
+					state = state < LZMA_NUM_LIT_STATES ? 9 : 11;
+					len = 1;
+					goto copy_match;
+				}
+			} else {
+				uint32_t distance;
 
-					prob2 += LZMA_IS_REP_G1 - LZMA_IS_REP_G0;
-					distance = rep1;
+				prob2 += LZMA_IS_REP_G1 - LZMA_IS_REP_G0;
+				distance = rep1;
+				if (rc_is_bit_1(rc, prob2)) {
+					prob2 += LZMA_IS_REP_G2 - LZMA_IS_REP_G1;
+					distance = rep2;
 					if (rc_is_bit_1(rc, prob2)) {
-						prob2 += LZMA_IS_REP_G2 - LZMA_IS_REP_G1;
-						distance = rep2;
-						if (rc_is_bit_1(rc, prob2)) {
-							distance = rep3;
-							rep3 = rep2;
-						}
-						rep2 = rep1;
+						distance = rep3;
+						rep3 = rep2;
 					}
-					rep1 = rep0;
-					rep0 = distance;
+					rep2 = rep1;
 				}
-				state = state < LZMA_NUM_LIT_STATES ? 8 : 11;
-				prob2 = p + LZMA_REP_LEN_CODER;
+				rep1 = rep0;
+				rep0 = distance;
 			}
+			state = state < LZMA_NUM_LIT_STATES ? 8 : 11;
+			prob2 = p + LZMA_REP_LEN_CODER;
+		}
 
-			prob_len = prob2 + LZMA_LEN_CHOICE;
-			num_bits = LZMA_LEN_NUM_LOW_BITS;
+		prob_len = prob2 + LZMA_LEN_CHOICE;
+		num_bits = LZMA_LEN_NUM_LOW_BITS;
+		if (!rc_is_bit_1(rc, prob_len)) {
+			prob_len += LZMA_LEN_LOW - LZMA_LEN_CHOICE
+			            + (pos_state << LZMA_LEN_NUM_LOW_BITS);
+			offset = 0;
+		} else {
+			prob_len += LZMA_LEN_CHOICE_2 - LZMA_LEN_CHOICE;
 			if (!rc_is_bit_1(rc, prob_len)) {
-				prob_len += LZMA_LEN_LOW - LZMA_LEN_CHOICE
-				            + (pos_state << LZMA_LEN_NUM_LOW_BITS);
-				offset = 0;
+				prob_len += LZMA_LEN_MID - LZMA_LEN_CHOICE_2
+				            + (pos_state << LZMA_LEN_NUM_MID_BITS);
+				offset = 1 << LZMA_LEN_NUM_LOW_BITS;
+				num_bits += LZMA_LEN_NUM_MID_BITS - LZMA_LEN_NUM_LOW_BITS;
 			} else {
-				prob_len += LZMA_LEN_CHOICE_2 - LZMA_LEN_CHOICE;
-				if (!rc_is_bit_1(rc, prob_len)) {
-					prob_len += LZMA_LEN_MID - LZMA_LEN_CHOICE_2
-					            + (pos_state << LZMA_LEN_NUM_MID_BITS);
-					offset = 1 << LZMA_LEN_NUM_LOW_BITS;
-					num_bits += LZMA_LEN_NUM_MID_BITS - LZMA_LEN_NUM_LOW_BITS;
+				prob_len += LZMA_LEN_HIGH - LZMA_LEN_CHOICE_2;
+				offset = ((1 << LZMA_LEN_NUM_LOW_BITS)
+				          + (1 << LZMA_LEN_NUM_MID_BITS));
+				num_bits += LZMA_LEN_NUM_HIGH_BITS - LZMA_LEN_NUM_LOW_BITS;
+			}
+		}
+		{
+			int l;
+			rc_bit_tree_decode(rc, prob_len, num_bits, &l);
+			len = l + offset;
+		}
+
+		if (state < 4) {
+			int pos_slot;
+			uint16_t *prob3;
+
+			state += LZMA_NUM_LIT_STATES;
+			prob3 = p + LZMA_POS_SLOT +
+			       ((len < LZMA_NUM_LEN_TO_POS_STATES ? len :
+			         LZMA_NUM_LEN_TO_POS_STATES - 1)
+			         << LZMA_NUM_POS_SLOT_BITS);
+			rc_bit_tree_decode(rc, prob3,
+				LZMA_NUM_POS_SLOT_BITS, &pos_slot);
+			rep0 = pos_slot;
+			if (pos_slot >= LZMA_START_POS_MODEL_INDEX) {
+				int i2, mi2, num_bits2 = (pos_slot >> 1) - 1;
+				rep0 = 2 | (pos_slot & 1);
+				if (pos_slot < LZMA_END_POS_MODEL_INDEX) {
+					rep0 <<= num_bits2;
+					prob3 = p + LZMA_SPEC_POS + rep0 - pos_slot - 1;
 				} else {
-					prob_len += LZMA_LEN_HIGH - LZMA_LEN_CHOICE_2;
-					offset = ((1 << LZMA_LEN_NUM_LOW_BITS)
-					          + (1 << LZMA_LEN_NUM_MID_BITS));
-					num_bits += LZMA_LEN_NUM_HIGH_BITS - LZMA_LEN_NUM_LOW_BITS;
+					for (; num_bits2 != LZMA_NUM_ALIGN_BITS; num_bits2--)
+						rep0 = (rep0 << 1) | rc_direct_bit(rc);
+					rep0 <<= LZMA_NUM_ALIGN_BITS;
+					prob3 = p + LZMA_ALIGN;
+				}
+				i2 = 1;
+				mi2 = 1;
+				while (num_bits2--) {
+					if (rc_get_bit(rc, prob3 + mi2, &mi2))
+						rep0 |= i2;
+					i2 <<= 1;
 				}
 			}
-			rc_bit_tree_decode(rc, prob_len, num_bits, &len);
-			len += offset;
-
-			if (state < 4) {
-				int pos_slot;
-				uint16_t *prob3;
-
-				state += LZMA_NUM_LIT_STATES;
-				prob3 = p + LZMA_POS_SLOT +
-				       ((len < LZMA_NUM_LEN_TO_POS_STATES ? len :
-				         LZMA_NUM_LEN_TO_POS_STATES - 1)
-				         << LZMA_NUM_POS_SLOT_BITS);
-				rc_bit_tree_decode(rc, prob3,
-					LZMA_NUM_POS_SLOT_BITS, &pos_slot);
-				rep0 = pos_slot;
-				if (pos_slot >= LZMA_START_POS_MODEL_INDEX) {
-					int i2, mi2, num_bits2 = (pos_slot >> 1) - 1;
-					rep0 = 2 | (pos_slot & 1);
-					if (pos_slot < LZMA_END_POS_MODEL_INDEX) {
-						rep0 <<= num_bits2;
-						prob3 = p + LZMA_SPEC_POS + rep0 - pos_slot - 1;
-					} else {
-						for (; num_bits2 != LZMA_NUM_ALIGN_BITS; num_bits2--)
-							rep0 = (rep0 << 1) | rc_direct_bit(rc);
-						rep0 <<= LZMA_NUM_ALIGN_BITS;
-						prob3 = p + LZMA_ALIGN;
-					}
-					i2 = 1;
-					mi2 = 1;
-					while (num_bits2--) {
-						if (rc_get_bit(rc, prob3 + mi2, &mi2))
-							rep0 |= i2;
-						i2 <<= 1;
+			if (++rep0 == 0) {
+				len = 0;
+				ret = 1;
+				break;
+			}
+		}
+
+		len += LZMA_MATCH_MIN_LEN;
+ copy_match:
+		/* Copy as much as we can in one go: the match is cut short
+		 * by the end of the window, by the source wrapping around it,
+		 * and by the output limit. */
+		do {
+			uint32_t pos = buffer_pos - rep0;
+			uint32_t n = len;
+			uint64_t left = out_size - lz->global_pos - buffer_pos;
+			uint8_t *dst, *src;
+
+			while (pos >= dict_size)
+				pos += dict_size;
+			if (n > dict_size - buffer_pos)
+				n = dict_size - buffer_pos;
+			if (n > left)
+				n = left;
+			dst = buffer + buffer_pos;
+			src = buffer + pos;
+			if (pos < buffer_pos) {
+				if (rep0 >= n) {
+					memcpy(dst, src, n);
+				} else {
+					/* Overlapping: this repeats the last rep0 bytes */
+					uint32_t k = n;
+					if (rep0 >= sizeof(uint64_t)) {
+						for (; k >= sizeof(uint64_t); k -= sizeof(uint64_t)) {
+							memcpy(dst, src, sizeof(uint64_t));
+							dst += sizeof(uint64_t);
+							src += sizeof(uint64_t);
+						}
 					}
+					while (k--)
+						*dst++ = *src++;
 				}
-				if (++rep0 == 0)
-					break;
+			} else {
+				if (n > dict_size - pos)
+					n = dict_size - pos;
+				memmove(dst, src, n);
 			}
+			buffer_pos += n;
+			len -= n;
+			if (buffer_pos == dict_size)
+				WINDOW_FULL();
+		} while (len != 0 && lz->global_pos + buffer_pos < out_size);
+		previous_byte = buffer[(buffer_pos ? buffer_pos : dict_size) - 1];
+	}
+#undef WINDOW_FULL
+ done:
+	lz->buffer_pos = buffer_pos;
+	lz->state = state;
+	lz->rep0 = rep0;
+	lz->rep1 = rep1;
+	lz->rep2 = rep2;
+	lz->rep3 = rep3;
+	lz->len = len;
+	return ret;
+}
 
-			len += LZMA_MATCH_MIN_LEN;
- IF_NOT_FEATURE_LZMA_FAST(string:)
-			do {
-				uint32_t pos = buffer_pos - rep0;
-				while (pos >= header.dict_size)
-					pos += header.dict_size;
-				previous_byte = buffer[pos];
- IF_NOT_FEATURE_LZMA_FAST(one_byte2:)
-				buffer[buffer_pos++] = previous_byte;
-				if (buffer_pos == header.dict_size) {
-					buffer_pos = 0;
-					global_pos += header.dict_size;
-					if (full_write(dst_fd, buffer, header.dict_size) != (ssize_t)header.dict_size)
-						goto bad;
-					IF_DESKTOP(total_written += header.dict_size;)
-				}
-				len--;
-			} while (len != 0 && buffer_pos < header.dst_size);
+
+#if XZ_SUPPORT
+/*
+ * .xz container: stream header, blocks, index, stream footer.
+ * Blocks must use the LZMA2 filter alone (no BCJ or delta),
+ * which is what xz produces for plain files and kernel modules.
+ */
+
+enum {
+	XZ_CHECK_NONE = 0,
+	XZ_CHECK_CRC32 = 1,
+	XZ_CHECK_CRC64 = 4,
+	XZ_CHECK_SHA256 = 10,
+	XZ_FILTER_LZMA2 = 0x21,
+};
+
+static const uint8_t xz_magic[6] ALIGN1 = { 0xFD, '7', 'z', 'X', 'Z', 0 };
+
+struct xz_check {
+	int type;
+	uint32_t *crc32_table;
+	uint32_t crc32;
+	uint64_t crc64;
+	uint64_t crc64_table[256];
+	sha256_ctx_t sha256;
+};
+
+static uint32_t xz_le32(const uint8_t *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint32_t xz_crc32(const uint32_t *table, uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	crc = ~crc;
+	while (len--)
+		crc = table[(uint8_t)crc ^ *buf++] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void xz_check_update(struct xz_check *check, const uint8_t *buf, uint32_t len)
+{
+	switch (check->type) {
+	case XZ_CHECK_CRC32:
+		check->crc32 = xz_crc32(check->crc32_table, check->crc32, buf, len);
+		break;
+	case XZ_CHECK_CRC64: {
+		uint64_t crc = ~check->crc64;
+		while (len--)
+			crc = check->crc64_table[(uint8_t)crc ^ *buf++] ^ (crc >> 8);
+		check->crc64 = ~crc;
+		break;
+	}
+	case XZ_CHECK_SHA256:
+		sha256_hash(buf, len, &check->sha256);
+		break;
+	}
+}
+
+static void xz_check_begin(struct xz_check *check)
+{
+	check->crc32 = 0;
+	check->crc64 = 0;
+	if (check->type == XZ_CHECK_SHA256)
+		sha256_begin(&check->sha256);
+}
+
+/* Compare the stored check with what we computed, 0 if it matches */
+static int xz_check_end(struct xz_check *check, const uint8_t *stored)
+{
+	uint8_t buf[32];
+
+	switch (check->type) {
+	case XZ_CHECK_CRC32:
+		move_to_unaligned32(buf, SWAP_LE32(check->crc32));
+		return memcmp(buf, stored, 4);
+	case XZ_CHECK_CRC64: {
+		int i;
+		for (i = 0; i < 8; i++)
+			buf[i] = check->crc64 >> (i * 8);
+		return memcmp(buf, stored, 8);
+	}
+	case XZ_CHECK_SHA256:
+		sha256_end(buf, &check->sha256);
+		return memcmp(buf, stored, 32);
+	}
+	return 0; /* none, or a kind we don't know: not checked */
+}
+
+static unsigned xz_check_size(int type)
+{
+	/* 0, 4, 4, 4, 8, 8, 8, 16, 16, 16, 32, 32, 32, 64, 64, 64 */
+	return type ? 4 << ((type - 1) / 3) : 0;
+}
+
+/* Read a variable length integer from buf[*pos] */
+static int xz_vli(const uint8_t *buf, unsigned size, unsigned *pos, uint64_t *v)
+{
+	int i;
+
+	*v = 0;
+	for (i = 0; i < 9 && *pos < size; i++) {
+		uint8_t b = buf[(*pos)++];
+		*v |= (uint64_t)(b & 0x7f) << (i * 7);
+		if (!(b & 0x80))
+			return (b == 0 && i) ? -1 : 0;
+	}
+	return -1;
+}
+
+/* Same, straight from the input, CRC32 of the bytes is updated */
+static uint64_t xz_read_vli(rc_t *rc, const uint32_t *table, uint32_t *crc)
+{
+	uint8_t buf[9];
+	unsigned n = 0;
+	uint64_t v;
+
+	do {
+		buf[n] = rc_get_byte(rc);
+	} while ((buf[n++] & 0x80) && n < sizeof(buf));
+	*crc = xz_crc32(table, *crc, buf, n);
+	n = 0;
+	if (xz_vli(buf, sizeof(buf), &n, &v))
+		bb_error_msg_and_die("corrupted data");
+	return v;
+}
+
+/* Decode the LZMA2 chunks of one block */
+static int xz_lzma2(lzma_t *lz, rc_t *rc)
+{
+	/* Nothing would fit: a worker whose block is "empty" */
+	if (lz->dict_size == 0)
+		return -2;
+	for (;;) {
+		unsigned ctrl, unpacked, packed;
+		off_t start;
+		int r;
+
+		ctrl = rc_get_byte(rc);
+		if (ctrl == 0)
+			return 0;
+		if (ctrl >= 0xE0 || ctrl == 1) {
+			/* Dictionary reset. Parallel workers keep the whole
+			 * block in the window, so they can only do it first */
+			if (lz->dst_fd < 0 && (lz->buffer_pos | lz->global_pos))
+				return -2;
+			if (lzma_flush(lz))
+				return -1;
+			lz->buffer_pos = lz->flushed = 0;
+			lz->global_pos = 0;
+		}
+		unpacked = rc_get_byte(rc) << 8;
+		unpacked |= rc_get_byte(rc);
+		unpacked++;
+		if (ctrl < 0x80) {
+			/* Uncompressed chunk */
+			if (ctrl > 2)
+				return -2;
+			while (unpacked) {
+				unsigned n = unpacked;
+
+				if (rc->ptr >= rc->buffer_end)
+					rc_read(rc);
+				if (n > rc->buffer_end - rc->ptr)
+					n = rc->buffer_end - rc->ptr;
+				if (n > lz->dict_size - lz->buffer_pos)
+					n = lz->dict_size - lz->buffer_pos;
+				memcpy(lz->buffer + lz->buffer_pos, rc->ptr, n);
+				rc->ptr += n;
+				lz->buffer_pos += n;
+				unpacked -= n;
+				if (lz->buffer_pos == lz->dict_size && lzma_flush(lz))
+					return -1;
+			}
+			continue;
+		}
+
+		unpacked += (ctrl & 0x1f) << 16;
+		packed = rc_get_byte(rc) << 8;
+		packed |= rc_get_byte(rc);
+		packed++;
+		if (ctrl >= 0xC0) {
+			/* New properties */
+			if (lzma_set_props(lz, rc_get_byte(rc))
+			 || lz->lc + lz->lp > LZMA2_LCLP_MAX
+			) {
+				return -2;
+			}
+		}
+		if (ctrl >= 0xA0)
+			lzma_reset_state(lz);
+
+		start = rc_tell(rc);
+		rc_start(rc);
+		r = lzma_decode(lz, rc, lz->global_pos + lz->buffer_pos + unpacked);
+		if (r)
+			return r < 0 ? r : -2; /* end marker isn't allowed in LZMA2 */
+		rc_normalize(rc);
+		if (lz->len || rc->code || rc_tell(rc) - start != packed)
+			return -2;
+	}
+}
+
+/* Decode one block, its header size byte is already read.
+ * max_size is what the index says the biggest block unpacks to, if known.
+ * Returns NULL and the sizes which go into the index, or an error. */
+static const char *xz_block(lzma_t **lzp, rc_t *rc, struct xz_check *check,
+		int dst_fd, unsigned size_byte, uint64_t max_size,
+		uint64_t *unpadded, uint64_t *uncompressed)
+{
+	lzma_t *lz = *lzp;
+	uint8_t buf[1024];
+	unsigned size, pos, pad;
+	uint64_t v, dict, compressed_size, uncompressed_size;
+	off_t start;
+	int r;
+
+	buf[0] = size_byte;
+	size = (size_byte + 1) * 4;
+	xz_read(rc, buf + 1, size - 1);
+	if (xz_crc32(check->crc32_table, 0, buf, size - 4) != xz_le32(buf + size - 4))
+		return "corrupted data";
+	if (buf[1] & 0x3f) /* more than one filter, or reserved bits */
+		return "unsupported xz filter";
+	pos = 2;
+	compressed_size = uncompressed_size = (uint64_t)-1;
+	if ((buf[1] & 0x40) && xz_vli(buf, size - 4, &pos, &compressed_size))
+		return "corrupted data";
+	if ((buf[1] & 0x80) && xz_vli(buf, size - 4, &pos, &uncompressed_size))
+		return "corrupted data";
+	if (xz_vli(buf, size - 4, &pos, &v))
+		return "corrupted data";
+	if (v != XZ_FILTER_LZMA2)
+		return "unsupported xz filter";
+	if (xz_vli(buf, size - 4, &pos, &v) || v != 1 || pos >= size - 4 || buf[pos] > 40)
+		return "corrupted data";
+	dict = (buf[pos] == 40) ? 0xFFFFFFFF : (uint64_t)(2 | (buf[pos] & 1)) << (buf[pos] / 2 + 11);
+	while (++pos < size - 4)
+		if (buf[pos])
+			return "corrupted data";
+
+	/* No need for a window bigger than the whole block. xz only puts
+	 * its size in the header when it packs in threads, else the index
+	 * may tell. If the index lies, the block won't match it.
+	 * Parallel workers already have one exactly that big. */
+	v = (uncompressed_size != (uint64_t)-1) ? uncompressed_size : max_size;
+	if (dict > v)
+		dict = v ? v : 1;
+	if (!lz || (lz->dst_fd >= 0 && lz->dict_size < dict)) {
+		lzma_t *old = lz;
+
+		lz = lzma_alloc(NULL, dict, LZMA2_LCLP_MAX, dst_fd);
+		lz->check = check;
+		if (old) {
+			IF_DESKTOP(lz->total_written = old->total_written;)
+			lzma_free(old);
+		}
+		*lzp = lz;
+	}
+	lz->buffer_pos = lz->flushed = 0;
+	lz->global_pos = 0;
+	lz->lc = lz->lp = 0; /* first chunk must set them */
+	xz_check_begin(check);
+
+	start = rc_tell(rc);
+	r = xz_lzma2(lz, rc);
+	if (r == 0)
+		r = lzma_flush(lz);
+	if (r)
+		return (r == -1) ? "write error" : "corrupted data";
+	v = rc_tell(rc) - start;
+	*uncompressed = lz->global_pos + lz->buffer_pos;
+	if ((compressed_size != (uint64_t)-1 && v != compressed_size)
+	 || (uncompressed_size != (uint64_t)-1 && *uncompressed != uncompressed_size)
+	) {
+		return "corrupted data";
+	}
+	*unpadded = size + v + xz_check_size(check->type);
+	/* Block padding, then the check */
+	for (pad = (-v) & 3; pad; pad--)
+		if (rc_get_byte(rc))
+			return "corrupted data";
+	xz_read(rc, buf, xz_check_size(check->type));
+	if (xz_check_end(check, buf))
+		return "CRC error";
+	return NULL;
+}
+
+#if ENABLE_FEATURE_LZMA_FAST
+/* In an mmapped input, with rc->ptr at the first block: this stream's
+ * index, found through the footer at the end of the input, and the
+ * position of its first record. If more streams follow this one,
+ * the footer found is not ours: the caller must check that the
+ * records add up to where the index is. */
+static const uint8_t *xz_map_index(rc_t *rc, struct xz_check *check,
+		size_t *idx_size, unsigned *pos, uint64_t *count)
+{
+	const uint8_t *base = rc->ptr;
+	const uint8_t *end = rc->buffer_end;
+	const uint8_t *idx;
+
+	if (!rc->map)
+		return NULL;
+	/* Stream padding, then the footer */
+	while (end - base >= 12 + 4 && end[-1] == 0 && end[-2] == 0 && end[-3] == 0 && end[-4] == 0)
+		end -= 4;
+	if (end - base < 12
+	 || end[-2] != 'Y' || end[-1] != 'Z' || end[-4] != 0 || end[-3] != check->type
+	 || xz_crc32(check->crc32_table, 0, end - 8, 6) != xz_le32(end - 12)
+	) {
+		return NULL;
+	}
+	*idx_size = ((size_t)xz_le32(end - 8) + 1) * 4;
+	if (*idx_size < 8 || *idx_size > (size_t)(end - 12 - base))
+		return NULL;
+	idx = end - 12 - *idx_size;
+	if (idx[0] != 0
+	 || xz_crc32(check->crc32_table, 0, idx, *idx_size - 4) != xz_le32(idx + *idx_size - 4)
+	) {
+		return NULL;
+	}
+	*pos = 1;
+	if (xz_vli(idx, *idx_size - 4, pos, count))
+		return NULL;
+	return idx;
+}
+
+/* The most any block of this stream unpacks to, -1 if unknown */
+static uint64_t xz_max_block(rc_t *rc, struct xz_check *check)
+{
+	const uint8_t *idx;
+	size_t idx_size;
+	unsigned pos;
+	uint64_t count, unpadded, uncompressed, offset, max;
+
+	idx = xz_map_index(rc, check, &idx_size, &pos, &count);
+	if (!idx)
+		return (uint64_t)-1;
+	offset = max = 0;
+	while (count--) {
+		if (xz_vli(idx, idx_size - 4, &pos, &unpadded)
+		 || xz_vli(idx, idx_size - 4, &pos, &uncompressed)
+		) {
+			return (uint64_t)-1;
+		}
+		offset += (unpadded + 3) & ~(uint64_t)3;
+		if (max < uncompressed)
+			max = uncompressed;
+	}
+	if (offset != (uint64_t)(idx - rc->ptr))
+		return (uint64_t)-1;
+	return max;
+}
+#else
+# define xz_max_block(rc, check) ((uint64_t)-1)
+#endif
+
+#if ENABLE_FEATURE_XZ_PARALLEL
+unsigned unpack_xz_jobs;
+
+/* Each worker holds a whole block in memory, bigger blocks
+ * are left to the serial decoder */
+#define XZ_PAR_MAX_BLOCK (64 * 1024 * 1024)
+
+struct xz_job {
+	pid_t pid;
+	uint8_t *out;           /* shared mapping the worker unpacks into */
+	uint64_t offset;        /* of the block, from the first one */
+	uint64_t unpadded;
+	uint64_t uncompressed;
+};
+
+static void xz_start_job(struct xz_job *job, const uint8_t *base, struct xz_check *check)
+{
+	job->out = mmap(NULL, job->uncompressed + 1, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (job->out == MAP_FAILED)
+		bb_perror_msg_and_die("mmap");
+	job->pid = fork();
+	if (job->pid < 0)
+		bb_perror_msg_and_die("vfork" + 1);
+	if (job->pid == 0) {
+		/* Block is fully in the map, running past it is an error:
+		 * fd -1 makes rc_read() hit "EOF" */
+		rc_t rc;
+		lzma_t *lz;
+		uint64_t unpadded, uncompressed;
+		const char *err;
+
+		logmode = LOGMODE_NONE; /* parent will say what's wrong */
+		memset(&rc, 0, sizeof(rc));
+		rc.fd = -1;
+		rc.ptr = (uint8_t *)base + job->offset;
+		rc.buffer_end = rc.ptr + ((job->unpadded + 3) & ~(uint64_t)3);
+		lz = lzma_alloc(job->out, job->uncompressed, LZMA2_LCLP_MAX, -1);
+		lz->check = check;
+		err = xz_block(&lz, &rc, check, -1, rc_get_byte(&rc), job->uncompressed,
+				&unpadded, &uncompressed);
+		_exit(err || unpadded != job->unpadded || uncompressed != job->uncompressed);
+	}
+}
+
+static void xz_kill_job(struct xz_job *job)
+{
+	kill(job->pid, SIGKILL);
+	safe_waitpid(job->pid, NULL, 0);
+	munmap(job->out, job->uncompressed + 1);
+}
+
+/* Unpack the blocks of an mmapped stream in forked workers, using
+ * the index at its end to find them. rc->ptr is at the first block.
+ * Returns bytes written (or 0 if DESKTOP is off), -1 on write error.
+ * Blocks which were done are counted into *blocks and the sums, and
+ * rc->ptr is moved past them, so that the serial code can go on from
+ * there (it also checks the index). If a worker fails, its block is
+ * redone serially to get the right error message. */
+static IF_DESKTOP(long long) int xz_parallel(rc_t *rc, struct xz_check *check, int dst_fd,
+		uint64_t *blocks, uint64_t *unpadded_sum, uint64_t *uncompressed_sum)
+{
+	const uint8_t *base = rc->ptr;
+	const uint8_t *idx;
+	struct xz_job *jobs;
+	uint64_t count, offset, i;
+	size_t idx_size;
+	unsigned pos, nworkers, head, running;
+	int write_err = 0;
+	IF_DESKTOP(long long total = 0;)
+
+	nworkers = unpack_xz_jobs;
+	if (nworkers == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nworkers = MIN(ncpu, 8);
+	}
+	if ((int)nworkers < 2)
+		return 0;
+
+	/* Where are the blocks, and are they small enough? */
+	idx = xz_map_index(rc, check, &idx_size, &pos, &count);
+	if (!idx || count < 2 || count > idx_size / 2)
+		return 0;
+	jobs = xzalloc(count * sizeof(jobs[0]));
+	offset = 0;
+	for (i = 0; i < count; i++) {
+		/* A block can't be empty or bigger than the stream. Let
+		 * the serial code say what is wrong with such an index */
+		if (xz_vli(idx, idx_size - 4, &pos, &jobs[i].unpadded)
+		 || xz_vli(idx, idx_size - 4, &pos, &jobs[i].uncompressed)
+		 || jobs[i].unpadded == 0
+		 || jobs[i].unpadded > (uint64_t)(idx - base)
+		 || jobs[i].uncompressed == 0
+		 || jobs[i].uncompressed > XZ_PAR_MAX_BLOCK
+		) {
+			goto serial;
+		}
+		jobs[i].offset = offset;
+		offset += (jobs[i].unpadded + 3) & ~(uint64_t)3;
+	}
+	/* If it doesn't add up, it's not this stream's index */
+	if (offset != idx - base)
+		goto serial;
+
+	/* Keep nworkers blocks in flight, write them out in order */
+	head = running = 0;
+	for (i = 0; i < count; i++) {
+		int status = -1;
+		ssize_t n = 0;
+
+		while (running < nworkers && head + running < count) {
+			xz_start_job(&jobs[head + running], base, check);
+			running++;
+		}
+		safe_waitpid(jobs[i].pid, &status, 0);
+		running--;
+		head++;
+		if (status == 0)
+			n = full_write(dst_fd, jobs[i].out, jobs[i].uncompressed);
+		munmap(jobs[i].out, jobs[i].uncompressed + 1);
+		if (status != 0)
+			break;
+		if (n != (ssize_t)jobs[i].uncompressed) {
+			write_err = 1;
+			break;
 		}
+		IF_DESKTOP(total += jobs[i].uncompressed;)
+		(*blocks)++;
+		*unpadded_sum += jobs[i].unpadded;
+		*uncompressed_sum += jobs[i].uncompressed;
+		rc->ptr = (uint8_t *)base + jobs[i].offset + ((jobs[i].unpadded + 3) & ~(uint64_t)3);
 	}
+	/* Stopped early: drop what is still running */
+	while (running--)
+		xz_kill_job(&jobs[head + running]);
+ serial:
+	free(jobs);
+	if (write_err)
+		return -1;
+	return IF_DESKTOP(total) + 0;
+}
+#endif
+
+static IF_DESKTOP(long long) int
+unpack_xz_stream_rc(rc_t *rc, int dst_fd)
+{
+	struct xz_check *check;
+	lzma_t *lz = NULL;
+	uint8_t buf[12];
+	uint32_t crc;
+	off_t index_start, index_size;
+	uint64_t blocks, unpadded_sum, uncompressed_sum, max_block;
+	unsigned pad;
+	IF_DESKTOP(long long total = 0;)
+	IF_DESKTOP(long long) int status;
+	const char *err = "corrupted data";
 
+	check = xzalloc(sizeof(*check));
+	check->crc32_table = crc32_filltable(NULL, 0);
 	{
-		IF_NOT_DESKTOP(int total_written = 0; /* success */)
-		IF_DESKTOP(total_written += buffer_pos;)
-		if (full_write(dst_fd, buffer, buffer_pos) != (ssize_t)buffer_pos) {
- bad:
-			total_written = -1; /* failure */
+		int i, j;
+		for (i = 0; i < 256; i++) {
+			uint64_t c = i;
+			for (j = 0; j < 8; j++)
+				c = (c >> 1) ^ (0xC96C5795D7870F42ULL & (0 - (c & 1)));
+			check->crc64_table[i] = c;
 		}
+	}
+
+ next_stream:
+	/* Stream header: the magic is already read */
+	xz_read(rc, buf, 6);
+	if (buf[0] != 0 || (buf[1] & 0xf0)
+	 || xz_crc32(check->crc32_table, 0, buf, 2) != xz_le32(buf + 2)
+	) {
+		goto bad;
+	}
+	check->type = buf[1];
+	blocks = unpadded_sum = uncompressed_sum = 0;
+	max_block = xz_max_block(rc, check);
+
+#if ENABLE_FEATURE_XZ_PARALLEL
+	status = xz_parallel(rc, check, dst_fd, &blocks, &unpadded_sum, &uncompressed_sum);
+	if (status < 0) {
+		err = "write error";
+		goto bad;
+	}
+	IF_DESKTOP(total += status;)
+#endif
+
+	for (;;) {
+		uint64_t unpadded, uncompressed;
+
+		/* Block header, or index if size byte is 0 */
+		buf[0] = rc_get_byte(rc);
+		if (buf[0] == 0)
+			break;
+		err = xz_block(&lz, rc, check, dst_fd, buf[0], max_block,
+				&unpadded, &uncompressed);
+		if (err)
+			goto bad;
+		err = "corrupted data";
+		unpadded_sum += unpadded;
+		uncompressed_sum += uncompressed;
+		blocks++;
+	}
+
+	/* Index: compare with what we saw */
+	{
+		uint64_t count, unpadded, uncompressed;
+		unsigned n;
+
+		index_start = rc_tell(rc) - 1;
+
+		crc = xz_crc32(check->crc32_table, 0, buf, 1);
+		count = xz_read_vli(rc, check->crc32_table, &crc);
+		if (count != blocks)
+			goto bad;
+		while (count--) {
+			unpadded = xz_read_vli(rc, check->crc32_table, &crc);
+			uncompressed = xz_read_vli(rc, check->crc32_table, &crc);
+			unpadded_sum -= unpadded;
+			uncompressed_sum -= uncompressed;
+		}
+		if (unpadded_sum || uncompressed_sum)
+			goto bad;
+		for (n = (index_start - rc_tell(rc)) & 3; n; n--) {
+			buf[0] = rc_get_byte(rc);
+			if (buf[0])
+				goto bad;
+			crc = xz_crc32(check->crc32_table, crc, buf, 1);
+		}
+		xz_read(rc, buf, 4);
+		if (crc != xz_le32(buf))
+			goto bad;
+	}
+
+	/* Stream footer, its backward size is that of the index */
+	index_size = rc_tell(rc) - index_start;
+	xz_read(rc, buf, 12);
+	if (buf[8] != 0 || buf[9] != check->type || buf[10] != 'Y' || buf[11] != 'Z'
+	 || xz_crc32(check->crc32_table, 0, buf + 4, 6) != xz_le32(buf)
+	 || ((uint64_t)xz_le32(buf + 4) + 1) * 4 != index_size
+	) {
+		goto bad;
+	}
+
+	/* Stream padding, and maybe another stream */
+	for (pad = 0;; pad++) {
+		if (rc->ptr >= rc->buffer_end && !rc_try_read(rc))
+			break;
+		if (*rc->ptr) {
+			if (pad & 3)
+				goto bad;
+			xz_read(rc, buf, 6);
+			if (memcmp(buf, xz_magic, 6) != 0)
+				goto bad;
+			goto next_stream;
+		}
+		rc->ptr++;
+	}
+	if (pad & 3)
+		goto bad;
+
+	status = IF_DESKTOP(total + (lz ? lz->total_written : 0) +) 0;
+	goto ret;
+
+ bad:
+	bb_error_msg("%s", err);
+	status = -1;
+ ret:
+	if (lz)
+		lzma_free(lz);
+	free(check->crc32_table);
+	free(check);
+	return status;
+}
+
+IF_DESKTOP(long long) int FAST_FUNC
+unpack_xz_stream(int src_fd, int dst_fd)
+{
+	IF_DESKTOP(long long) int status;
+	rc_t *rc;
+
+	rc = rc_init(src_fd);
+	status = unpack_xz_stream_rc(rc, dst_fd);
+	rc_free(rc);
+	return status;
+}
+
+IF_DESKTOP(long long) int FAST_FUNC
+unpack_xz_stream_prime(int src_fd, int dst_fd)
+{
+	uint8_t magic[6];
+
+	xread(src_fd, magic, 6);
+	if (memcmp(magic, xz_magic, 6) != 0) {
+		bb_error_msg("invalid magic");
+		return -1;
+	}
+	return unpack_xz_stream(src_fd, dst_fd);
+}
+#endif
+
+
+IF_DESKTOP(long long) int FAST_FUNC
+unpack_lzma_stream(int src_fd, int dst_fd)
+{
+	IF_DESKTOP(long long total_written;)
+	lzma_header_t header;
+	lzma_t *lz;
+	rc_t *rc;
+	int r;
+
+	rc = rc_init(src_fd); /*, RC_BUFFER_SIZE); */
+
+	xz_read(rc, (uint8_t*)&header, 6);
+#if ENABLE_FEATURE_LZMA_XZ
+	if (memcmp(&header, xz_magic, 6) == 0) {
+		IF_DESKTOP(long long) int status = unpack_xz_stream_rc(rc, dst_fd);
 		rc_free(rc);
-		free(p);
-		free(buffer);
-		return total_written;
+		return status;
 	}
+#endif
+	xz_read(rc, (uint8_t*)&header + 6, sizeof(header) - 6);
+	if (header.pos >= (9 * 5 * 5)) {
+		bb_error_msg("bad lzma header");
+		rc_free(rc);
+		return -1;
+	}
+
+	header.dict_size = SWAP_LE32(header.dict_size);
+	header.dst_size = SWAP_LE64(header.dst_size);
+
+	if (header.dict_size == 0)
+		header.dict_size++;
+
+	lz = lzma_alloc(NULL, MIN(header.dst_size, header.dict_size),
+			header.pos / 9 % 5 + header.pos % 9, dst_fd);
+	lzma_set_props(lz, header.pos);
+	lzma_reset_state(lz);
+
+	rc_start(rc);
+	r = lzma_decode(lz, rc, header.dst_size);
+	if (r >= 0)
+		r = lzma_flush(lz);
+	IF_DESKTOP(total_written = lz->total_written;)
+	rc_free(rc);
+	lzma_free(lz);
+	if (r < 0)
+		return -1; /* failure */
+	return IF_DESKTOP(total_written) + 0; /* success */
 }
@@ -118,6 +118,16 @@ typedef struct state_t {
 
 	const char *error_msg;
 	jmp_buf error_jmp;
+
+#if ENABLE_FEATURE_TAR_INDEX
+	/* unpack_gz_stream_indexed() */
+	gz_checkpoint_t *checkpoint;
+	int checkpoint_fd;
+	off_t checkpoint_next; /* output offset for the next one */
+	off_t out_base; /* output of previous gzip members */
+	const gz_checkpoint_t *resume;
+	unsigned resume_w;
+#endif
 } state_t;
 #define gunzip_bytes_out    (S()gunzip_bytes_out   )
 #define gunzip_crc          (S()gunzip_crc         )
@@ -155,6 +165,12 @@ typedef struct state_t {
 #define inflate_stored_w    (S()inflate_stored_w   )
 #define error_msg           (S()error_msg          )
 #define error_jmp           (S()error_jmp          )
+#define checkpoint          (S()checkpoint         )
+#define checkpoint_fd       (S()checkpoint_fd      )
+#define checkpoint_next     (S()checkpoint_next    )
+#define out_base            (S()out_base           )
+#define resume              (S()resume             )
+#define resume_w            (S()resume_w           )
 
 /* This is a generic part */
 #if STATE_IN_BSS /* Use global data segment */
@@ -929,10 +945,34 @@ static void calculate_gunzip_crc(STATE_PARAM_ONLY)
 	gunzip_bytes_out += gunzip_outbuf_count;
 }
 
+#if ENABLE_FEATURE_TAR_INDEX
+/* Between two blocks nothing but the bit buffer, the input position
+ * and the window carries over, so this is a place to restart from */
+static void save_checkpoint(STATE_PARAM_ONLY)
+{
+	gz_checkpoint_t *cp = checkpoint;
+
+	cp->out_ofs = out_base + gunzip_bytes_out;
+	cp->in_ofs = xlseek(gunzip_src_fd, 0, SEEK_CUR)
+			- (bytebuffer_size - bytebuffer_offset);
+	cp->bitbuf = gunzip_bb;
+	cp->bitcnt = gunzip_bk;
+	cp->wpos = gunzip_outbuf_count;
+	memcpy(cp->window, gunzip_window, GUNZIP_WSIZE);
+	xwrite(checkpoint_fd, cp, sizeof(*cp));
+	checkpoint_next = cp->out_ofs + cp->wpos + GZ_CHECKPOINT_SPAN;
+}
+#endif
+
 /* One callsite in inflate_unzip_internal */
 static int inflate_get_next_window(STATE_PARAM_ONLY)
 {
 	gunzip_outbuf_count = 0;
+#if ENABLE_FEATURE_TAR_INDEX
+	/* Restarted in mid-window */
+	gunzip_outbuf_count = resume_w;
+	resume_w = 0;
+#endif
 
 	while (1) {
 		int ret;
@@ -944,6 +984,13 @@ static int inflate_get_next_window(STATE_PARAM_ONLY)
 				/* NB: need_another_block is still set */
 				return 0; /* Last block */
 			}
+#if ENABLE_FEATURE_TAR_INDEX
+			if (checkpoint
+			 && out_base + gunzip_bytes_out + gunzip_outbuf_count >= checkpoint_next
+			) {
+				save_checkpoint(PASS_STATE_ONLY);
+			}
+#endif
 			method = inflate_block(PASS_STATE &end_reached);
 			need_another_block = 0;
 		}
@@ -993,6 +1040,15 @@ inflate_unzip_internal(STATE_PARAM int in, int out)
 	gunzip_crc_table = crc32_filltable(NULL, 0);
 	gunzip_crc = ~0;
 
+#if ENABLE_FEATURE_TAR_INDEX
+	if (resume) {
+		memcpy(gunzip_window, resume->window, GUNZIP_WSIZE);
+		resume_w = resume->wpos;
+		gunzip_bb = resume->bitbuf;
+		gunzip_bk = resume->bitcnt;
+	}
+#endif
+
 	error_msg = "corrupted data";
 	if (setjmp(error_jmp)) {
 		/* Error from deep inside zip machinery */
@@ -1181,22 +1237,32 @@ static int check_header_gzip(STATE_PARAM unpack_info_t *info)
 	return 1;
 }
 
-IF_DESKTOP(long long) int FAST_FUNC
-unpack_gz_stream_with_info(int in, int out, unpack_info_t *info)
+static IF_DESKTOP(long long) int
+unpack_gz_internal(STATE_PARAM int in, int out, unpack_info_t *info)
 {
 	uint32_t v32;
 	IF_DESKTOP(long long) int n;
-	DECLARE_STATE;
+#if ENABLE_FEATURE_TAR_INDEX
+	smallint resumed;
+#else
+	enum { resumed = 0 };
+#endif
 
 	n = 0;
 
-	ALLOC_STATE;
 	to_read = -1;
 //	bytebuffer_max = 0x8000;
 	bytebuffer = xmalloc(bytebuffer_max);
 	gunzip_src_fd = in;
 
  again:
+#if ENABLE_FEATURE_TAR_INDEX
+	resumed = (resume != NULL);
+	if (resumed) {
+		/* In the middle of a member, no header to read */
+		xlseek(in, resume->in_ofs, SEEK_SET);
+	} else
+#endif
 	if (!check_header_gzip(PASS_STATE info)) {
 		bb_error_msg("corrupted data");
 		n = -1;
@@ -1205,6 +1271,10 @@ unpack_gz_stream_with_info(int in, int out, unpack_info_t *info)
 	n += inflate_unzip_internal(PASS_STATE in, out);
 	if (n < 0)
 		goto ret;
+#if ENABLE_FEATURE_TAR_INDEX
+	out_base += gunzip_bytes_out;
+	resume = NULL;
+#endif
 
 	if (!top_up(PASS_STATE 8)) {
 		bb_error_msg("corrupted data");
@@ -1214,6 +1284,11 @@ unpack_gz_stream_with_info(int in, int out, unpack_info_t *info)
 
 	/* Validate decompression - crc */
 	v32 = buffer_read_le_u32(PASS_STATE_ONLY);
+	if (resumed) {
+		/* We did not see the start of this member */
+		bytebuffer_offset += 4;
+		goto next;
+	}
 	if ((~gunzip_crc) != v32) {
 		bb_error_msg("crc error");
 		n = -1;
@@ -1227,6 +1302,7 @@ unpack_gz_stream_with_info(int in, int out, unpack_info_t *info)
 		n = -1;
 	}
 
+ next:
 	if (!top_up(PASS_STATE 2))
 		goto ret; /* EOF */
 
@@ -1241,6 +1317,17 @@ unpack_gz_stream_with_info(int in, int out, unpack_info_t *info)
 
  ret:
 	free(bytebuffer);
+	return n;
+}
+
+IF_DESKTOP(long long) int FAST_FUNC
+unpack_gz_stream_with_info(int in, int out, unpack_info_t *info)
+{
+	IF_DESKTOP(long long) int n;
+	DECLARE_STATE;
+
+	ALLOC_STATE;
+	n = unpack_gz_internal(PASS_STATE in, out, info);
 	DEALLOC_STATE;
 	return n;
 }
@@ -1250,3 +1337,24 @@ unpack_gz_stream(int in, int out)
 {
 	return unpack_gz_stream_with_info(in, out, NULL);
 }
+
+#if ENABLE_FEATURE_TAR_INDEX
+IF_DESKTOP(long long) int FAST_FUNC
+unpack_gz_stream_indexed(int in, int out, int cp_fd, const gz_checkpoint_t *cp)
+{
+	IF_DESKTOP(long long) int n;
+	DECLARE_STATE;
+
+	ALLOC_STATE;
+	if (cp_fd >= 0) {
+		checkpoint = xmalloc(sizeof(*checkpoint));
+		checkpoint_fd = cp_fd;
+		checkpoint_next = GZ_CHECKPOINT_SPAN;
+	}
+	resume = cp;
+	n = unpack_gz_internal(PASS_STATE in, out, NULL);
+	free(checkpoint);
+	DEALLOC_STATE;
+	return n;
+}
+#endif
@@ -99,6 +99,73 @@ static unsigned long long getOctal(char *str, int len)
 }
 #define GET_OCTAL(a) getOctal((a), sizeof(a))
 
+#if ENABLE_FEATURE_TAR_SPARSE
+/* Like GET_OCTAL, but leaves the following field alone */
+static off_t get_sparse_num(const char *str)
+{
+	char buf[13];
+
+	if ((str[0] & 0xc0) == 0x80) { /* positive base256 */
+		off_t value = str[0] & 0x3f;
+		int i;
+		for (i = 1; i < 12; i++)
+			value = (value << 8) + (unsigned char) str[i];
+		return value;
+	}
+	memcpy(buf, str, 12);
+	return getOctal(buf, 12);
+}
+
+/* Old GNU sparse header: up to 4 (offset, numbytes) pairs at 386,
+ * "isextended" flag at 482, real file size at 483. If isextended
+ * is set, 512-byte blocks with 21 more pairs follow the header,
+ * each with its own isextended flag at 504 */
+static void get_sparse_map(archive_handle_t *archive_handle, char *hdr)
+{
+	file_header_t *file_header = archive_handle->file_header;
+	off_t *map = NULL;
+	off_t data_size = 0;
+	off_t last_end = 0;
+	unsigned n = 0;
+	char *sp = hdr + 386;
+	int cnt = 4;
+	char ext[512];
+
+	file_header->tar__sparse_size = get_sparse_num(hdr + 483);
+	hdr += 482;
+	while (1) {
+		while (--cnt >= 0 && sp[12]) {
+			map = xrealloc_vector(map, 4, 2 * n);
+			map[2*n] = get_sparse_num(sp);
+			map[2*n + 1] = get_sparse_num(sp + 12);
+			/* Regions must be sorted and inside the file */
+			if (map[2*n] < last_end
+			 || map[2*n] + map[2*n + 1] > file_header->tar__sparse_size
+			) {
+				goto corrupt;
+			}
+			last_end = map[2*n] + map[2*n + 1];
+			data_size += map[2*n + 1];
+			n++;
+			sp += 24;
+		}
+		if (!*hdr) /* !isextended */
+			break;
+		xread(archive_handle->src_fd, ext, 512);
+		archive_handle->offset += 512;
+		sp = ext;
+		cnt = 21;
+		hdr = ext + 504;
+	}
+	if (data_size != file_header->size) {
+ corrupt:
+		bb_error_msg_and_die("corrupted sparse map in tar header");
+	}
+	file_header->tar__sparse = map;
+	file_header->tar__sparse_cnt = n;
+}
+#endif
+
 void BUG_tar_header_size(void);
 char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 {
@@ -151,6 +218,11 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 #endif
 	/* Align header */
 	data_align(archive_handle, 512);
+#if ENABLE_FEATURE_TAR_INDEX
+	/* Longname headers belong to the member after them */
+	if (!p_longname && !p_linkname)
+		archive_handle->tar__hdr_offset = archive_handle->offset;
+#endif
 
  again_after_align:
 
@@ -206,9 +278,9 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 		char FAST_FUNC (*get_header_ptr)(archive_handle_t *);
 
  autodetect:
-		/* tar gz/bz autodetect: check for gz/bz2 magic.
+		/* tar gz/bz/xz autodetect: check for gz/bz2/xz magic.
 		 * If we see the magic, and it is the very first block,
-		 * we can switch to get_header_tar_gz/bz2/lzma().
+		 * we can switch to get_header_tar_gz/bz2/xz().
 		 * Needs seekable fd. I wish recv(MSG_PEEK) works
 		 * on any fd... */
 #if ENABLE_FEATURE_SEAMLESS_GZ
@@ -222,11 +294,16 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 		) { /* bzip2 */
 			get_header_ptr = get_header_tar_bz2;
 		} else
+#endif
+#if ENABLE_FEATURE_SEAMLESS_XZ
+		if (memcmp(tar.name, "\xfd" "7zXZ\0", 6) == 0) { /* xz */
+			get_header_ptr = get_header_tar_xz;
+		} else
 #endif
 			goto err;
 		/* Two different causes for lseek() != 0:
 		 * unseekable fd (would like to support that too, but...),
-		 * or not first block (false positive, it's not .gz/.bz2!) */
+		 * or not first block (false positive, it's not .gz/.bz2/.xz!) */
 		if (lseek(archive_handle->src_fd, -i, SEEK_CUR) != 0)
 			goto err;
 		while (get_header_ptr(archive_handle) == EXIT_SUCCESS)
@@ -362,6 +439,17 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 	case '6':
 		file_header->mode |= S_IFIFO;
 		goto size0;
+#if ENABLE_FEATURE_TAR_SPARSE
+	case 'S':	/* Sparse file */
+		/* prefix area holds the sparse map, not a name prefix */
+		if (!p_longname) {
+			tar.mode[0] = '\0';
+			file_header->name = xstrdup(tar.name);
+		}
+		get_sparse_map(archive_handle, (char*)&tar);
+		file_header->mode |= S_IFREG;
+		break;
+#endif
 #if ENABLE_FEATURE_TAR_GNU_EXTENSIONS
 	case 'L':
 		/* free: paranoia: tar with several consecutive longnames */
@@ -385,7 +473,9 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 	case 'D':	/* GNU dump dir */
 	case 'M':	/* Continuation of multi volume archive */
 	case 'N':	/* Old GNU for names > 100 characters */
+# if !ENABLE_FEATURE_TAR_SPARSE
 	case 'S':	/* Sparse file */
+# endif
 	case 'V':	/* Volume header */
 #endif
 	case 'g':	/* pax global header */
@@ -444,6 +534,10 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 #if ENABLE_FEATURE_TAR_UNAME_GNAME
 	free(file_header->tar__uname);
 	free(file_header->tar__gname);
+#endif
+#if ENABLE_FEATURE_TAR_SPARSE
+	free(file_header->tar__sparse);
+	file_header->tar__sparse = NULL;
 #endif
 	return EXIT_SUCCESS;
 }
@@ -407,7 +407,7 @@ struct globals {
 //#define LZOP_VERSION_STRING     "1.01"
 //#define LZOP_VERSION_DATE       "Apr 27th 2003"
 
-#define OPTION_STRING "cfvdt123456789CF"
+#define OPTION_STRING "cfvdt123456789CF" IF_FEATURE_LZOP_PARALLEL("T:")
 
 enum {
 	OPT_STDOUT      = (1 << 0),
@@ -426,6 +426,7 @@ enum {
 	OPT_8           = (1 << 12),
 	OPT_C           = (1 << 14),
 	OPT_F           = (1 << 15),
+	OPT_T           = (1 << 16),
 };
 
 /**********************************************************************/
@@ -595,103 +596,109 @@ static int lzo_get_method(header_t *h)
 /* LZO may expand uncompressible data by a small amount */
 #define MAX_COMPRESSED_SIZE(x)	((x) + (x) / 16 + 64 + 3)
 
+/* Sizes and checksums of a block, as stored before its data */
+struct lzo_blk {
+	uint32_t len;  /* uncompressed */
+	uint32_t clen; /* compressed, == len if stored */
+	uint32_t d_adler32;
+	uint32_t d_crc32;
+	uint32_t c_adler32;
+	uint32_t c_crc32;
+};
+
+static unsigned wrk_mem_size(const header_t *h)
+{
+	if (h->method == M_LZO1X_1)
+		return LZO1X_1_MEM_COMPRESS;
+	if (h->method == M_LZO1X_1_15)
+		return LZO1X_1_15_MEM_COMPRESS;
+	if (h->method == M_LZO1X_999)
+		return LZO1X_999_MEM_COMPRESS;
+	return 0;
+}
+
 /**********************************************************************/
 // compress a file
 /**********************************************************************/
-static NOINLINE smallint lzo_compress(const header_t *h)
+/* Compress blk->len bytes of b1 into b2 and fill in the rest of blk */
+static void compress_block(const header_t *h, struct lzo_blk *blk,
+		uint8_t *b1, uint8_t *b2, uint8_t *wrk_mem)
 {
-	unsigned block_size = LZO_BLOCK_SIZE;
+	unsigned src_len = blk->len;
+	unsigned dst_len = 0;
 	int r = 0; /* LZO_E_OK */
-	uint8_t *const b1 = xzalloc(block_size);
-	uint8_t *const b2 = xzalloc(MAX_COMPRESSED_SIZE(block_size));
-	unsigned src_len = 0, dst_len = 0;
-	uint32_t d_adler32 = ADLER32_INIT_VALUE;
-	uint32_t d_crc32 = CRC32_INIT_VALUE;
-	int l;
-	smallint ok = 1;
-	uint8_t *wrk_mem = NULL;
-
-	if (h->method == M_LZO1X_1)
-		wrk_mem = xzalloc(LZO1X_1_MEM_COMPRESS);
-	else if (h->method == M_LZO1X_1_15)
-		wrk_mem = xzalloc(LZO1X_1_15_MEM_COMPRESS);
-	else if (h->method == M_LZO1X_999)
-		wrk_mem = xzalloc(LZO1X_999_MEM_COMPRESS);
-
-	for (;;) {
-		/* read a block */
-		l = full_read(0, b1, block_size);
-		src_len = (l > 0 ? l : 0);
-
-		/* write uncompressed block size */
-		write32(src_len);
 
-		/* exit if last block */
-		if (src_len == 0)
-			break;
+	/* compute checksum of uncompressed block */
+	if (h->flags & F_ADLER32_D)
+		blk->d_adler32 = lzo_adler32(ADLER32_INIT_VALUE, b1, src_len);
+	if (h->flags & F_CRC32_D)
+		blk->d_crc32 = lzo_crc32(CRC32_INIT_VALUE, b1, src_len);
 
-		/* compute checksum of uncompressed block */
-		if (h->flags & F_ADLER32_D)
-			d_adler32 = lzo_adler32(ADLER32_INIT_VALUE, b1, src_len);
-		if (h->flags & F_CRC32_D)
-			d_crc32 = lzo_crc32(CRC32_INIT_VALUE, b1, src_len);
+	/* The dictionary is left over from the previous block. Clear it,
+	 * else output depends on which blocks this process did before */
+	memset(wrk_mem, 0, wrk_mem_size(h));
 
-		/* compress */
-		if (h->method == M_LZO1X_1)
-			r = lzo1x_1_compress(b1, src_len, b2, &dst_len, wrk_mem);
-		else if (h->method == M_LZO1X_1_15)
-			r = lzo1x_1_15_compress(b1, src_len, b2, &dst_len, wrk_mem);
+	/* compress */
+	if (h->method == M_LZO1X_1)
+		r = lzo1x_1_compress(b1, src_len, b2, &dst_len, wrk_mem);
+	else if (h->method == M_LZO1X_1_15)
+		r = lzo1x_1_15_compress(b1, src_len, b2, &dst_len, wrk_mem);
 #if ENABLE_LZOP_COMPR_HIGH
-		else if (h->method == M_LZO1X_999)
-			r = lzo1x_999_compress_level(b1, src_len, b2, &dst_len,
-						wrk_mem, h->level);
+	else if (h->method == M_LZO1X_999)
+		r = lzo1x_999_compress_level(b1, src_len, b2, &dst_len,
+					wrk_mem, h->level);
 #endif
-		else
-			bb_error_msg_and_die("internal error");
-
-		if (r != 0) /* not LZO_E_OK */
-			bb_error_msg_and_die("internal error - compression failed");
-
-		/* write compressed block size */
-		if (dst_len < src_len) {
-			/* optimize */
-			if (h->method == M_LZO1X_999) {
-				unsigned new_len = src_len;
-				r = lzo1x_optimize(b2, dst_len, b1, &new_len, NULL);
-				if (r != 0 /*LZO_E_OK*/ || new_len != src_len)
-					bb_error_msg_and_die("internal error - optimization failed");
-			}
-			write32(dst_len);
-		} else {
-			/* data actually expanded => store data uncompressed */
-			write32(src_len);
-		}
-
-		/* write checksum of uncompressed block */
-		if (h->flags & F_ADLER32_D)
-			write32(d_adler32);
-		if (h->flags & F_CRC32_D)
-			write32(d_crc32);
-
-		if (dst_len < src_len) {
-			/* write checksum of compressed block */
-			if (h->flags & F_ADLER32_C)
-				write32(lzo_adler32(ADLER32_INIT_VALUE, b2,
-							dst_len));
-			if (h->flags & F_CRC32_C)
-				write32(lzo_crc32(CRC32_INIT_VALUE, b2, dst_len));
-			/* write compressed block data */
-			xwrite(1, b2, dst_len);
-		} else {
-			/* write uncompressed block data */
-			xwrite(1, b1, src_len);
+	else
+		bb_error_msg_and_die("internal error");
+
+	if (r != 0) /* not LZO_E_OK */
+		bb_error_msg_and_die("internal error - compression failed");
+
+	if (dst_len < src_len) {
+		/* optimize */
+		if (h->method == M_LZO1X_999) {
+			unsigned new_len = src_len;
+			r = lzo1x_optimize(b2, dst_len, b1, &new_len, NULL);
+			if (r != 0 /*LZO_E_OK*/ || new_len != src_len)
+				bb_error_msg_and_die("internal error - optimization failed");
 		}
+		/* compute checksum of compressed block */
+		if (h->flags & F_ADLER32_C)
+			blk->c_adler32 = lzo_adler32(ADLER32_INIT_VALUE, b2, dst_len);
+		if (h->flags & F_CRC32_C)
+			blk->c_crc32 = lzo_crc32(CRC32_INIT_VALUE, b2, dst_len);
+	} else {
+		/* data actually expanded => store data uncompressed */
+		dst_len = src_len;
 	}
+	blk->clen = dst_len;
+}
 
-	free(wrk_mem);
-	free(b1);
-	free(b2);
-	return ok;
+static void write_block(const header_t *h, const struct lzo_blk *blk,
+		const uint8_t *b1, const uint8_t *b2)
+{
+	/* write uncompressed and compressed block size */
+	write32(blk->len);
+	write32(blk->clen);
+
+	/* write checksum of uncompressed block */
+	if (h->flags & F_ADLER32_D)
+		write32(blk->d_adler32);
+	if (h->flags & F_CRC32_D)
+		write32(blk->d_crc32);
+
+	if (blk->clen < blk->len) {
+		/* write checksum of compressed block */
+		if (h->flags & F_ADLER32_C)
+			write32(blk->c_adler32);
+		if (h->flags & F_CRC32_C)
+			write32(blk->c_crc32);
+		/* write compressed block data */
+		xwrite(1, b2, blk->clen);
+	} else {
+		/* write uncompressed block data */
+		xwrite(1, b1, blk->len);
+	}
 }
 
 static void lzo_check(uint32_t FAST_FUNC (*fn)(uint32_t, const uint8_t*, unsigned),
@@ -706,114 +713,370 @@ static void lzo_check(uint32_t FAST_FUNC (*fn)(uint32_t, const uint8_t*, unsigne
 /**********************************************************************/
 // decompress a file
 /**********************************************************************/
-static NOINLINE smallint lzo_decompress(const header_t *h)
+/* Read what precedes the data of a block. Returns 0 after the last one */
+static int read_block_header(const header_t *h, struct lzo_blk *blk)
 {
-	unsigned block_size = LZO_BLOCK_SIZE;
-	int r;
-	uint32_t src_len, dst_len;
-	uint32_t c_adler32 = ADLER32_INIT_VALUE;
-	uint32_t d_adler32 = ADLER32_INIT_VALUE;
-	uint32_t c_crc32 = CRC32_INIT_VALUE, d_crc32 = CRC32_INIT_VALUE;
-	smallint ok = 1;
-	uint8_t *b1;
-	uint32_t mcs_block_size = MAX_COMPRESSED_SIZE(block_size);
-	uint8_t *b2 = NULL;
+	/* read uncompressed block size */
+	blk->len = read32();
 
-	for (;;) {
-		uint8_t *dst;
+	/* exit if last block */
+	if (blk->len == 0)
+		return 0;
 
-		/* read uncompressed block size */
-		dst_len = read32();
+	/* error if split file */
+	if (blk->len == 0xffffffffL)
+		/* should not happen - not yet implemented */
+		bb_error_msg_and_die("this file is a split lzop file");
+
+	if (blk->len > MAX_BLOCK_SIZE)
+		bb_error_msg_and_die("lzop file corrupted");
+
+	/* read compressed block size */
+	blk->clen = read32();
+	if (blk->clen <= 0 || blk->clen > blk->len)
+		bb_error_msg_and_die("lzop file corrupted");
+
+	/* read checksum of uncompressed block */
+	if (h->flags & F_ADLER32_D)
+		blk->d_adler32 = read32();
+	if (h->flags & F_CRC32_D)
+		blk->d_crc32 = read32();
+
+	/* read checksum of compressed block */
+	if (blk->clen < blk->len) {
+		if (h->flags & F_ADLER32_C)
+			blk->c_adler32 = read32();
+		if (h->flags & F_CRC32_C)
+			blk->c_crc32 = read32();
+	}
+	return 1;
+}
 
-		/* exit if last block */
-		if (dst_len == 0)
-			break;
+/* The block's data is at the end of buf, which is
+ * MAX_COMPRESSED_SIZE(blk->len) or more bytes. Decompress it
+ * to the start of buf. Returns where the uncompressed data is */
+static uint8_t *decompress_block(const header_t *h, const struct lzo_blk *blk,
+		uint8_t *buf, uint32_t buf_size)
+{
+	uint8_t *b1 = buf + buf_size - blk->clen;
+	uint8_t *dst;
+	int r;
 
-		/* error if split file */
-		if (dst_len == 0xffffffffL)
-			/* should not happen - not yet implemented */
-			bb_error_msg_and_die("this file is a split lzop file");
+	if (blk->clen < blk->len) {
+		unsigned d = blk->len;
 
-		if (dst_len > MAX_BLOCK_SIZE)
-			bb_error_msg_and_die("lzop file corrupted");
+		if (!(option_mask32 & OPT_F)) {
+			/* verify checksum of compressed block */
+			if (h->flags & F_ADLER32_C)
+				lzo_check(lzo_adler32, blk->c_adler32,
+						ADLER32_INIT_VALUE,
+						b1, blk->clen);
+			if (h->flags & F_CRC32_C)
+				lzo_check(lzo_crc32, blk->c_crc32,
+						CRC32_INIT_VALUE,
+						b1, blk->clen);
+		}
 
-		/* read compressed block size */
-		src_len = read32();
-		if (src_len <= 0 || src_len > dst_len)
-			bb_error_msg_and_die("lzop file corrupted");
+		/* decompress */
+//		if (option_mask32 & OPT_F)
+//			r = lzo1x_decompress(b1, blk->clen, buf, &d, NULL);
+//		else
+			r = lzo1x_decompress_safe(b1, blk->clen, buf, &d, NULL);
 
-		if (dst_len > block_size) {
-			if (b2) {
-//FIXME!
-				b2 = NULL;
-				free(b2);
-			}
-			block_size = dst_len;
-			mcs_block_size = MAX_COMPRESSED_SIZE(block_size);
+		if (r != 0 /*LZO_E_OK*/ || blk->len != d) {
+			bb_error_msg_and_die("corrupted compressed data");
 		}
+		dst = buf;
+	} else {
+		/* "stored" block => no decompression */
+		dst = b1;
+	}
 
-		/* read checksum of uncompressed block */
+	if (!(option_mask32 & OPT_F)) {
+		/* verify checksum of uncompressed block */
 		if (h->flags & F_ADLER32_D)
-			d_adler32 = read32();
+			lzo_check(lzo_adler32, blk->d_adler32, ADLER32_INIT_VALUE,
+				  dst, blk->len);
 		if (h->flags & F_CRC32_D)
-			d_crc32 = read32();
+			lzo_check(lzo_crc32, blk->d_crc32, CRC32_INIT_VALUE,
+				  dst, blk->len);
+	}
+	return dst;
+}
 
-		/* read checksum of compressed block */
-		if (src_len < dst_len) {
-			if (h->flags & F_ADLER32_C)
-				c_adler32 = read32();
-			if (h->flags & F_CRC32_C)
-				c_crc32 = read32();
+#if ENABLE_FEATURE_LZOP_PARALLEL
+/* lzop -T N: blocks are independent, so N forked workers compress or
+ * decompress them and do their checksums, while the main process
+ * reads blocks into shared slots and writes the results in order.
+ * Worker k gets blocks k, k+N, k+2N... and tells it is done with each
+ * on its own pipe, so its results come back in block order. There are
+ * two slots per worker: one is worked on while the other waits to be
+ * written out. Blocks bigger than a slot (only from other lzop
+ * programs) are decompressed by the main process. */
+#define SLOT_BUF_SIZE MAX_COMPRESSED_SIZE(LZO_BLOCK_SIZE)
+
+struct lzo_slot {
+	struct lzo_blk blk;
+	uint8_t *data; /* where the result is */
+	uint8_t *b1;   /* LZO_BLOCK_SIZE bytes of uncompressed data */
+	uint8_t *b2;   /* SLOT_BUF_SIZE bytes */
+};
+
+static struct {
+	unsigned cnt;
+	unsigned nslots;
+	struct lzo_slot **slot;
+	int *job_fd;
+	int *done_fd;
+	pid_t *pid;
+} W;
+
+static void NORETURN lzo_worker(const header_t *h, int job_fd, int done_fd)
+{
+	uint8_t *wrk_mem = NULL;
+	unsigned char s;
+
+	if (!(option_mask32 & OPT_DECOMPRESS))
+		wrk_mem = xmalloc(wrk_mem_size(h));
+	while (safe_read(job_fd, &s, 1) == 1) {
+		struct lzo_slot *sl = W.slot[s];
+
+		if (option_mask32 & OPT_DECOMPRESS) {
+			sl->data = decompress_block(h, &sl->blk, sl->b2, SLOT_BUF_SIZE);
+		} else {
+			compress_block(h, &sl->blk, sl->b1, sl->b2, wrk_mem);
 		}
+		xwrite(done_fd, &s, 1);
+	}
+	_exit(EXIT_SUCCESS);
+}
 
-		if (b2 == NULL)
-			b2 = xzalloc(mcs_block_size);
-		/* read the block into the end of our buffer */
-		b1 = b2 + mcs_block_size - src_len;
-		xread(0, b1, src_len);
-
-		if (src_len < dst_len) {
-			unsigned d = dst_len;
-
-			if (!(option_mask32 & OPT_F)) {
-				/* verify checksum of compressed block */
-				if (h->flags & F_ADLER32_C)
-					lzo_check(lzo_adler32, c_adler32,
-							ADLER32_INIT_VALUE,
-							b1, src_len);
-				if (h->flags & F_CRC32_C)
-					lzo_check(lzo_crc32, c_crc32,
-							CRC32_INIT_VALUE,
-							b1, src_len);
+static void lzo_start_workers(const header_t *h)
+{
+	unsigned i;
+
+	W.nslots = 2 * W.cnt;
+	W.slot = xmalloc(W.nslots * sizeof(W.slot[0]));
+	for (i = 0; i < W.nslots; i++) {
+		struct lzo_slot *sl;
+
+		sl = mmap(NULL, sizeof(*sl) + LZO_BLOCK_SIZE + SLOT_BUF_SIZE,
+				PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (sl == MAP_FAILED)
+			bb_perror_msg_and_die("mmap");
+		sl->b1 = (uint8_t*)(sl + 1);
+		sl->b2 = sl->b1 + LZO_BLOCK_SIZE;
+		W.slot[i] = sl;
+	}
+	W.job_fd = xmalloc(W.cnt * sizeof(W.job_fd[0]));
+	W.done_fd = xmalloc(W.cnt * sizeof(W.done_fd[0]));
+	W.pid = xmalloc(W.cnt * sizeof(W.pid[0]));
+	fflush_all();
+	for (i = 0; i < W.cnt; i++) {
+		struct fd_pair job, done;
+
+		xpiped_pair(job);
+		xpiped_pair(done);
+		W.pid[i] = fork();
+		if (W.pid[i] < 0)
+			bb_perror_msg_and_die("vfork" + 1);
+		if (W.pid[i] == 0) {
+			/* Other workers must see EOF when we close their pipes */
+			while (i--) {
+				close(W.job_fd[i]);
+				close(W.done_fd[i]);
 			}
+			close(job.wr);
+			close(done.rd);
+			lzo_worker(h, job.rd, done.wr);
+		}
+		close(job.rd);
+		close(done.wr);
+		W.job_fd[i] = job.wr;
+		W.done_fd[i] = done.rd;
+	}
+	/* A worker which died has said why, don't die of SIGPIPE
+	 * before we get to exit with an error */
+	signal(SIGPIPE, SIG_IGN);
+}
 
-			/* decompress */
-//			if (option_mask32 & OPT_F)
-//				r = lzo1x_decompress(b1, src_len, b2, &d, NULL);
-//			else
-				r = lzo1x_decompress_safe(b1, src_len, b2, &d, NULL);
+static smallint lzo_stop_workers(void)
+{
+	smallint ok = 1;
+	unsigned i;
 
-			if (r != 0 /*LZO_E_OK*/ || dst_len != d) {
-				bb_error_msg_and_die("corrupted compressed data");
-			}
-			dst = b2;
-		} else {
-			/* "stored" block => no decompression */
-			dst = b1;
+	signal(SIGPIPE, SIG_DFL);
+	for (i = 0; i < W.cnt; i++) {
+		close(W.job_fd[i]);
+		close(W.done_fd[i]);
+	}
+	for (i = 0; i < W.cnt; i++) {
+		int status;
+		if (safe_waitpid(W.pid[i], &status, 0) < 0 || status != 0)
+			ok = 0;
+	}
+	for (i = 0; i < W.nslots; i++)
+		munmap(W.slot[i], sizeof(struct lzo_slot) + LZO_BLOCK_SIZE + SLOT_BUF_SIZE);
+	free(W.slot);
+	free(W.job_fd);
+	free(W.done_fd);
+	free(W.pid);
+	return ok;
+}
+
+static void lzo_dispatch(unsigned n)
+{
+	unsigned char s = n % W.nslots;
+	if (full_write(W.job_fd[n % W.cnt], &s, 1) != 1)
+		xfunc_die(); /* worker has said why */
+}
+
+/* Wait for block n and write it out */
+static void lzo_collect(const header_t *h, unsigned n)
+{
+	struct lzo_slot *sl;
+	unsigned char s;
+
+	if (safe_read(W.done_fd[n % W.cnt], &s, 1) != 1)
+		xfunc_die(); /* worker has said why */
+	sl = W.slot[s];
+	if (option_mask32 & OPT_DECOMPRESS)
+		xwrite(1, sl->data, sl->blk.len);
+	else
+		write_block(h, &sl->blk, sl->b1, sl->b2);
+}
+
+static smallint lzo_compress_parallel(const header_t *h)
+{
+	unsigned n, out;
+
+	lzo_start_workers(h);
+	out = 0;
+	for (n = 0;; n++) {
+		struct lzo_slot *sl;
+		int l;
+
+		if (n - out == W.nslots)
+			lzo_collect(h, out++);
+		sl = W.slot[n % W.nslots];
+		l = full_read(0, sl->b1, LZO_BLOCK_SIZE);
+		if (l <= 0)
+			break;
+		sl->blk.len = l;
+		lzo_dispatch(n);
+	}
+	while (out < n)
+		lzo_collect(h, out++);
+	write32(0);
+	return lzo_stop_workers();
+}
+
+static smallint lzo_decompress_parallel(const header_t *h)
+{
+	unsigned n, out;
+
+	lzo_start_workers(h);
+	out = 0;
+	for (n = 0;; n++) {
+		struct lzo_slot *sl;
+		struct lzo_blk blk;
+
+		if (n - out == W.nslots)
+			lzo_collect(h, out++);
+		if (!read_block_header(h, &blk))
+			break;
+		if (blk.len > LZO_BLOCK_SIZE) {
+			uint32_t sz = MAX_COMPRESSED_SIZE(blk.len);
+			uint8_t *buf = xmalloc(sz);
+
+			while (out < n)
+				lzo_collect(h, out++);
+			out = n + 1;
+			xread(0, buf + sz - blk.clen, blk.clen);
+			xwrite(1, decompress_block(h, &blk, buf, sz), blk.len);
+			free(buf);
+			continue;
 		}
+		sl = W.slot[n % W.nslots];
+		sl->blk = blk;
+		xread(0, sl->b2 + SLOT_BUF_SIZE - blk.clen, blk.clen);
+		lzo_dispatch(n);
+	}
+	while (out < n)
+		lzo_collect(h, out++);
+	return lzo_stop_workers();
+}
+#endif
 
-		if (!(option_mask32 & OPT_F)) {
-			/* verify checksum of uncompressed block */
-			if (h->flags & F_ADLER32_D)
-				lzo_check(lzo_adler32, d_adler32, ADLER32_INIT_VALUE,
-					  dst, dst_len);
-			if (h->flags & F_CRC32_D)
-				lzo_check(lzo_crc32, d_crc32, CRC32_INIT_VALUE,
-					  dst, dst_len);
+static NOINLINE smallint lzo_compress(const header_t *h)
+{
+	unsigned block_size = LZO_BLOCK_SIZE;
+	uint8_t *b1, *b2;
+	struct lzo_blk blk;
+	int l;
+	smallint ok = 1;
+	uint8_t *wrk_mem;
+
+#if ENABLE_FEATURE_LZOP_PARALLEL
+	if (W.cnt > 1)
+		return lzo_compress_parallel(h);
+#endif
+	b1 = xzalloc(block_size);
+	b2 = xzalloc(MAX_COMPRESSED_SIZE(block_size));
+	wrk_mem = xmalloc(wrk_mem_size(h));
+	memset(&blk, 0, sizeof(blk));
+	for (;;) {
+		/* read a block */
+		l = full_read(0, b1, block_size);
+		blk.len = (l > 0 ? l : 0);
+
+		/* exit if last block */
+		if (blk.len == 0) {
+			write32(0);
+			break;
 		}
 
+		compress_block(h, &blk, b1, b2, wrk_mem);
+		write_block(h, &blk, b1, b2);
+	}
+
+	free(wrk_mem);
+	free(b1);
+	free(b2);
+	return ok;
+}
+
+static NOINLINE smallint lzo_decompress(const header_t *h)
+{
+	unsigned block_size = LZO_BLOCK_SIZE;
+	struct lzo_blk blk;
+	smallint ok = 1;
+	uint32_t mcs_block_size = MAX_COMPRESSED_SIZE(block_size);
+	uint8_t *b2 = NULL;
+
+#if ENABLE_FEATURE_LZOP_PARALLEL
+	if (W.cnt > 1)
+		return lzo_decompress_parallel(h);
+#endif
+	memset(&blk, 0, sizeof(blk));
+	for (;;) {
+		if (!read_block_header(h, &blk))
+			break;
+
+		if (blk.len > block_size) {
+			free(b2);
+			b2 = NULL;
+			block_size = blk.len;
+			mcs_block_size = MAX_COMPRESSED_SIZE(block_size);
+		}
+
+		if (b2 == NULL)
+			b2 = xzalloc(mcs_block_size);
+		/* read the block into the end of our buffer */
+		xread(0, b2 + mcs_block_size - blk.clen, blk.clen);
+
 		/* write uncompressed block data */
-		xwrite(1, dst, dst_len);
+		xwrite(1, decompress_block(h, &blk, b2, mcs_block_size), blk.len);
 	}
 
 	free(b2);
@@ -1061,8 +1324,19 @@ static IF_DESKTOP(long long) int pack_lzop(unpack_info_t *info UNUSED_PARAM)
 int lzop_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int lzop_main(int argc UNUSED_PARAM, char **argv)
 {
-	getopt32(argv, OPTION_STRING);
+	IF_FEATURE_LZOP_PARALLEL(const char *opt_T;)
+
+	getopt32(argv, OPTION_STRING IF_FEATURE_LZOP_PARALLEL(, &opt_T));
 	argv += optind;
+#if ENABLE_FEATURE_LZOP_PARALLEL
+	if (option_mask32 & OPT_T) {
+		W.cnt = xatou_range(opt_T, 0, 64);
+		if (W.cnt == 0) {
+			long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+			W.cnt = ncpu > 64 ? 64 : ncpu;
+		}
+	}
+#endif
 	/* lzopcat? */
 	if (applet_name[4] == 'c')
 		option_mask32 |= (OPT_STDOUT | OPT_DECOMPRESS);
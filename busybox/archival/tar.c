@@ -41,8 +41,8 @@
 
 #if !ENABLE_FEATURE_SEAMLESS_GZ && !ENABLE_FEATURE_SEAMLESS_BZ2
 /* Do not pass gzip flag to writeTarFile() */
-#define writeTarFile(tar_fd, verboseFlag, dereferenceFlag, include, exclude, gzip) \
-	writeTarFile(tar_fd, verboseFlag, dereferenceFlag, include, exclude)
+#define writeTarFile(tar_fd, verboseFlag, dereferenceFlag, sparseFlag, include, exclude, gzip) \
+	writeTarFile(tar_fd, verboseFlag, dereferenceFlag, sparseFlag, include, exclude)
 #endif
 
 
@@ -97,6 +97,12 @@ typedef struct TarBallInfo {
 	int tarFd;                      /* Open-for-write file descriptor
 	                                 * for the tarball */
 	int verboseFlag;                /* Whether to print extra stuff or not */
+#if ENABLE_FEATURE_TAR_SPARSE
+	int sparseFlag;                 /* Store holes of sparse files (-S) */
+	off_t *sparseMap;               /* Data regions of the current file */
+	unsigned sparseCnt;
+	off_t sparseDataSize;           /* Sum of their lengths */
+#endif
 	const llist_t *excludeList;     /* List of files to not include */
 	HardLinkInfo *hlInfoHead;       /* Hard Link Tracking Information */
 	HardLinkInfo *hlInfo;           /* Hard Link Info for the current file */
@@ -120,6 +126,7 @@ enum {
 	CONTTYPE = '7',		/* reserved */
 	GNULONGLINK = 'K',	/* GNU long (>100 chars) link name */
 	GNULONGNAME = 'L',	/* GNU long (>100 chars) file name */
+	GNUSPARSE = 'S',	/* GNU sparse file */
 };
 
 /* Might be faster (and bigger) if the dev/ino were stored in numeric order;) */
@@ -261,6 +268,67 @@ static void writeLongname(int fd, int type, const char *name, int dir)
 }
 #endif
 
+#if ENABLE_FEATURE_TAR_SPARSE
+/* Find the data regions of a sparse file, as (offset, length) pairs.
+ * Like GNU tar, end the map with an empty region at the file size
+ * if the file ends in a hole. Returns NULL if it is all data */
+static off_t *getSparseMap(int fd, off_t size, unsigned *cnt)
+{
+	off_t *map = NULL;
+	off_t pos = 0;
+	unsigned n = 0;
+
+	while (pos < size) {
+		off_t data = pos;
+		off_t end = bb_find_data(fd, &data, size);
+
+		if (data >= size)
+			break;
+		if (data == 0 && end == size) /* no holes (or no SEEK_HOLE) */
+			return NULL;
+		map = xrealloc_vector(map, 4, 2 * n);
+		map[2*n] = data;
+		map[2*n + 1] = end - data;
+		n++;
+		pos = end;
+	}
+	if (n == 0 || map[2*n - 2] + map[2*n - 1] < size) {
+		map = xrealloc_vector(map, 4, 2 * n);
+		map[2*n] = size;
+		map[2*n + 1] = 0;
+		n++;
+	}
+	*cnt = n;
+	return map;
+}
+
+/* Old GNU sparse map: 4 pairs in the header at 386 (isextended
+ * at 482), then blocks of 21 pairs each (isextended at 504) */
+static const off_t *putSparseMap(char *sp, const off_t *map, unsigned *cnt, int max)
+{
+	while (*cnt && --max >= 0) {
+		putOctal(sp, 12, map[0]);
+		putOctal(sp + 12, 12, map[1]);
+		map += 2;
+		sp += 24;
+		(*cnt)--;
+	}
+	return map;
+}
+
+static void writeSparseExtensions(int fd, const off_t *map, unsigned cnt)
+{
+	char block[TAR_BLOCK_SIZE];
+
+	while (cnt) {
+		memset(block, 0, sizeof(block));
+		map = putSparseMap(block, map, &cnt, 21);
+		block[504] = (cnt != 0);
+		xwrite(fd, block, sizeof(block));
+	}
+}
+#endif
+
 /* Write out a tar header for the specified file/directory/whatever */
 void BUG_tar_header_size(void);
 static int writeTarHeader(struct TarBallInfo *tbInfo,
@@ -341,6 +409,18 @@ static int writeTarHeader(struct TarBallInfo *tbInfo,
 		}
 		header.typeflag = REGTYPE;
 		PUT_OCTAL(header.size, statbuf->st_size);
+#if ENABLE_FEATURE_TAR_SPARSE
+		if (tbInfo->sparseMap) {
+			char *hp = (char*)&header;
+			unsigned cnt = tbInfo->sparseCnt;
+
+			header.typeflag = GNUSPARSE;
+			PUT_OCTAL(header.size, tbInfo->sparseDataSize);
+			putSparseMap(hp + 386, tbInfo->sparseMap, &cnt, 4);
+			hp[482] = (cnt != 0); /* isextended */
+			putOctal(hp + 483, 12, statbuf->st_size); /* realsize */
+		}
+#endif
 	} else {
 		bb_error_msg("%s: unknown file type", fileName);
 		return FALSE;
@@ -356,6 +436,11 @@ static int writeTarHeader(struct TarBallInfo *tbInfo,
 
 	/* Now write the header out to disk */
 	chksum_and_xwrite(tbInfo->tarFd, &header);
+#if ENABLE_FEATURE_TAR_SPARSE
+	if (tbInfo->sparseMap && tbInfo->sparseCnt > 4)
+		writeSparseExtensions(tbInfo->tarFd, tbInfo->sparseMap + 2*4,
+				tbInfo->sparseCnt - 4);
+#endif
 
 	/* Now do the verbose thing (or not) */
 	if (tbInfo->verboseFlag) {
@@ -410,6 +495,7 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 	struct TarBallInfo *tbInfo = (struct TarBallInfo *) userData;
 	const char *header_name;
 	int inputFileFd = -1;
+	off_t dataSize = statbuf->st_size;
 
 	DBG("writeFileToTarball('%s')", fileName);
 
@@ -480,8 +566,26 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 		}
 	}
 
+#if ENABLE_FEATURE_TAR_SPARSE
+	tbInfo->sparseMap = NULL;
+	/* Fewer blocks than the size says: there are holes to skip */
+	if (tbInfo->sparseFlag && inputFileFd >= 0
+	 && (off_t)statbuf->st_blocks * 512 < statbuf->st_size
+	) {
+		tbInfo->sparseMap = getSparseMap(inputFileFd, statbuf->st_size, &tbInfo->sparseCnt);
+		if (tbInfo->sparseMap) {
+			unsigned i;
+			dataSize = 0;
+			for (i = 0; i < tbInfo->sparseCnt; i++)
+				dataSize += tbInfo->sparseMap[2*i + 1];
+			tbInfo->sparseDataSize = dataSize;
+		}
+	}
+#endif
+
 	/* Add an entry to the tarball */
 	if (writeTarHeader(tbInfo, header_name, fileName, statbuf) == FALSE) {
+		IF_FEATURE_TAR_SPARSE(free(tbInfo->sparseMap);)
 		return FALSE;
 	}
 
@@ -494,6 +598,19 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 		/* tar will be corrupted. So we don't allow for that. */
 		/* NB: GNU tar 1.16 warns and pads with zeroes */
 		/* or even seeks back and updates header */
+#if ENABLE_FEATURE_TAR_SPARSE
+		if (tbInfo->sparseMap) {
+			const off_t *sp = tbInfo->sparseMap;
+			unsigned n = tbInfo->sparseCnt;
+
+			while (n--) {
+				xlseek(inputFileFd, sp[0], SEEK_SET);
+				bb_copyfd_exact_size(inputFileFd, tbInfo->tarFd, sp[1]);
+				sp += 2;
+			}
+			free(tbInfo->sparseMap);
+		} else
+#endif
 		bb_copyfd_exact_size(inputFileFd, tbInfo->tarFd, statbuf->st_size);
 		////off_t readSize;
 		////readSize = bb_copyfd_size(inputFileFd, tbInfo->tarFd, statbuf->st_size);
@@ -508,7 +625,7 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 
 		/* Pad the file up to the tar block size */
 		/* (a few tricks here in the name of code size) */
-		readSize = (-(int)statbuf->st_size) & (TAR_BLOCK_SIZE-1);
+		readSize = (-(int)dataSize) & (TAR_BLOCK_SIZE-1);
 		memset(block_buf, 0, readSize);
 		xwrite(tbInfo->tarFd, block_buf, readSize);
 	}
@@ -597,7 +714,7 @@ static void NOINLINE vfork_compressor(int tar_fd, int gzip)
 
 /* gcc 4.2.1 inlines it, making code bigger */
 static NOINLINE int writeTarFile(int tar_fd, int verboseFlag,
-	int dereferenceFlag, const llist_t *include,
+	int dereferenceFlag, int sparseFlag, const llist_t *include,
 	const llist_t *exclude, int gzip)
 {
 	int errorFlag = FALSE;
@@ -606,6 +723,9 @@ static NOINLINE int writeTarFile(int tar_fd, int verboseFlag,
 	tbInfo.hlInfoHead = NULL;
 	tbInfo.tarFd = tar_fd;
 	tbInfo.verboseFlag = verboseFlag;
+#if ENABLE_FEATURE_TAR_SPARSE
+	tbInfo.sparseFlag = sparseFlag;
+#endif
 
 	/* Store the stat info for the tarball's file, so
 	 * can avoid including the tarball into itself....  */
@@ -662,7 +782,7 @@ static NOINLINE int writeTarFile(int tar_fd, int verboseFlag,
 }
 #else
 int writeTarFile(int tar_fd, int verboseFlag,
-	int dereferenceFlag, const llist_t *include,
+	int dereferenceFlag, int sparseFlag, const llist_t *include,
 	const llist_t *exclude, int gzip);
 #endif /* FEATURE_TAR_CREATE */
 
@@ -715,6 +835,520 @@ static char FAST_FUNC get_header_tar_Z(archive_handle_t *archive_handle)
 # define get_header_tar_Z NULL
 #endif
 
+#if ENABLE_FEATURE_TAR_INDEX
+/* tar --index FILE: FILE lists where each member's headers start in
+ * the tar stream, so that t or x of a few members reads only the part
+ * of the archive holding them. For a .tar.gz it also has a deflate
+ * restart point for about every GZ_CHECKPOINT_SPAN bytes of tar stream.
+ * FILE is (re)made by a full pass when it is missing or the archive's
+ * size or mtime changed. It is a cache in this machine's layout:
+ *   struct tar_index_hdr
+ *   gz_checkpoint_t [checkpoints]
+ *   off_t offset, NUL terminated name [members]
+ * If FILE is the .tar.gz itself, the index is kept inside it instead,
+ * see export_index().
+ */
+#define TAR_INDEX_MAGIC "BBtarIdx"
+struct tar_index_hdr {
+	char magic[8];
+	off_t archive_size;
+	time_t archive_mtime;
+	uint32_t checkpoints;
+	uint32_t members;
+};
+
+struct tar_index_member {
+	off_t offset;
+	char *name;
+};
+
+static struct {
+	int fd;
+	struct tar_index_hdr hdr;
+	unsigned cnt;
+	struct tar_index_member *member;
+	char FAST_FUNC (*filter)(archive_handle_t *);
+	const gz_checkpoint_t *resume;
+	int archive_fd; /* >= 0: the index is in the archive */
+} IX;
+
+/* Returns 0 if the index is damaged or for another archive */
+static int read_index(const struct stat *st)
+{
+	struct tar_index_hdr *h = &IX.hdr;
+	struct stat ist;
+	char *start, *p, *end;
+	size_t sz = INT_MAX - 4095;
+	unsigned i;
+
+	if (full_read(IX.fd, h, sizeof(*h)) != sizeof(*h)
+	 || memcmp(h->magic, TAR_INDEX_MAGIC, sizeof(h->magic)) != 0
+	 || h->archive_size != st->st_size
+	 || h->archive_mtime != st->st_mtime
+	 || fstat(IX.fd, &ist) != 0
+	 || h->checkpoints > (ist.st_size - sizeof(*h)) / sizeof(gz_checkpoint_t)
+	) {
+		return 0;
+	}
+	xlseek(IX.fd, sizeof(*h) + (off_t)h->checkpoints * sizeof(gz_checkpoint_t), SEEK_SET);
+	p = start = xmalloc_read(IX.fd, &sz);
+	end = p + sz;
+	/* A member takes an offset and a NUL at least. Don't trust
+	 * a damaged count with the size of an allocation */
+	if (h->members > sz / (sizeof(off_t) + 1))
+		goto bad;
+	IX.member = xzalloc(h->members * sizeof(IX.member[0]));
+	for (i = 0; i < h->members; i++) {
+		if (end - p < (int)sizeof(off_t) + 1)
+			goto bad;
+		memcpy(&IX.member[i].offset, p, sizeof(off_t));
+		p += sizeof(off_t);
+		IX.member[i].name = p;
+		p = memchr(p, '\0', end - p);
+		if (!p)
+			goto bad;
+		p++;
+	}
+	IX.cnt = i;
+	return 1;
+ bad:
+	free(IX.member);
+	IX.member = NULL;
+	free(start);
+	return 0;
+}
+
+static char FAST_FUNC filter_and_index(archive_handle_t *archive_handle)
+{
+	IX.member = xrealloc_vector(IX.member, 6, IX.cnt);
+	IX.member[IX.cnt].offset = archive_handle->tar__hdr_offset;
+	IX.member[IX.cnt].name = xstrdup(archive_handle->file_header->name);
+	IX.cnt++;
+	return IX.filter(archive_handle);
+}
+
+static IF_DESKTOP(long long) int FAST_FUNC unpack_gz_indexed(int src_fd, int dst_fd)
+{
+	/* When tar has all it wants it stops reading, die quietly then */
+	signal(SIGPIPE, SIG_DFL);
+	/* Until then we hold the --jobs pipes too */
+	IF_FEATURE_TAR_JOBS(data_extract_parallel_close();)
+	return unpack_gz_stream_indexed(src_fd, dst_fd, IX.fd, IX.resume);
+}
+
+static void start_gunzip(archive_handle_t *archive_handle)
+{
+	if (!IX.resume) /* else it seeks to its checkpoint */
+		xlseek(archive_handle->src_fd, 2, SEEK_SET); /* magic */
+	open_transformer(archive_handle->src_fd, unpack_gz_indexed, "gunzip");
+	archive_handle->seek = seek_by_read;
+}
+
+static void make_index(archive_handle_t *archive_handle, const char *index_name,
+		const struct stat *st, int gz)
+{
+	struct tar_index_hdr *h = &IX.hdr;
+	FILE *fp;
+	off_t end;
+	unsigned i;
+
+	/* Don't wipe a file which was never an index, the name
+	 * may be mistyped. A temporary file is ours to wipe */
+	if (IX.archive_fd < 0) {
+		ssize_t n = pread(IX.fd, h->magic, sizeof(h->magic), 0);
+		if (n != 0 && (n != sizeof(h->magic)
+		    || memcmp(h->magic, TAR_INDEX_MAGIC, sizeof(h->magic)) != 0)
+		) {
+			bb_error_msg_and_die("'%s' is not a tar index", index_name);
+		}
+	}
+	/* An index, but for no archive until the header is rewritten
+	 * below: if we are interrupted, the next run may still wipe it */
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, TAR_INDEX_MAGIC, sizeof(h->magic));
+	xlseek(IX.fd, 0, SEEK_SET);
+	if (ftruncate(IX.fd, 0) != 0)
+		bb_perror_msg_and_die("can't write '%s'", index_name);
+	xwrite(IX.fd, h, sizeof(*h));
+
+	IX.filter = archive_handle->filter;
+	archive_handle->filter = filter_and_index;
+	if (gz)
+		start_gunzip(archive_handle);
+	archive_handle->offset = 0;
+	while (get_header_tar(archive_handle) == EXIT_SUCCESS)
+		continue;
+	/* get_header_tar() has read gunzip's output to EOF,
+	 * so it has written all checkpoints after the header */
+	end = xlseek(IX.fd, 0, SEEK_END);
+
+	fp = xfdopen_dup_for_write(IX.fd);
+	for (i = 0; i < IX.cnt; i++) {
+		fwrite(&IX.member[i].offset, sizeof(off_t), 1, fp);
+		fwrite(IX.member[i].name, strlen(IX.member[i].name) + 1, 1, fp);
+	}
+	fflush_all();
+	memcpy(h->magic, TAR_INDEX_MAGIC, sizeof(h->magic));
+	h->archive_size = st->st_size;
+	h->archive_mtime = st->st_mtime;
+	h->checkpoints = (end - sizeof(*h)) / sizeof(gz_checkpoint_t);
+	h->members = IX.cnt;
+	xlseek(IX.fd, 0, SEEK_SET);
+	xwrite(IX.fd, h, sizeof(*h));
+	if (fclose(fp) != 0)
+		bb_perror_msg_and_die("%s", index_name);
+}
+
+/* Last checkpoint at or before ofs, NULL if none */
+static gz_checkpoint_t *find_checkpoint(off_t ofs)
+{
+	gz_checkpoint_t *cp;
+	unsigned lo, hi;
+
+	/* Invariant: the answer is in [lo-1, hi) */
+	lo = 0;
+	hi = IX.hdr.checkpoints;
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+		off_t out_ofs;
+
+		if (pread(IX.fd, &out_ofs, sizeof(out_ofs), sizeof(IX.hdr)
+				+ (off_t)mid * sizeof(gz_checkpoint_t)
+				+ offsetof(gz_checkpoint_t, out_ofs)) != sizeof(out_ofs)
+		) {
+			bb_perror_msg_and_die("read error");
+		}
+		if (out_ofs <= ofs)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return NULL;
+	cp = xmalloc(sizeof(*cp));
+	if (pread(IX.fd, cp, sizeof(*cp), sizeof(IX.hdr)
+			+ (off_t)(lo - 1) * sizeof(gz_checkpoint_t)) != sizeof(*cp)
+	) {
+		bb_perror_msg_and_die("read error");
+	}
+	return cp;
+}
+
+/* The index inside a .tar.gz is a run of empty gzip members after
+ * the tar data: gunzip and other tars get no output from them.
+ * The index rides in their extra fields (subfield "BI"), in the order
+ * of the index file but little endian, in pieces of up to GZ_IDX_CHUNK
+ * bytes. The last member is GZ_IDX_LOCATOR bytes long and holds
+ * TAR_INDEX_MAGIC and the offset of the first one. The pieces are
+ * kept small for gunzips with small input buffers, ours among them. Inside tar the
+ * index is converted to and from the index file form in a temporary
+ * file, so the rest of the code sees no difference. */
+enum {
+	GZ_IDX_HEAD = 10 + 2 + 4, /* gzip header, XLEN, subfield header */
+	GZ_IDX_TAIL = 2 + 8,      /* empty final block, CRC32, ISIZE */
+	GZ_IDX_CHUNK = 8 * 1024,
+	GZ_IDX_LOCATOR = GZ_IDX_HEAD + 16 + GZ_IDX_TAIL,
+	GZ_IDX_CP_SIZE = 8 + 8 + 4 + 4 + 4 + sizeof(((gz_checkpoint_t*)0)->window),
+};
+
+struct gz_idx_writer {
+	int fd;
+	unsigned len;
+	unsigned char buf[GZ_IDX_HEAD + GZ_IDX_CHUNK + GZ_IDX_TAIL];
+};
+
+static void gz_idx_flush(struct gz_idx_writer *w)
+{
+	unsigned char *p = w->buf;
+
+	/* FEXTRA, no mtime, unknown OS */
+	memcpy(p, "\x1f\x8b\x08\x04\0\0\0\0\0\xff", 10);
+	p[10] = (w->len + 4);
+	p[11] = (w->len + 4) >> 8;
+	p[12] = 'B';
+	p[13] = 'I';
+	p[14] = w->len;
+	p[15] = w->len >> 8;
+	memset(p + GZ_IDX_HEAD + w->len, 0, GZ_IDX_TAIL);
+	p[GZ_IDX_HEAD + w->len] = 0x03;
+	xwrite(w->fd, p, GZ_IDX_HEAD + w->len + GZ_IDX_TAIL);
+	w->len = 0;
+}
+
+static void gz_idx_put(struct gz_idx_writer *w, const void *data, size_t n)
+{
+	while (n) {
+		size_t k = GZ_IDX_CHUNK - w->len;
+		if (k > n)
+			k = n;
+		memcpy(w->buf + GZ_IDX_HEAD + w->len, data, k);
+		w->len += k;
+		data = (const char *)data + k;
+		n -= k;
+		if (w->len == GZ_IDX_CHUNK)
+			gz_idx_flush(w);
+	}
+}
+
+static void gz_idx_put_le(struct gz_idx_writer *w, uint64_t v, unsigned n)
+{
+	unsigned char b[8];
+	unsigned i;
+
+	for (i = 0; i < n; i++, v >>= 8)
+		b[i] = v;
+	gz_idx_put(w, b, n);
+}
+
+static uint64_t get_le(const unsigned char *p, unsigned n)
+{
+	uint64_t v = 0;
+
+	while (n)
+		v = (v << 8) | p[--n];
+	return v;
+}
+
+/* Appends the index made by make_index() to the archive */
+static void export_index(void)
+{
+	struct gz_idx_writer *w = xmalloc(sizeof(*w));
+	gz_checkpoint_t *cp = xmalloc(sizeof(*cp));
+	off_t start = xlseek(IX.archive_fd, 0, SEEK_END);
+	unsigned i;
+
+	w->fd = IX.archive_fd;
+	w->len = 0;
+	gz_idx_put_le(w, IX.hdr.checkpoints, 4);
+	gz_idx_put_le(w, IX.cnt, 4);
+	xlseek(IX.fd, sizeof(IX.hdr), SEEK_SET);
+	for (i = 0; i < IX.hdr.checkpoints; i++) {
+		xread(IX.fd, cp, sizeof(*cp));
+		gz_idx_put_le(w, cp->out_ofs, 8);
+		gz_idx_put_le(w, cp->in_ofs, 8);
+		gz_idx_put_le(w, cp->bitbuf, 4);
+		gz_idx_put_le(w, cp->bitcnt, 4);
+		gz_idx_put_le(w, cp->wpos, 4);
+		gz_idx_put(w, cp->window, sizeof(cp->window));
+	}
+	for (i = 0; i < IX.cnt; i++) {
+		gz_idx_put_le(w, IX.member[i].offset, 8);
+		gz_idx_put(w, IX.member[i].name, strlen(IX.member[i].name) + 1);
+	}
+	if (w->len)
+		gz_idx_flush(w);
+	gz_idx_put(w, TAR_INDEX_MAGIC, 8);
+	gz_idx_put_le(w, start, 8);
+	gz_idx_flush(w);
+	free(cp);
+	free(w);
+}
+
+/* Length of the payload of the index member at p, -1 if it isn't one */
+static int gz_idx_member(const unsigned char *p, size_t avail)
+{
+	unsigned len;
+
+	if (avail < GZ_IDX_HEAD + GZ_IDX_TAIL
+	 || memcmp(p, "\x1f\x8b\x08\x04", 4) != 0
+	 || p[12] != 'B' || p[13] != 'I'
+	) {
+		return -1;
+	}
+	len = get_le(p + 14, 2);
+	if (get_le(p + 10, 2) != len + 4
+	 || avail < GZ_IDX_HEAD + len + GZ_IDX_TAIL
+	 || p[GZ_IDX_HEAD + len] != 0x03
+	) {
+		return -1;
+	}
+	return len;
+}
+
+/* Writes the archive's own index to IX.fd in the index file form.
+ * Returns 0 if there is none or it is damaged */
+static int import_index(const struct stat *st)
+{
+	struct tar_index_hdr *h = &IX.hdr;
+	unsigned char loc[GZ_IDX_LOCATOR];
+	unsigned char *buf, *p, *end;
+	gz_checkpoint_t *cp;
+	off_t start, stop;
+	size_t sz;
+	int len;
+	unsigned i;
+
+	stop = st->st_size - GZ_IDX_LOCATOR;
+	if (stop < 0
+	 || pread(IX.archive_fd, loc, sizeof(loc), stop) != sizeof(loc)
+	 || gz_idx_member(loc, sizeof(loc)) != 16
+	 || memcmp(loc + GZ_IDX_HEAD, TAR_INDEX_MAGIC, 8) != 0
+	) {
+		return 0;
+	}
+	start = get_le(loc + GZ_IDX_HEAD + 8, 8);
+	if (start < 0 || start > stop)
+		return 0;
+	sz = stop - start;
+	buf = xmalloc(sz + 1);
+	xlseek(IX.archive_fd, start, SEEK_SET);
+	if (full_read(IX.archive_fd, buf, sz) != (ssize_t)sz)
+		goto bad;
+	/* Join the payloads */
+	end = buf;
+	for (p = buf; p < buf + sz; p += GZ_IDX_HEAD + len + GZ_IDX_TAIL) {
+		len = gz_idx_member(p, buf + sz - p);
+		if (len < 0)
+			goto bad;
+		memmove(end, p + GZ_IDX_HEAD, len);
+		end += len;
+	}
+
+	p = buf;
+	if (end - p < 8)
+		goto bad;
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, TAR_INDEX_MAGIC, sizeof(h->magic));
+	h->archive_size = st->st_size;
+	h->archive_mtime = st->st_mtime;
+	h->checkpoints = get_le(p, 4);
+	h->members = get_le(p + 4, 4);
+	p += 8;
+	if ((size_t)(end - p) / GZ_IDX_CP_SIZE < h->checkpoints)
+		goto bad;
+	xwrite(IX.fd, h, sizeof(*h));
+	cp = xmalloc(sizeof(*cp));
+	for (i = 0; i < h->checkpoints; i++) {
+		cp->out_ofs = get_le(p, 8);
+		cp->in_ofs = get_le(p + 8, 8);
+		cp->bitbuf = get_le(p + 16, 4);
+		cp->bitcnt = get_le(p + 20, 4);
+		cp->wpos = get_le(p + 24, 4);
+		memcpy(cp->window, p + 28, sizeof(cp->window));
+		p += GZ_IDX_CP_SIZE;
+		if (cp->in_ofs < 0 || cp->in_ofs > start
+		 || cp->bitcnt > 32 || cp->wpos > sizeof(cp->window)
+		) {
+			free(cp);
+			goto bad;
+		}
+		xwrite(IX.fd, cp, sizeof(*cp));
+	}
+	free(cp);
+	/* read_index() checks the member list */
+	*end = '\0';
+	for (i = 0; i < h->members && end - p >= 8; i++) {
+		off_t ofs = get_le(p, 8);
+		unsigned char *name_end;
+
+		p += 8;
+		xwrite(IX.fd, &ofs, sizeof(ofs));
+		name_end = (unsigned char *)strchr((char *)p, '\0') + 1;
+		xwrite(IX.fd, p, name_end - p);
+		p = name_end;
+	}
+	free(buf);
+	xlseek(IX.fd, 0, SEEK_SET);
+	return 1;
+ bad:
+	free(buf);
+	return 0;
+}
+
+/* Before -C DIR, the name is relative to where we started */
+static void open_index(const char *index_name, int src_fd)
+{
+	struct stat st1, st2;
+
+	IX.archive_fd = -1;
+	IX.fd = open(index_name, O_RDWR | O_CREAT, 0666);
+	if (IX.fd < 0) /* can still use an existing one */
+		IX.fd = xopen(index_name, O_RDONLY);
+	if (fstat(IX.fd, &st1) == 0 && fstat(src_fd, &st2) == 0
+	 && st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino
+	) {
+		IX.archive_fd = IX.fd;
+		IX.fd = xmkstemp_unlinked(NULL, "tar");
+	}
+}
+
+/* Replaces the get_header loop of tar_main */
+static void tar_indexed(archive_handle_t *archive_handle, const char *index_name)
+{
+	file_header_t *file_header = archive_handle->file_header;
+	struct stat st;
+	char magic[6];
+	off_t first, last;
+	int gz;
+	unsigned i;
+
+	if (fstat(archive_handle->src_fd, &st) != 0 || !S_ISREG(st.st_mode))
+		bb_error_msg_and_die("--index needs an archive file");
+	memset(magic, 0, sizeof(magic));
+	if (pread(archive_handle->src_fd, magic, 2, 0) < 0)
+		bb_perror_msg_and_die("read error");
+	gz = (magic[0] == 0x1f && magic[1] == (char)0x8b);
+	if (!gz) {
+		/* Offsets in other compressed archives are of no use */
+		if (pread(archive_handle->src_fd, magic, 5, 257) < 0)
+			bb_perror_msg_and_die("read error");
+		if (strcmp(magic, "ustar") != 0)
+			bb_error_msg_and_die("--index needs a tar or tar.gz archive");
+		if (IX.archive_fd >= 0)
+			bb_error_msg_and_die("only a tar.gz can hold its index");
+	}
+
+	if ((IX.archive_fd >= 0 && !import_index(&st)) || !read_index(&st)) {
+		make_index(archive_handle, index_name, &st, gz);
+		if (IX.archive_fd >= 0)
+			export_index();
+		return;
+	}
+
+	/* Only the headers from the first to the last wanted member
+	 * have to be read. For tar t, the index has all there is to say */
+	first = -1;
+	last = 0;
+	for (i = 0; i < IX.cnt; i++) {
+		file_header->name = IX.member[i].name;
+		if (archive_handle->filter(archive_handle) != EXIT_SUCCESS)
+			continue;
+		if (archive_handle->action_header == header_list
+		 && archive_handle->action_data == data_skip
+		) {
+			char *cp = last_char_is(file_header->name, '/');
+			header_list(file_header);
+			if (cp) *cp = '\0';
+			llist_add_to(&archive_handle->passed, file_header->name);
+			continue;
+		}
+		if (first < 0)
+			first = IX.member[i].offset;
+		last = IX.member[i].offset;
+	}
+	file_header->name = NULL;
+	if (first < 0)
+		return;
+
+	if (!gz) {
+		xlseek(archive_handle->src_fd, first, SEEK_SET);
+	} else {
+		IX.resume = find_checkpoint(first);
+		close(IX.fd);
+		IX.fd = -1;
+		start_gunzip(archive_handle);
+		seek_by_read(archive_handle->src_fd,
+				first - (IX.resume ? IX.resume->out_ofs : 0));
+	}
+	archive_handle->offset = first;
+	while (get_header_tar(archive_handle) == EXIT_SUCCESS
+	 && archive_handle->offset <= last
+	) {
+		continue;
+	}
+}
+#endif
+
 #ifdef CHECK_FOR_CHILD_EXITCODE
 /* Looks like it isn't needed - tar detects malformed (truncated)
  * archive if e.g. bunzip2 fails */
@@ -749,6 +1383,8 @@ enum {
 	IF_FEATURE_SEAMLESS_GZ(  OPTBIT_GZIP        ,)
 	IF_FEATURE_SEAMLESS_Z(   OPTBIT_COMPRESS    ,) // 16th bit
 	IF_FEATURE_TAR_NOPRESERVE_TIME(OPTBIT_NOPRESERVE_TIME,)
+	IF_FEATURE_SEAMLESS_XZ(  OPTBIT_XZ          ,)
+	IF_FEATURE_TAR_SPARSE(   OPTBIT_SPARSE      ,)
 #if ENABLE_FEATURE_TAR_LONG_OPTIONS
 	OPTBIT_NUMERIC_OWNER,
 	OPTBIT_NOPRESERVE_PERM,
@@ -772,6 +1408,8 @@ enum {
 	OPT_GZIP         = IF_FEATURE_SEAMLESS_GZ(  (1 << OPTBIT_GZIP        )) + 0, // z
 	OPT_COMPRESS     = IF_FEATURE_SEAMLESS_Z(   (1 << OPTBIT_COMPRESS    )) + 0, // Z
 	OPT_NOPRESERVE_TIME = IF_FEATURE_TAR_NOPRESERVE_TIME((1 << OPTBIT_NOPRESERVE_TIME)) + 0, // m
+	OPT_XZ           = IF_FEATURE_SEAMLESS_XZ(  (1 << OPTBIT_XZ          )) + 0, // J
+	OPT_SPARSE       = IF_FEATURE_TAR_SPARSE(   (1 << OPTBIT_SPARSE      )) + 0, // S
 	OPT_NUMERIC_OWNER   = IF_FEATURE_TAR_LONG_OPTIONS((1 << OPTBIT_NUMERIC_OWNER  )) + 0, // numeric-owner
 	OPT_NOPRESERVE_PERM = IF_FEATURE_TAR_LONG_OPTIONS((1 << OPTBIT_NOPRESERVE_PERM)) + 0, // no-same-permissions
 	OPT_OVERWRITE       = IF_FEATURE_TAR_LONG_OPTIONS((1 << OPTBIT_OVERWRITE      )) + 0, // overwrite
@@ -812,6 +1450,12 @@ static const char tar_longopts[] ALIGN1 =
 # endif
 # if ENABLE_FEATURE_TAR_NOPRESERVE_TIME
 	"touch\0"               No_argument       "m"
+# endif
+# if ENABLE_FEATURE_SEAMLESS_XZ
+	"xz\0"                  No_argument       "J"
+# endif
+# if ENABLE_FEATURE_TAR_SPARSE
+	"sparse\0"              No_argument       "S"
 # endif
 	/* use numeric uid/gid from tar header, not textual */
 	"numeric-owner\0"       No_argument       "\xfc"
@@ -823,6 +1467,14 @@ static const char tar_longopts[] ALIGN1 =
 	/* therefore we have to put it _after_ --no-same-permissions */
 # if ENABLE_FEATURE_TAR_FROM
 	"exclude\0"             Required_argument "\xff"
+# endif
+# if ENABLE_FEATURE_TAR_JOBS
+	/* write files in N processes */
+	"jobs\0"                Required_argument "\xfb"
+# endif
+# if ENABLE_FEATURE_TAR_INDEX
+	/* offsets of members */
+	"index\0"               Required_argument "\xfa"
 # endif
 	;
 #endif
@@ -839,6 +1491,13 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 #if ENABLE_FEATURE_TAR_LONG_OPTIONS && ENABLE_FEATURE_TAR_FROM
 	llist_t *excludes = NULL;
 #endif
+#if ENABLE_FEATURE_TAR_JOBS
+	const char *jobs_str = NULL;
+	unsigned jobs = 1;
+#endif
+#if ENABLE_FEATURE_TAR_INDEX
+	const char *index_name = NULL;
+#endif
 
 	/* Initialise default values */
 	tar_handle = init_handle();
@@ -900,6 +1559,8 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 		IF_FEATURE_SEAMLESS_GZ(  "z"   )
 		IF_FEATURE_SEAMLESS_Z(   "Z"   )
 		IF_FEATURE_TAR_NOPRESERVE_TIME("m")
+		IF_FEATURE_SEAMLESS_XZ(  "J"   )
+		IF_FEATURE_TAR_SPARSE(   "S"   )
 		, &base_dir // -C dir
 		, &tar_filename // -f filename
 		IF_FEATURE_TAR_FROM(, &(tar_handle->accept)) // T
@@ -907,6 +1568,8 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 #if ENABLE_FEATURE_TAR_LONG_OPTIONS && ENABLE_FEATURE_TAR_FROM
 		, &excludes // --exclude
 #endif
+		IF_FEATURE_TAR_JOBS(, &jobs_str) // --jobs
+		IF_FEATURE_TAR_INDEX(, &index_name) // --index
 		, &verboseFlag // combined count for -t and -v
 		, &verboseFlag // combined count for -t and -v
 		);
@@ -919,6 +1582,11 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 	if (opt & OPT_EXTRACT)
 		tar_handle->action_data = data_extract_all;
 
+#if ENABLE_FEATURE_TAR_JOBS
+	if (jobs_str)
+		jobs = xatou_range(jobs_str, 1, 64);
+#endif
+
 	if (opt & OPT_2STDOUT)
 		tar_handle->action_data = data_extract_to_stdout;
 
@@ -948,6 +1616,9 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 	if (opt & OPT_LZMA)
 		get_header_ptr = get_header_tar_lzma;
 
+	if (opt & OPT_XZ)
+		get_header_ptr = get_header_tar_xz;
+
 	if (opt & OPT_COMPRESS)
 		get_header_ptr = get_header_tar_Z;
 
@@ -1001,7 +1672,9 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 			tar_handle->src_fd = tar_fd;
 			tar_handle->seek = seek_by_read;
 		} else {
-			if (ENABLE_FEATURE_TAR_AUTODETECT && flags == O_RDONLY) {
+			if (ENABLE_FEATURE_TAR_AUTODETECT && flags == O_RDONLY
+			 IF_FEATURE_TAR_INDEX(&& !index_name) /* it reads the raw file */
+			) {
 				get_header_ptr = get_header_tar;
 				tar_handle->src_fd = open_zipped(tar_filename);
 				if (tar_handle->src_fd < 0)
@@ -1012,9 +1685,22 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 		}
 	}
 
+#if ENABLE_FEATURE_TAR_INDEX
+	if (index_name && !(opt & OPT_CREATE))
+		open_index(index_name, tar_handle->src_fd);
+#endif
+
 	if (base_dir)
 		xchdir(base_dir);
 
+#if ENABLE_FEATURE_TAR_JOBS
+	/* Not for -O, there the order of the data matters */
+	if (jobs > 1 && tar_handle->action_data == data_extract_all) {
+		data_extract_parallel_start(tar_handle, jobs);
+		tar_handle->action_data = data_extract_parallel;
+	}
+#endif
+
 #ifdef CHECK_FOR_CHILD_EXITCODE
 	/* We need to know whether child (gzip/bzip/etc) exits abnormally */
 	signal(SIGCHLD, handle_SIGCHLD);
@@ -1031,13 +1717,27 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 #endif
 		/* NB: writeTarFile() closes tar_handle->src_fd */
 		return writeTarFile(tar_handle->src_fd, verboseFlag, opt & OPT_DEREFERENCE,
-				tar_handle->accept,
+				opt & OPT_SPARSE, tar_handle->accept,
 				tar_handle->reject, zipMode);
 	}
 
+#if ENABLE_FEATURE_TAR_INDEX
+	if (index_name)
+		tar_indexed(tar_handle, index_name);
+	else
+#endif
 	while (get_header_ptr(tar_handle) == EXIT_SUCCESS)
 		continue;
 
+#if ENABLE_FEATURE_TAR_JOBS
+	/* A writer which failed has said why */
+	if (tar_handle->action_data == data_extract_parallel
+	 && data_extract_parallel_wait() != 0
+	) {
+		xfunc_die();
+	}
+#endif
+
 	/* Check that every file that should have been extracted was */
 	while (tar_handle->accept) {
 		if (!find_list_entry(tar_handle->reject, tar_handle->accept->data)
@@ -247,6 +247,125 @@ static void unzip_extract(zip_header_t *zip_header, int dst_fd)
 	}
 }
 
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+/* Members are independent, so while the main process walks the
+ * headers, decides what to extract and makes the directories, forked
+ * workers inflate. Each worker opens the zip file itself, for a file
+ * position of its own, and gets jobs on its own pipe. Jobs go to the
+ * worker picked by hashing the name: a name which is in the zip twice
+ * is written in zip order. */
+struct unzip_job {
+	off_t data_ofs;
+	zip_header_t zip_header;
+	/* then the name, filename_len bytes */
+};
+
+static struct {
+	unsigned cnt;
+	int *fd;
+	pid_t *pid;
+} W;
+
+static void NORETURN unzip_worker(const char *zip_path, int job_fd)
+{
+	struct unzip_job job;
+
+	xmove_fd(xopen(zip_path, O_RDONLY), zip_fd);
+	while (full_read(job_fd, &job, sizeof(job)) == sizeof(job)) {
+		char *name = xzalloc(job.zip_header.formatted.filename_len + 1);
+		int dst_fd;
+
+		xread(job_fd, name, job.zip_header.formatted.filename_len);
+		dst_fd = xopen(name, O_WRONLY | O_TRUNC);
+		xlseek(zip_fd, job.data_ofs, SEEK_SET);
+		unzip_extract(&job.zip_header, dst_fd);
+		close(dst_fd);
+		free(name);
+	}
+	_exit(EXIT_SUCCESS);
+}
+
+/* jobs == 0: one per online CPU */
+static void unzip_start_workers(const char *zip_path, unsigned jobs)
+{
+	unsigned i;
+
+	if (jobs == 0) {
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+		if ((int)jobs > 8)
+			jobs = 8;
+	}
+	if ((int)jobs <= 1)
+		return;
+	W.cnt = jobs;
+	W.fd = xmalloc(W.cnt * sizeof(W.fd[0]));
+	W.pid = xmalloc(W.cnt * sizeof(W.pid[0]));
+	fflush_all();
+	/* A worker which died has said why, don't die of SIGPIPE
+	 * before we get to exit with an error */
+	signal(SIGPIPE, SIG_IGN);
+	for (i = 0; i < W.cnt; i++) {
+		struct fd_pair job;
+
+		xpiped_pair(job);
+		W.pid[i] = fork();
+		if (W.pid[i] < 0)
+			bb_perror_msg_and_die("vfork" + 1);
+		if (W.pid[i] == 0) {
+			/* Other workers must see EOF when we close their pipes */
+			while (i)
+				close(W.fd[--i]);
+			close(job.wr);
+			unzip_worker(zip_path, job.rd);
+		}
+		close(job.rd);
+		W.fd[i] = job.wr;
+	}
+}
+
+/* Returns 0 if all workers have done their work */
+static int unzip_wait_workers(void)
+{
+	int ret = 0;
+	unsigned i;
+
+	for (i = 0; i < W.cnt; i++)
+		close(W.fd[i]);
+	for (i = 0; i < W.cnt; i++) {
+		int status;
+		if (safe_waitpid(W.pid[i], &status, 0) < 0 || status != 0)
+			ret = 1;
+	}
+	return ret;
+}
+
+/* The file exists already, the worker fills it */
+static void unzip_queue(zip_header_t *zip_header, const char *dst_fn)
+{
+	struct unzip_job job;
+	unsigned hash;
+	const char *p;
+	int fd;
+
+	hash = 0;
+	for (p = dst_fn; *p; p++)
+		hash = hash * 31 + (unsigned char)*p;
+	fd = W.fd[hash % W.cnt];
+
+	job.data_ofs = xlseek(zip_fd, 0, SEEK_CUR);
+	job.zip_header = *zip_header;
+	job.zip_header.formatted.filename_len = p - dst_fn;
+	if (full_write(fd, &job, sizeof(job)) != sizeof(job)
+	 || full_write(fd, dst_fn, p - dst_fn) != p - dst_fn
+	) {
+		/* The worker has said why. Let the others finish
+		 * what they have, they write into our cwd */
+		unzip_wait_workers();
+		xfunc_die();
+	}
+}
+#endif
+
 int unzip_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int unzip_main(int argc, char **argv)
 {
@@ -270,6 +389,10 @@ int unzip_main(int argc, char **argv)
 	llist_t *zaccept = NULL;
 	llist_t *zreject = NULL;
 	char *base_dir = NULL;
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+	char *zip_path = NULL;
+	unsigned jobs = 0;
+#endif
 	int i, opt;
 	int opt_range = 0;
 	char key_buf[80];
@@ -317,7 +440,7 @@ int unzip_main(int argc, char **argv)
  */
 
 	/* '-' makes getopt return 1 for non-options */
-	while ((opt = getopt(argc, argv, "-d:lnopqxv")) != -1) {
+	while ((opt = getopt(argc, argv, "-d:lnopqxv" IF_FEATURE_UNZIP_PARALLEL("T:"))) != -1) {
 		switch (opt_range) {
 		case 0: /* Options */
 			switch (opt) {
@@ -345,6 +468,12 @@ int unzip_main(int argc, char **argv)
 				listing = 1;
 				break;
 
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+			case 'T': /* Number of workers */
+				jobs = xatou_range(optarg, 0, 64);
+				break;
+#endif
+
 			case 1: /* The zip file */
 				/* +5: space for ".zip" and NUL */
 				src_fn = xmalloc(strlen(optarg) + 5);
@@ -417,10 +546,23 @@ int unzip_main(int argc, char **argv)
 		xmove_fd(src_fd, zip_fd);
 	}
 
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+	/* Workers need a file to open, and are of no use for -l and -p.
+	 * They start after -d DIR, so give them a name valid there */
+	if (!LONE_DASH(src_fn) && !listing && dst_fd != STDOUT_FILENO)
+		zip_path = src_fn[0] == '/' ? src_fn
+			: concat_path_file(xrealloc_getcwd_or_warn(NULL), src_fn);
+#endif
+
 	/* Change dir if necessary */
 	if (base_dir)
 		xchdir(base_dir);
 
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+	if (zip_path)
+		unzip_start_workers(zip_path, jobs);
+#endif
+
 	if (quiet <= 1) { /* not -qq */
 		if (quiet == 0)
 			printf("Archive:  %s\n", src_fn);
@@ -593,6 +735,17 @@ int unzip_main(int argc, char **argv)
 		case 'y': /* Open file and fall into unzip */
 			unzip_create_leading_dirs(dst_fn);
 			dst_fd = xopen(dst_fn, O_WRONLY | O_CREAT | O_TRUNC);
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+			if (W.cnt) {
+				close(dst_fd);
+				if (!quiet) {
+					printf("  inflating: %s\n", dst_fn);
+				}
+				unzip_queue(&zip_header, dst_fn);
+				unzip_skip(zip_header.formatted.cmpsize);
+				break;
+			}
+#endif
 		case -1: /* Unzip */
 			if (!quiet) {
 				printf("  inflating: %s\n", dst_fn);
@@ -651,5 +804,10 @@ int unzip_main(int argc, char **argv)
 		}
 	}
 
+#if ENABLE_FEATURE_UNZIP_PARALLEL
+	/* A worker which failed has said why */
+	if (W.cnt && unzip_wait_workers() != 0)
+		return EXIT_FAILURE;
+#endif
 	return 0;
 }
@@ -103,7 +103,10 @@ int chmod_main(int argc UNUSED_PARAM, char **argv)
 	smode = *argv++;
 	do {
 		if (!recursive_action(*argv,
-			OPT_RECURSE,    // recurse
+			OPT_RECURSE     // recurse
+			  /* order shows only in messages */
+			  | ((OPT_RECURSE && !OPT_VERBOSE && !OPT_CHANGED)
+			    ? ACTION_UNORDERED | ACTION_PARALLEL : 0),
 			fileAction,     // file action
 			fileAction,     // dir action
 			smode,          // user data
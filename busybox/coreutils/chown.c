@@ -113,6 +113,8 @@ int chown_main(int argc UNUSED_PARAM, char **argv)
 		flags |= ACTION_FOLLOWLINKS_L0; /* -H/-L: follow links on depth 0 */
 	if (OPT_TRAVERSE)
 		flags |= ACTION_FOLLOWLINKS; /* follow links if -L */
+	if (OPT_RECURSE && !OPT_VERBOSE && !OPT_CHANGED)
+		flags |= ACTION_UNORDERED | ACTION_PARALLEL;
 
 	parse_chown_usergroup_or_die(&param.ugid, argv[0]);
 
@@ -40,6 +40,12 @@ int cp_main(int argc, char **argv)
 		OPT_parents = 1 << (sizeof(FILEUTILS_CP_OPTSTR)+3),
 #endif
 	};
+#if ENABLE_FEATURE_CP_JOBS
+	const char *jobs = NULL;
+#endif
+#if ENABLE_FEATURE_CP_SPARSE
+	const char *sparse = "auto";
+#endif
 
 	// Need at least two arguments
 	// Soft- and hardlinking doesn't mix
@@ -60,10 +66,19 @@ int cp_main(int argc, char **argv)
 		"symbolic-link\0"  No_argument "s"
 		"verbose\0"        No_argument "v"
 		"parents\0"        No_argument "\xff"
+		IF_FEATURE_CP_JOBS(
+		"jobs\0"           Required_argument "\xfe"
+		)
+		IF_FEATURE_CP_SPARSE(
+		"sparse\0"         Required_argument "\xfd"
+		)
 		;
 #endif
 	// -v (--verbose) is ignored
-	flags = getopt32(argv, FILEUTILS_CP_OPTSTR "arPv");
+	flags = getopt32(argv, FILEUTILS_CP_OPTSTR "arPv"
+			IF_FEATURE_CP_JOBS(, &jobs)
+			IF_FEATURE_CP_SPARSE(, &sparse)
+	);
 	/* Options of cp from GNU coreutils 6.10:
 	 * -a, --archive
 	 * -f, --force
@@ -80,6 +95,8 @@ int cp_main(int argc, char **argv)
 	 * -c	same as --preserve=context
 	 * --parents
 	 *	use full source file name under DIRECTORY
+	 * --sparse=WHEN
+	 *	control creation of sparse files
 	 * NOT SUPPORTED IN BBOX:
 	 * --backup[=CONTROL]
 	 *	make a backup of each existing destination file
@@ -92,8 +109,6 @@ int cp_main(int argc, char **argv)
 	 * --no-preserve=ATTR_LIST
 	 * --remove-destination
 	 *	remove  each existing destination file before attempting to open
-	 * --sparse=WHEN
-	 *	control creation of sparse files
 	 * --strip-trailing-slashes
 	 *	remove any trailing slashes from each SOURCE argument
 	 * -S, --suffix=SUFFIX
@@ -126,6 +141,25 @@ int cp_main(int argc, char **argv)
 		selinux_or_die();
 	}
 #endif
+#if ENABLE_FEATURE_CP_SPARSE
+	/* Like coreutils, keep holes by default ("auto").
+	 * "always" also makes holes where the source has zeroes */
+	{
+		static const char sparse_words[] ALIGN1 = "always\0""auto\0""never\0";
+		static const int sparse_flags[] = {
+			FILEUTILS_SPARSE_ZEROES, FILEUTILS_SPARSE, 0
+		};
+		int i = index_in_strings(sparse_words, sparse);
+		if (i < 0)
+			bb_error_msg_and_die(bb_msg_invalid_arg, sparse, "--sparse");
+		flags |= sparse_flags[i];
+	}
+#endif
+#if ENABLE_FEATURE_CP_JOBS
+	/* -i is fine: prompts come from us, before a copy is forked */
+	if (jobs)
+		copy_file_jobs(xatou_range(jobs, 1, 64));
+#endif
 
 	status = EXIT_SUCCESS;
 	last = argv[argc - 1];
@@ -175,9 +209,17 @@ int cp_main(int argc, char **argv)
 #endif
 		dest = concat_path_file(last, bb_get_last_path_component_strip(*argv));
  DO_COPY:
+#if ENABLE_FEATURE_PARALLEL_TREEWALK
+		if (flags & FILEUTILS_RECUR)
+			treewalk_prefetch_start(*argv);
+#endif
 		if (copy_file(*argv, dest, flags) < 0) {
 			status = EXIT_FAILURE;
 		}
+#if ENABLE_FEATURE_PARALLEL_TREEWALK
+		if (flags & FILEUTILS_RECUR)
+			treewalk_prefetch_stop();
+#endif
 		if (*++argv == last) {
 			/* possibly leaking dest... */
 			break;
@@ -186,6 +228,10 @@ int cp_main(int argc, char **argv)
 		free((void*)dest);
 	}
 
+#if ENABLE_FEATURE_CP_JOBS
+	if (copy_file_wait_jobs() < 0)
+		status = EXIT_FAILURE;
+#endif
 	/* Exit. We are NOEXEC, not NOFORK. We do exit at the end of main() */
 	return status;
 }
@@ -44,17 +44,25 @@ static void cut_file(FILE *file, char delim, const struct cut_list *cut_lists, u
 {
 	char *line;
 	unsigned linenum = 0;	/* keep these zero-based to be consistent */
+	line_reader_t *lr = line_reader_new(fileno(file));
+	char *printed = NULL;
+	int printed_size = 0;
 
 	/* go through every line in the file */
-	while ((line = xmalloc_fgetline(file)) != NULL) {
+	while ((line = line_reader_get(lr, NULL)) != NULL) {
 
-		/* set up a list so we can keep track of what's been printed */
 		int linelen = strlen(line);
-		char *printed = xzalloc(linelen + 1);
-		char *orig_line = line;
 		unsigned cl_pos = 0;
 		int spos;
 
+		/* set up a list so we can keep track of what's been printed */
+		if (linelen >= printed_size) {
+			printed_size = linelen + 1;
+			free(printed);
+			printed = xmalloc(printed_size);
+		}
+		memset(printed, 0, linelen + 1);
+
 		/* cut based on chars/bytes XXX: only works when sizeof(char) == byte */
 		if (option_mask32 & (CUT_OPT_CHAR_FLGS | CUT_OPT_BYTE_FLGS)) {
 			/* print the chars specified in each cut list */
@@ -160,9 +168,9 @@ static void cut_file(FILE *file, char delim, const struct cut_list *cut_lists, u
 		putchar('\n');
  next_line:
 		linenum++;
-		free(printed);
-		free(orig_line);
 	}
+	free(printed);
+	line_reader_free(lr);
 }
 
 int cut_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
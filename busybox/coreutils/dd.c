@@ -18,6 +18,28 @@ enum {
 	ofd = STDOUT_FILENO,
 };
 
+enum {
+	/* Must be in the same order as OP_conv_XXX! */
+	/* (see "flags |= (1 << what)" below) */
+	FLAG_NOTRUNC   = 1 << 0,
+	FLAG_SYNC      = 1 << 1,
+	FLAG_NOERROR   = 1 << 2,
+	FLAG_FSYNC     = 1 << 3,
+	FLAG_SPARSE    = 1 << 4,
+	/* end of conv flags */
+	/* Must be in the same order as iflag_words[] */
+	FLAG_IFLAG_SHIFT = 5,
+	FLAG_IDIRECT   = 1 << 5,
+	FLAG_FULLBLOCK = 1 << 6,
+	FLAG_ASYNC     = 1 << 7,
+	/* end of iflag flags */
+	FLAG_OFLAG_SHIFT = 8,
+	FLAG_ODIRECT   = 1 << 8,
+	/* end of oflag flags */
+	FLAG_TWOBUFS   = 1 << 9,
+	FLAG_COUNT     = 1 << 10,
+};
+
 static const struct suffix_mult dd_suffixes[] = {
 	{ "c", 1 },
 	{ "w", 2 },
@@ -34,6 +56,18 @@ static const struct suffix_mult dd_suffixes[] = {
 
 struct globals {
 	off_t out_full, out_part, in_full, in_part;
+#if ENABLE_FEATURE_DD_IBS_OBS
+	smallint sparse; /* conv=sparse */
+	smallint in_hole; /* last output block was skipped */
+	size_t direct_obs; /* oflag=direct is on for writes of this size */
+#endif
+#if ENABLE_FEATURE_DD_ASYNC
+	pid_t reader_pid;
+	int data_fd; /* filled buffers come from the reader here */
+	int free_fd; /* and go back to it here */
+	unsigned async_blocks;
+	char *async_bufs;
+#endif
 #if ENABLE_FEATURE_DD_THIRD_STATUS_LINE
 	unsigned long long total_bytes;
 	unsigned long long begin_time_us;
@@ -82,10 +116,204 @@ static void dd_output_status(int UNUSED_PARAM cur_signal)
 #endif
 }
 
+#if ENABLE_FEATURE_DD_IBS_OBS
+static int set_direct(int fd, int on)
+{
+	int fl = fcntl(fd, F_GETFL);
+
+	if (fl < 0)
+		return fl;
+	return fcntl(fd, F_SETFL, on ? (fl | O_DIRECT) : (fl & ~O_DIRECT));
+}
+
+/* O_DIRECT needs aligned buffers, mmap gives page aligned ones.
+ * iflag=async shares them with the reader process */
+static char *alloc_buf(size_t size, int flags)
+{
+	char *p;
+
+	if (!(flags & (FLAG_IDIRECT | FLAG_ODIRECT | FLAG_ASYNC)))
+		return xmalloc(size);
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		((flags & FLAG_ASYNC) ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS,
+		-1, 0);
+	if (p == MAP_FAILED)
+		bb_error_msg_and_die(bb_msg_memory_exhausted);
+	return p;
+}
+
+static int parse_comma_flags(char *val, const char *words, const char *error_in)
+{
+	int flags = 0;
+
+	while (1) {
+		int what;
+		/* find ',', replace them with NUL so we can use val for
+		 * index_in_strings() without copying.
+		 * We rely on val being non-null, else strchr would fault.
+		 */
+		char *arg = strchr(val, ',');
+		if (arg)
+			*arg = '\0';
+		what = index_in_strings(words, val);
+		if (what < 0)
+			bb_error_msg_and_die(bb_msg_invalid_arg, val, error_in);
+		flags |= (1 << what);
+		if (!arg) /* no ',' left, so this was the last specifier */
+			break;
+		/* *arg = ','; - to preserve ps listing? */
+		val = arg + 1; /* skip this keyword and ',' */
+	}
+	return flags;
+}
+#else
+# define alloc_buf(size, flags) xmalloc(size)
+#endif
+
+/* Read one input block, handling conv=noerror,sync and iflag=fullblock.
+ * Returns the number of bytes to write, -1 at EOF */
+static ssize_t read_block(char *ibuf, size_t ibs, int flags,
+	const char *infile, int *partial)
+{
+	ssize_t n;
+
+	if (ENABLE_FEATURE_DD_IBS_OBS && (flags & FLAG_FULLBLOCK))
+		n = full_read(ifd, ibuf, ibs);
+	else
+		n = safe_read(ifd, ibuf, ibs);
+	if (n == 0)
+		return -1;
+	if (n < 0) {
+		/* "Bad block" */
+		if (!(flags & FLAG_NOERROR))
+			bb_simple_perror_msg_and_die(infile);
+		bb_simple_perror_msg(infile);
+		/* GNU dd with conv=noerror skips over bad blocks */
+		xlseek(ifd, ibs, SEEK_CUR);
+		/* conv=noerror,sync writes NULs,
+		 * conv=noerror just ignores input bad blocks */
+		n = 0;
+	}
+	*partial = ((size_t)n != ibs);
+	if (*partial && (flags & FLAG_SYNC)) {
+		memset(ibuf + n, 0, ibs - n);
+		n = ibs;
+	}
+	return n;
+}
+
+#if ENABLE_FEATURE_DD_ASYNC
+/* iflag=async: a child reads into two shared buffers in turn while
+ * we write out the other one. It reports each filled buffer over one
+ * pipe, we hand buffers back over another */
+struct dd_block {
+	ssize_t n;
+	int partial;
+};
+
+static void NORETURN async_reader(char *bufs, size_t ibs, int flags,
+	off_t count, const char *infile, int data_fd, int free_fd)
+{
+	struct dd_block blk;
+	off_t blocks;
+	char c;
+
+	signal(SIGUSR1, SIG_IGN); /* the writer reports the status */
+	close(ofd);
+	for (blocks = 0; !(flags & FLAG_COUNT) || blocks != count; blocks++) {
+		/* Wait until the writer is done with this buffer */
+		if (blocks >= 2 && safe_read(free_fd, &c, 1) != 1)
+			break;
+		blk.n = read_block(bufs + (blocks & 1) * ibs, ibs, flags,
+				infile, &blk.partial);
+		if (blk.n < 0)
+			break;
+		if (full_write(data_fd, &blk, sizeof(blk)) != sizeof(blk))
+			break;
+	}
+	close(data_fd);
+	/* Stay around until the writer is done, so that it never
+	 * gets SIGPIPE giving a buffer back */
+	while (safe_read(free_fd, &c, 1) > 0)
+		continue;
+	_exit(EXIT_SUCCESS);
+}
+
+static void async_start(char *bufs, size_t ibs, int flags,
+	off_t count, const char *infile)
+{
+	struct fd_pair data, back;
+
+	xpiped_pair(data);
+	xpiped_pair(back);
+	G.reader_pid = fork();
+	if (G.reader_pid < 0)
+		bb_perror_msg_and_die("vfork" + 1);
+	if (G.reader_pid == 0) {
+		close(data.rd);
+		close(back.wr);
+		async_reader(bufs, ibs, flags, count, infile, data.wr, back.rd);
+	}
+	close(data.wr);
+	close(back.rd);
+	G.data_fd = data.rd;
+	G.free_fd = back.wr;
+	G.async_bufs = bufs;
+}
+
+static ssize_t async_next_block(char **ibuf, size_t ibs, int *partial)
+{
+	struct dd_block blk;
+
+	/* A reader which died on a read error closes the pipe */
+	if (full_read(G.data_fd, &blk, sizeof(blk)) != sizeof(blk))
+		return -1;
+	/* It is alive and waiting for the buffer we wrote out last */
+	if (G.async_blocks)
+		xwrite(G.free_fd, "", 1);
+	*ibuf = G.async_bufs + (G.async_blocks & 1) * ibs;
+	G.async_blocks++;
+	*partial = blk.partial;
+	return blk.n;
+}
+
+/* Returns the reader's exit status */
+static int async_finish(void)
+{
+	int status;
+
+	close(G.free_fd);
+	close(G.data_fd);
+	if (safe_waitpid(G.reader_pid, &status, 0) < 0)
+		return 1;
+	return status;
+}
+#endif
+
 static ssize_t full_write_or_warn(const void *buf, size_t len,
 	const char *const filename)
 {
-	ssize_t n = full_write(ofd, buf, len);
+	ssize_t n;
+
+#if ENABLE_FEATURE_DD_IBS_OBS
+	/* O_DIRECT wants whole blocks, a short last one needs it off */
+	if (G.direct_obs && len != G.direct_obs) {
+		set_direct(ofd, 0);
+		G.direct_obs = 0;
+	}
+	/* Seek over blocks of zeroes, unless output can't seek */
+	if (G.sparse && len) {
+		const char *p = buf;
+		if (p[0] == 0 && memcmp(p, p + 1, len - 1) == 0
+		 && lseek(ofd, len, SEEK_CUR) >= 0
+		) {
+			G.in_hole = 1;
+			return len;
+		}
+		G.in_hole = 0;
+	}
+#endif
+	n = full_write(ofd, buf, len);
 	if (n < 0)
 		bb_perror_msg("writing '%s'", filename);
 	return n;
@@ -116,26 +344,19 @@ static bool write_and_stats(const void *buf, size_t len, size_t obs,
 int dd_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int dd_main(int argc UNUSED_PARAM, char **argv)
 {
-	enum {
-		/* Must be in the same order as OP_conv_XXX! */
-		/* (see "flags |= (1 << what)" below) */
-		FLAG_NOTRUNC = 1 << 0,
-		FLAG_SYNC    = 1 << 1,
-		FLAG_NOERROR = 1 << 2,
-		FLAG_FSYNC   = 1 << 3,
-		/* end of conv flags */
-		FLAG_TWOBUFS = 1 << 4,
-		FLAG_COUNT   = 1 << 5,
-	};
 	static const char keywords[] ALIGN1 =
 		"bs\0""count\0""seek\0""skip\0""if\0""of\0"
 #if ENABLE_FEATURE_DD_IBS_OBS
-		"ibs\0""obs\0""conv\0"
+		"ibs\0""obs\0""conv\0""iflag\0""oflag\0"
 #endif
 		;
 #if ENABLE_FEATURE_DD_IBS_OBS
 	static const char conv_words[] ALIGN1 =
-		"notrunc\0""sync\0""noerror\0""fsync\0";
+		"notrunc\0""sync\0""noerror\0""fsync\0""sparse\0";
+	static const char iflag_words[] ALIGN1 =
+		"direct\0""fullblock\0" IF_FEATURE_DD_ASYNC("async\0");
+	static const char oflag_words[] ALIGN1 =
+		"direct\0";
 #endif
 	enum {
 		OP_bs = 0,
@@ -148,11 +369,14 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 		OP_ibs,
 		OP_obs,
 		OP_conv,
+		OP_iflag,
+		OP_oflag,
 		/* Must be in the same order as FLAG_XXX! */
 		OP_conv_notrunc = 0,
 		OP_conv_sync,
 		OP_conv_noerror,
 		OP_conv_fsync,
+		OP_conv_sparse,
 	/* Unimplemented conv=XXX: */
 	//nocreat       do not create the output file
 	//excl          fail if the output file already exists
@@ -222,24 +446,16 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 			/*continue;*/
 		}
 		if (what == OP_conv) {
-			while (1) {
-				/* find ',', replace them with NUL so we can use val for
-				 * index_in_strings() without copying.
-				 * We rely on val being non-null, else strchr would fault.
-				 */
-				arg = strchr(val, ',');
-				if (arg)
-					*arg = '\0';
-				what = index_in_strings(conv_words, val);
-				if (what < 0)
-					bb_error_msg_and_die(bb_msg_invalid_arg, val, "conv");
-				flags |= (1 << what);
-				if (!arg) /* no ',' left, so this was the last specifier */
-					break;
-				/* *arg = ','; - to preserve ps listing? */
-				val = arg + 1; /* skip this keyword and ',' */
-			}
-			continue; /* we trashed 'what', can't fall through */
+			flags |= parse_comma_flags(val, conv_words, "conv");
+			/*continue;*/
+		}
+		if (what == OP_iflag) {
+			flags |= parse_comma_flags(val, iflag_words, "iflag") << FLAG_IFLAG_SHIFT;
+			/*continue;*/
+		}
+		if (what == OP_oflag) {
+			flags |= parse_comma_flags(val, oflag_words, "oflag") << FLAG_OFLAG_SHIFT;
+			/*continue;*/
 		}
 #endif
 		if (what == OP_bs) {
@@ -271,10 +487,14 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	} /* end of "for (argv[n])" */
 
 //XXX:FIXME for huge ibs or obs, malloc'ing them isn't the brightest idea ever
-	ibuf = obuf = xmalloc(ibs);
+#if ENABLE_FEATURE_DD_IBS_OBS
+	G.sparse = (flags & FLAG_SPARSE) != 0;
+#endif
+	/* iflag=async reads into two buffers */
+	ibuf = obuf = alloc_buf((flags & FLAG_ASYNC) ? 2 * ibs : ibs, flags);
 	if (ibs != obs) {
 		flags |= FLAG_TWOBUFS;
-		obuf = xmalloc(obs);
+		obuf = alloc_buf(obs, flags & ~FLAG_ASYNC);
 	}
 
 #if ENABLE_FEATURE_DD_SIGNAL_HANDLING
@@ -289,6 +509,11 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	else {
 		infile = bb_msg_standard_input;
 	}
+#if ENABLE_FEATURE_DD_IBS_OBS
+	/* By fcntl and not open, so that it works on stdin/stdout too */
+	if ((flags & FLAG_IDIRECT) && set_direct(ifd, 1) < 0)
+		goto die_infile;
+#endif
 	if (outfile != NULL) {
 		int oflag = O_WRONLY | O_CREAT;
 
@@ -309,6 +534,13 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	} else {
 		outfile = bb_msg_standard_output;
 	}
+#if ENABLE_FEATURE_DD_IBS_OBS
+	if (flags & FLAG_ODIRECT) {
+		if (set_direct(ofd, 1) < 0)
+			goto die_outfile;
+		G.direct_obs = obs;
+	}
+#endif
 	if (skip) {
 		if (lseek(ifd, skip * ibs, SEEK_CUR) < 0) {
 			while (skip-- > 0) {
@@ -325,30 +557,25 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 			goto die_outfile;
 	}
 
+#if ENABLE_FEATURE_DD_ASYNC
+	if (flags & FLAG_ASYNC)
+		async_start(ibuf, ibs, flags, count, infile);
+#endif
 	while (!(flags & FLAG_COUNT) || (G.in_full + G.in_part != count)) {
-		n = safe_read(ifd, ibuf, ibs);
-		if (n == 0)
+		int partial;
+
+#if ENABLE_FEATURE_DD_ASYNC
+		if (flags & FLAG_ASYNC)
+			n = async_next_block(&ibuf, ibs, &partial);
+		else
+#endif
+			n = read_block(ibuf, ibs, flags, infile, &partial);
+		if (n < 0) /* EOF */
 			break;
-		if (n < 0) {
-			/* "Bad block" */
-			if (!(flags & FLAG_NOERROR))
-				goto die_infile;
-			bb_simple_perror_msg(infile);
-			/* GNU dd with conv=noerror skips over bad blocks */
-			xlseek(ifd, ibs, SEEK_CUR);
-			/* conv=noerror,sync writes NULs,
-			 * conv=noerror just ignores input bad blocks */
-			n = 0;
-		}
-		if ((size_t)n == ibs)
-			G.in_full++;
-		else {
+		if (partial)
 			G.in_part++;
-			if (flags & FLAG_SYNC) {
-				memset(ibuf + n, 0, ibs - n);
-				n = ibs;
-			}
-		}
+		else
+			G.in_full++;
 		if (flags & FLAG_TWOBUFS) {
 			char *tmp = ibuf;
 			while (n) {
@@ -374,12 +601,30 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 				goto die_outfile;
 		}
 	}
+#if ENABLE_FEATURE_DD_ASYNC
+	/* Reader died on a read error: it has said why */
+	if ((flags & FLAG_ASYNC) && async_finish() != 0)
+		xfunc_die();
+#endif
 
 	if (ENABLE_FEATURE_DD_IBS_OBS && oc) {
 		w = full_write_or_warn(obuf, oc, outfile);
 		if (w < 0) goto out_status;
 		if (w > 0) G.out_part++;
 	}
+#if ENABLE_FEATURE_DD_IBS_OBS
+	/* Seeking past the end doesn't extend a file, do it now */
+	if (G.in_hole) {
+		struct stat st;
+		off_t pos = lseek(ofd, 0, SEEK_CUR);
+
+		if (fstat(ofd, &st) == 0 && S_ISREG(st.st_mode)
+		 && st.st_size < pos && ftruncate(ofd, pos) < 0
+		) {
+			goto die_outfile;
+		}
+	}
+#endif
 	if (close(ifd) < 0) {
  die_infile:
 		bb_simple_perror_msg_and_die(infile);
@@ -30,9 +30,16 @@ static unsigned char *hash_bin_to_hex(unsigned char *hash_value,
 	return (unsigned char *)hex_value;
 }
 
-static uint8_t *hash_file(const char *filename /*, hash_algo_t hash_algo*/)
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+/* Bigger reads help the kernel keep the disk busy */
+# define HASH_BUFSIZE (64 * 1024)
+#else
+# define HASH_BUFSIZE 4096
+#endif
+
+static uint8_t *hash_fd(int src_fd /*, hash_algo_t hash_algo*/)
 {
-	int src_fd, hash_len, count;
+	int hash_len, count;
 	union _ctx_ {
 		sha512_ctx_t sha512;
 		sha256_ctx_t sha256;
@@ -40,16 +47,11 @@ static uint8_t *hash_file(const char *filename /*, hash_algo_t hash_algo*/)
 		md5_ctx_t md5;
 	} context;
 	uint8_t *hash_value = NULL;
-	RESERVE_CONFIG_UBUFFER(in_buf, 4096);
+	RESERVE_CONFIG_UBUFFER(in_buf, HASH_BUFSIZE);
 	void FAST_FUNC (*update)(const void*, size_t, void*);
 	void FAST_FUNC (*final)(void*, void*);
 	hash_algo_t hash_algo = applet_name[3];
 
-	src_fd = open_or_warn_stdin(filename);
-	if (src_fd < 0) {
-		return NULL;
-	}
-
 	/* figure specific hash algorithims */
 	if (ENABLE_MD5SUM && hash_algo == HASH_MD5) {
 		md5_begin(&context.md5);
@@ -75,7 +77,10 @@ static uint8_t *hash_file(const char *filename /*, hash_algo_t hash_algo*/)
 		bb_error_msg_and_die("algorithm not supported");
 	}
 
-	while (0 < (count = safe_read(src_fd, in_buf, 4096))) {
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+	posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	while (0 < (count = safe_read(src_fd, in_buf, HASH_BUFSIZE))) {
 		update(in_buf, count, &context);
 	}
 
@@ -86,13 +91,258 @@ static uint8_t *hash_file(const char *filename /*, hash_algo_t hash_algo*/)
 
 	RELEASE_CONFIG_BUFFER(in_buf);
 
+	return hash_value;
+}
+
+static uint8_t *hash_file(const char *filename /*, hash_algo_t hash_algo*/)
+{
+	int src_fd;
+	uint8_t *hash_value;
+
+	src_fd = open_or_warn_stdin(filename);
+	if (src_fd < 0) {
+		return NULL;
+	}
+	hash_value = hash_fd(src_fd);
 	if (src_fd != STDIN_FILENO) {
 		close(src_fd);
 	}
-
 	return hash_value;
 }
 
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+/* With -j N, files are hashed by N child processes. Child k takes
+ * files k, k+N, k+2N... and sends one reply per file down its pipe.
+ * The parent reads the pipes round robin, so results come back
+ * in the original order. */
+struct hash_reply {
+	int err; /* errno of failed open, -1 on read error */
+	char hex[64 * 2 + 1];
+};
+
+static unsigned jobs = 1;
+static int *job_fd;
+
+/* NULL names are skipped and don't count */
+static void start_jobs(char **names, unsigned n)
+{
+	unsigned k, valid;
+
+	valid = 0;
+	for (k = 0; k < n; k++)
+		if (names[k])
+			valid++;
+	if (jobs > valid)
+		jobs = valid;
+	if (jobs <= 1) {
+		jobs = 1;
+		return;
+	}
+	job_fd = xmalloc(jobs * sizeof(job_fd[0]));
+	for (k = 0; k < jobs; k++) {
+		struct fd_pair pipe;
+		pid_t pid;
+		unsigned i;
+
+		xpiped_pair(pipe);
+		pid = fork();
+		if (pid < 0)
+			bb_perror_msg_and_die("vfork" + 1);
+		if (pid) {
+			close(pipe.wr);
+			job_fd[k] = pipe.rd;
+			continue;
+		}
+		/* child */
+		close(pipe.rd);
+		for (i = 0; i < k; i++)
+			close(job_fd[i]);
+		valid = 0;
+		for (i = 0; i < n; i++) {
+			struct hash_reply reply;
+			uint8_t *hash_value = NULL;
+			int src_fd = STDIN_FILENO;
+
+			if (!names[i] || valid++ % jobs != k)
+				continue;
+			memset(&reply, 0, sizeof(reply));
+			if (NOT_LONE_DASH(names[i]))
+				src_fd = open(names[i], O_RDONLY);
+			if (src_fd < 0) {
+				reply.err = errno;
+			} else {
+				hash_value = hash_fd(src_fd);
+				if (src_fd != STDIN_FILENO)
+					close(src_fd);
+				if (hash_value)
+					strcpy(reply.hex, (char*)hash_value);
+				else
+					reply.err = -1;
+				free(hash_value);
+			}
+			if (full_write(pipe.wr, &reply, sizeof(reply)) != sizeof(reply))
+				_exit(EXIT_FAILURE);
+		}
+		_exit(EXIT_SUCCESS);
+	}
+}
+
+/* Result for the idx'th name given to start_jobs(), as hash_file() */
+static uint8_t *next_job_hash(unsigned idx, const char *filename)
+{
+	struct hash_reply reply;
+
+	if (full_read(job_fd[idx % jobs], &reply, sizeof(reply)) != sizeof(reply)) {
+		bb_error_msg("%s: child died", filename);
+		return NULL;
+	}
+	if (reply.err > 0) {
+		errno = reply.err;
+		bb_perror_msg("can't open '%s'", filename);
+	}
+	if (reply.err)
+		return NULL;
+	return (uint8_t *)xstrdup(reply.hex);
+}
+
+static void finish_jobs(void)
+{
+	unsigned k;
+
+	for (k = 0; k < jobs; k++)
+		close(job_fd[k]);
+	free(job_fd);
+	while (wait(NULL) > 0)
+		continue;
+}
+#endif
+
+/* Split "HASH  FILENAME" (or "HASH *FILENAME"), return FILENAME */
+static char *split_sum_line(char *line)
+{
+	char *filename_ptr;
+
+	filename_ptr = strstr(line, "  ");
+	/* handle format for binary checksums */
+	if (filename_ptr == NULL) {
+		filename_ptr = strstr(line, " *");
+	}
+	if (filename_ptr) {
+		*filename_ptr = '\0';
+		filename_ptr += 2;
+	}
+	return filename_ptr;
+}
+
+#if ENABLE_HASH_MULTIBUF
+# define MULTI_FILES 8
+# define MULTI_CHUNK (64 * 1024)
+
+/* Hash several files side by side and print their sums in argument
+ * order. Returns the first argument not taken, which is argv itself
+ * if the algorithm or the argument do not allow it. */
+static char **hash_files_multi(char **argv, int *return_value)
+{
+	union {
+		sha1_ctx_t sha1;
+		md5_ctx_t md5;
+	} ctx[MULTI_FILES];
+	void *ctxp[MULTI_FILES];
+	const void *data[MULTI_FILES];
+	size_t len[MULTI_FILES];
+	int fd[MULTI_FILES];
+	int err[MULTI_FILES];
+	uint8_t *buf;
+	hash_algo_t hash_algo = applet_name[3];
+	unsigned n, i, live, hash_len;
+
+	if (IF_FEATURE_MD5_SHA1_SUM_JOBS(jobs > 1 ||) 0)
+		return argv;
+	if (!(ENABLE_MD5SUM && hash_algo == HASH_MD5)
+	 && !(ENABLE_SHA1SUM && hash_algo == HASH_SHA1)
+	 && !(ENABLE_SHA256SUM && hash_algo == HASH_SHA256)
+	) {
+		return argv;
+	}
+	/* stdin can't be read side by side with itself */
+	for (n = 0; n < MULTI_FILES && argv[n] && NOT_LONE_DASH(argv[n]); n++)
+		continue;
+	if (n < 2)
+		return argv;
+
+	hash_len = 16;
+	live = 0;
+	for (i = 0; i < n; i++) {
+		if (hash_algo == HASH_MD5)
+			md5_begin(&ctx[i].md5);
+		else if (hash_algo == HASH_SHA1) {
+			sha1_begin(&ctx[i].sha1);
+			hash_len = 20;
+		} else {
+			sha256_begin(&ctx[i].sha1);
+			hash_len = 32;
+		}
+		/* Report errors when printing, to keep them in order */
+		fd[i] = open(argv[i], O_RDONLY);
+		err[i] = 0;
+		if (fd[i] < 0)
+			err[i] = errno;
+		else
+			live++;
+	}
+
+	buf = xmalloc(n * MULTI_CHUNK);
+	while (live) {
+		unsigned k = 0;
+
+		for (i = 0; i < n; i++) {
+			ssize_t count;
+
+			if (fd[i] < 0)
+				continue;
+			count = full_read(fd[i], buf + i * MULTI_CHUNK, MULTI_CHUNK);
+			if (count <= 0) {
+				close(fd[i]);
+				fd[i] = count < 0 ? -2 : -1;
+				live--;
+				continue;
+			}
+			ctxp[k] = &ctx[i];
+			data[k] = buf + i * MULTI_CHUNK;
+			len[k] = count;
+			k++;
+		}
+		if (hash_algo == HASH_MD5)
+			md5_hash_multi((md5_ctx_t **)ctxp, data, len, k);
+		else
+			sha1_hash_multi((sha1_ctx_t **)ctxp, data, len, k);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (fd[i] == -2 || err[i]) {
+			if (err[i]) {
+				errno = err[i];
+				bb_perror_msg("can't open '%s'", argv[i]);
+			}
+			*return_value = EXIT_FAILURE;
+			continue;
+		}
+		if (hash_algo == HASH_MD5)
+			md5_end(buf, &ctx[i].md5);
+		else if (hash_algo == HASH_SHA1)
+			sha1_end(buf, &ctx[i].sha1);
+		else
+			sha256_end(buf, &ctx[i].sha1);
+		bin2hex((char*)buf + 64, (char*)buf, hash_len);
+		buf[64 + hash_len * 2] = '\0';
+		printf("%s  %s\n", (char*)buf + 64, argv[i]);
+	}
+	free(buf);
+
+	return argv + n;
+}
+#endif
+
 int md5_sha1_sum_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 {
@@ -101,9 +351,13 @@ int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 	unsigned flags;
 	/*hash_algo_t hash_algo = applet_name[3];*/
 
-	if (ENABLE_FEATURE_MD5_SHA1_SUM_CHECK)
-		flags = getopt32(argv, "scw");
-	else optind = 1;
+	if (ENABLE_FEATURE_MD5_SHA1_SUM_CHECK || ENABLE_FEATURE_MD5_SHA1_SUM_JOBS) {
+		IF_FEATURE_MD5_SHA1_SUM_JOBS(opt_complementary = "j+";)
+		flags = getopt32(argv, ""
+			IF_FEATURE_MD5_SHA1_SUM_CHECK("scw")
+			IF_FEATURE_MD5_SHA1_SUM_JOBS("j:", &jobs)
+		);
+	} else optind = 1;
 	argv += optind;
 	//argc -= optind;
 	if (!*argv)
@@ -124,6 +378,12 @@ int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 		int count_total = 0;
 		int count_failed = 0;
 		char *line;
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+		char **lines = NULL;
+		char **names = NULL;
+		int nlines = 0;
+		unsigned valid = 0;
+#endif
 
 		if (argv[1]) {
 			bb_error_msg_and_die
@@ -132,15 +392,39 @@ int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 
 		pre_computed_stream = xfopen_stdin(argv[0]);
 
-		while ((line = xmalloc_fgetline(pre_computed_stream)) != NULL) {
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+		if (jobs > 1) {
+			/* Workers need the whole list up front */
+			while ((line = xmalloc_fgetline(pre_computed_stream)) != NULL) {
+				lines = xrealloc_vector(lines, 6, nlines);
+				names = xrealloc_vector(names, 6, nlines);
+				lines[nlines] = line;
+				names[nlines] = split_sum_line(line);
+				nlines++;
+			}
+			start_jobs(names, nlines);
+		}
+#endif
+
+		for (;;) {
 			char *filename_ptr;
 
-			count_total++;
-			filename_ptr = strstr(line, "  ");
-			/* handle format for binary checksums */
-			if (filename_ptr == NULL) {
-				filename_ptr = strstr(line, " *");
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+			if (lines) {
+				if (count_total == nlines)
+					break;
+				line = lines[count_total];
+				filename_ptr = names[count_total];
+			} else
+#endif
+			{
+				line = xmalloc_fgetline(pre_computed_stream);
+				if (!line)
+					break;
+				filename_ptr = split_sum_line(line);
 			}
+
+			count_total++;
 			if (filename_ptr == NULL) {
 				if (flags & FLAG_WARN) {
 					bb_error_msg("invalid format");
@@ -150,9 +434,12 @@ int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 				free(line);
 				continue;
 			}
-			*filename_ptr = '\0';
-			filename_ptr += 2;
 
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+			if (jobs > 1)
+				hash_value = next_job_hash(valid++, filename_ptr);
+			else
+#endif
 			hash_value = hash_file(filename_ptr /*, hash_algo*/);
 
 			if (hash_value && (strcmp((char*)hash_value, line) == 0)) {
@@ -168,6 +455,12 @@ int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 			free(hash_value);
 			free(line);
 		}
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+		if (jobs > 1)
+			finish_jobs();
+		free(lines);
+		free(names);
+#endif
 		if (count_failed && !(flags & FLAG_SILENT)) {
 			bb_error_msg("WARNING: %d of %d computed checksums did NOT match",
 						 count_failed, count_total);
@@ -178,7 +471,29 @@ int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 		}
 		*/
 	} else {
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+		unsigned idx = 0;
+
+		if (jobs > 1) {
+			unsigned n = 0;
+			while (argv[n])
+				n++;
+			start_jobs(argv, n);
+		}
+#endif
 		do {
+#if ENABLE_HASH_MULTIBUF
+			char **next = hash_files_multi(argv, &return_value);
+			if (next != argv) {
+				argv = next - 1;
+				continue;
+			}
+#endif
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+			if (jobs > 1)
+				hash_value = next_job_hash(idx++, *argv);
+			else
+#endif
 			hash_value = hash_file(*argv/*, hash_algo*/);
 			if (hash_value == NULL) {
 				return_value = EXIT_FAILURE;
@@ -187,6 +502,10 @@ int md5_sha1_sum_main(int argc UNUSED_PARAM, char **argv)
 				free(hash_value);
 			}
 		} while (*++argv);
+#if ENABLE_FEATURE_MD5_SHA1_SUM_JOBS
+		if (jobs > 1)
+			finish_jobs();
+#endif
 	}
 	return return_value;
 }
@@ -40,8 +40,8 @@ enum {
 	FLAG_f  = 0x400,        /* Force uppercase */
 	FLAG_i  = 0x800,        /* Ignore !isprint() */
 	FLAG_m  = 0x1000,       /* ignored: merge already sorted files; do not sort */
-	FLAG_S  = 0x2000,       /* ignored: -S, --buffer-size=SIZE */
-	FLAG_T  = 0x4000,       /* ignored: -T, --temporary-directory=DIR */
+	FLAG_S  = 0x2000,       /* -S, --buffer-size=SIZE */
+	FLAG_T  = 0x4000,       /* -T, --temporary-directory=DIR */
 	FLAG_o  = 0x8000,
 	FLAG_k  = 0x10000,
 	FLAG_t  = 0x20000,
@@ -56,8 +56,27 @@ static struct sort_key {
 	unsigned range[4];	/* start word, start char, end word, end char */
 	unsigned flags;
 } *key_list;
+static unsigned nkeys;
+#endif
+
+/* A line and its keys, made once when the line is read,
+ * all in one malloc block */
+struct sort_line {
+	char *str;
+	unsigned len;
+#if ENABLE_FEATURE_SORT_BIG
+	struct key_val {
+		char *str;  /* text key: the key, can be the line itself */
+		double num; /* -n, -g */
+		int type;   /* -g: 0 not a number, 1 NaN, 2 number; -M: month or -1 */
+	} key[];
+#endif
+};
 
-static char *get_key(char *str, struct sort_key *key, int flags)
+#if ENABLE_FEATURE_SORT_BIG
+/* Returns the key, which is str itself or a copy made in buf
+ * (strlen(str) + 1 bytes) */
+static char *get_key(char *str, struct sort_key *key, int flags, char *buf)
 {
 	int start = 0, end = 0, len, j;
 	unsigned i;
@@ -117,7 +136,9 @@ static char *get_key(char *str, struct sort_key *key, int flags)
 	}
 	/* Make the copy */
 	if (end < start) end = start;
-	str = xstrndup(str+start, end-start);
+	memcpy(buf, str+start, end-start);
+	buf[end-start] = '\0';
+	str = buf;
 	/* Handle -d */
 	if (flags & FLAG_d) {
 		for (start = end = 0; str[end]; end++)
@@ -145,123 +166,387 @@ static struct sort_key *add_key(void)
 	struct sort_key **pkey = &key_list;
 	while (*pkey)
 		pkey = &((*pkey)->next_key);
+	nkeys++;
 	return *pkey = xzalloc(sizeof(struct sort_key));
 }
 
-#define GET_LINE(fp) \
-	((option_mask32 & FLAG_z) \
-	? bb_get_chunk_from_file(fp, NULL) \
-	: xmalloc_fgetline(fp))
-#else
-#define GET_LINE(fp) xmalloc_fgetline(fp)
 #endif
 
-/* Iterate through keys list and perform comparisons */
-static int compare_keys(const void *xarg, const void *yarg)
-{
-	int flags = option_mask32, retval = 0;
-	char *x, *y;
+static struct {
+	char delim;
+#if ENABLE_FEATURE_SORT_BIG
+	char *scratch;
+	unsigned scratch_size;
+	struct key_val *kv;
+#endif
+#if ENABLE_FEATURE_SORT_EXTERNAL
+	unsigned long long mem; /* used by lines read so far */
+	const char *tmpdir;
+	unsigned jobs;
+	unsigned running;
+	unsigned nruns;
+	int *run_fd;
+	unsigned *run_level;
+#endif
+} G;
 
+/* Make (or remake, if line isn't NULL) line from str */
+static struct sort_line *make_line(struct sort_line *line, char *str, unsigned len)
+{
+	unsigned size = sizeof(*line) + len + 1;
 #if ENABLE_FEATURE_SORT_BIG
 	struct sort_key *key;
+	char *p;
+	unsigned i, need;
 
-	for (key = key_list; !retval && key; key = key->next_key) {
-		flags = key->flags ? key->flags : option_mask32;
-		/* Chop out and modify key chunks, handling -dfib */
-		x = get_key(*(char **)xarg, key, flags);
-		y = get_key(*(char **)yarg, key, flags);
-#else
-	/* This curly bracket serves no purpose but to match the nesting
-	   level of the for () loop we're not using */
-	{
-		x = *(char **)xarg;
-		y = *(char **)yarg;
-#endif
-		/* Perform actual comparison */
-		switch (flags & 7) {
+	/* Find the keys, in scratch if they are not the whole line */
+	need = nkeys * (len + 1);
+	if (G.scratch_size < need) {
+		G.scratch_size = need;
+		free(G.scratch);
+		G.scratch = xmalloc(need);
+	}
+	if (!G.kv)
+		G.kv = xmalloc(nkeys * sizeof(G.kv[0]));
+	size += nkeys * sizeof(line->key[0]);
+	for (i = 0, key = key_list; key; i++, key = key->next_key) {
+		struct key_val *kv = &G.kv[i];
+		char *x = get_key(str, key, key->flags, G.scratch + i * (len + 1));
+
+		kv->str = NULL;
+		switch (key->flags & 7) {
 		default:
 			bb_error_msg_and_die("unknown sort type");
-			break;
 		/* Ascii sort */
 		case 0:
-#if ENABLE_LOCALE_SUPPORT
-			retval = strcoll(x, y);
-#else
-			retval = strcmp(x, y);
-#endif
+			kv->str = x;
+			if (x != str)
+				size += strlen(x) + 1;
 			break;
-#if ENABLE_FEATURE_SORT_BIG
 		case FLAG_g: {
-			char *xx, *yy;
-			double dx = strtod(x, &xx);
-			double dy = strtod(y, &yy);
-			/* not numbers < NaN < -infinity < numbers < +infinity) */
-			if (x == xx)
-				retval = (y == yy ? 0 : -1);
-			else if (y == yy)
-				retval = 1;
-			/* Check for isnan */
-			else if (dx != dx)
-				retval = (dy != dy) ? 0 : -1;
-			else if (dy != dy)
-				retval = 1;
-			/* Check for infinity.  Could underflow, but it avoids libm. */
-			else if (1.0 / dx == 0.0) {
-				if (dx < 0)
-					retval = (1.0 / dy == 0.0 && dy < 0) ? 0 : -1;
-				else
-					retval = (1.0 / dy == 0.0 && dy > 0) ? 0 : 1;
-			} else if (1.0 / dy == 0.0)
-				retval = (dy < 0) ? 1 : -1;
-			else
-				retval = (dx > dy) ? 1 : ((dx < dy) ? -1 : 0);
+			char *xx;
+			kv->num = strtod(x, &xx);
+			kv->type = (x == xx) ? 0 : (kv->num != kv->num) ? 1 : 2;
 			break;
 		}
 		case FLAG_M: {
 			struct tm thyme;
-			int dx;
-			char *xx, *yy;
-
-			xx = strptime(x, "%b", &thyme);
-			dx = thyme.tm_mon;
-			yy = strptime(y, "%b", &thyme);
-			if (!xx)
-				retval = (!yy) ? 0 : -1;
-			else if (!yy)
-				retval = 1;
-			else
-				retval = (dx == thyme.tm_mon) ? 0 : dx - thyme.tm_mon;
+			kv->type = strptime(x, "%b", &thyme) ? thyme.tm_mon : -1;
 			break;
 		}
 		/* Full floating point version of -n */
-		case FLAG_n: {
-			double dx = atof(x);
-			double dy = atof(y);
-			retval = (dx > dy) ? 1 : ((dx < dy) ? -1 : 0);
+		case FLAG_n:
+			kv->num = atof(x);
 			break;
 		}
-		} /* switch */
-		/* Free key copies. */
-		if (x != *(char **)xarg) free(x);
-		if (y != *(char **)yarg) free(y);
-		/* if (retval) break; - done by for () anyway */
+	}
+#endif
+#if ENABLE_FEATURE_SORT_EXTERNAL
+	if (!line)
+		G.mem += size + sizeof(line);
+#endif
+	line = xrealloc(line, size);
+#if ENABLE_FEATURE_SORT_BIG
+	line->str = (char*)&line->key[nkeys];
 #else
-		/* Integer version of -n for tiny systems */
+	line->str = (char*)(line + 1);
+#endif
+	line->len = len;
+	memcpy(line->str, str, len + 1);
+#if ENABLE_FEATURE_SORT_BIG
+	p = line->str + len + 1;
+	for (i = 0; i < nkeys; i++) {
+		line->key[i] = G.kv[i];
+		if (G.kv[i].str == str)
+			line->key[i].str = line->str;
+		else if (G.kv[i].str) {
+			line->key[i].str = p;
+			p = stpcpy(p, G.kv[i].str) + 1;
+		}
+	}
+#endif
+	return line;
+}
+
+/* Iterate through keys list and perform comparisons */
+static int compare_lines(const struct sort_line *x, const struct sort_line *y, unsigned mask)
+{
+	int flags = mask, retval = 0;
+
+#if ENABLE_FEATURE_SORT_BIG
+	struct sort_key *key;
+	const struct key_val *kx = x->key;
+	const struct key_val *ky = y->key;
+
+	for (key = key_list; !retval && key; key = key->next_key, kx++, ky++) {
+		flags = key->flags;
+		switch (flags & 7) {
+		/* Ascii sort */
+		case 0:
+#if ENABLE_LOCALE_SUPPORT
+			retval = strcoll(kx->str, ky->str);
+#else
+			retval = strcmp(kx->str, ky->str);
+#endif
+			break;
+		/* not numbers < NaN < -infinity < numbers < +infinity) */
+		case FLAG_g:
+			if (kx->type != ky->type) {
+				retval = (kx->type < ky->type) ? -1 : 1;
+				break;
+			}
+			if (kx->type != 2)
+				break;
+			/* fall through */
 		case FLAG_n:
-			retval = atoi(x) - atoi(y);
+			retval = (kx->num > ky->num) ? 1 : ((kx->num < ky->num) ? -1 : 0);
 			break;
-		} /* switch */
+		case FLAG_M:
+			retval = kx->type - ky->type;
+			break;
+		}
+	}
+#else
+	switch (flags & 7) {
+	default:
+		bb_error_msg_and_die("unknown sort type");
+	/* Ascii sort */
+	case 0:
+#if ENABLE_LOCALE_SUPPORT
+		retval = strcoll(x->str, y->str);
+#else
+		retval = strcmp(x->str, y->str);
+#endif
+		break;
+	/* Integer version of -n for tiny systems */
+	case FLAG_n:
+		retval = atoi(x->str) - atoi(y->str);
+		break;
+	}
 #endif
-	} /* for */
-
 	/* Perform fallback sort if necessary */
-	if (!retval && !(option_mask32 & FLAG_s))
-		retval = strcmp(*(char **)xarg, *(char **)yarg);
+	if (!retval && !(mask & FLAG_s))
+		retval = strcmp(x->str, y->str);
 
 	if (flags & FLAG_r) return -retval;
 	return retval;
 }
 
+static int compare_keys(const void *xarg, const void *yarg)
+{
+	return compare_lines(*(struct sort_line **)xarg, *(struct sort_line **)yarg,
+			option_mask32);
+}
+
+/* Print line, unless -u and last has the same keys.
+ * Returns the line printed last */
+static const struct sort_line *put_line(FILE *fp,
+		const struct sort_line *line, const struct sort_line *last)
+{
+	/* coreutils 6.3 drop lines for which only key is the same */
+	/* -- disabling last-resort compare... */
+	if ((option_mask32 & FLAG_u) && last
+	 && compare_lines(last, line, option_mask32 | FLAG_s) == 0
+	) {
+		return last;
+	}
+	fwrite(line->str, 1, line->len, fp);
+	putc(G.delim, fp);
+	return line;
+}
+
+static void put_lines(FILE *fp, struct sort_line **lines, unsigned n)
+{
+	const struct sort_line *last = NULL;
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		last = put_line(fp, lines[i], last);
+}
+
+#if ENABLE_FEATURE_SORT_EXTERNAL
+/* With -S, lines are sorted in runs of at most SIZE (SIZE / (jobs + 1)
+ * if runs are sorted by forked children), which go to deleted
+ * temporary files. Runs are merged using a loser tree, at most
+ * MAX_MERGE at a time. Runs in G.run_fd[] are in input order and only
+ * neighbours are merged, for the sake of -s. */
+enum { MAX_MERGE = 16 };
+
+static void xfclose_tmp(FILE *fp)
+{
+	if (fflush(fp) != 0 || ferror(fp))
+		bb_perror_msg_and_die(bb_msg_write_error);
+	fclose(fp);
+}
+
+static void wait_run(void)
+{
+	int status;
+
+	if (safe_waitpid(-1, &status, 0) < 0 || status != 0)
+		xfunc_die(); /* child has said why */
+	G.running--;
+}
+
+struct run {
+	line_reader_t *lr;
+	struct sort_line *line; /* NULL at the end */
+};
+
+/* Does run a go before run b? (b can be the "minus infinity" n) */
+static int run_first(struct run *runs, unsigned a, unsigned b, unsigned n)
+{
+	int r;
+
+	if (a == n)
+		return 1;
+	if (b == n || !runs[a].line)
+		return 0;
+	if (!runs[b].line)
+		return 1;
+	r = compare_lines(runs[a].line, runs[b].line, option_mask32);
+	return r < 0 || (r == 0 && a < b);
+}
+
+/* Play s's matches on its way up the tree */
+static void play(struct run *runs, unsigned *tree, unsigned s, unsigned n)
+{
+	unsigned t;
+
+	for (t = (s + n) / 2; t; t /= 2) {
+		if (run_first(runs, tree[t], s, n)) {
+			unsigned tmp = tree[t];
+			tree[t] = s;
+			s = tmp;
+		}
+	}
+	tree[0] = s;
+}
+
+static void next_line(struct run *r)
+{
+	char *str = line_reader_get(r->lr, NULL);
+
+	if (!str) {
+		if (r->lr->error)
+			bb_perror_msg_and_die("read error");
+		free(r->line);
+		r->line = NULL;
+		return;
+	}
+	r->line = make_line(r->line, str, r->lr->len);
+}
+
+/* Merge n runs, closes their fds */
+static void merge(int *fd, unsigned n, FILE *out)
+{
+	struct run *runs = xzalloc(n * sizeof(runs[0]));
+	/* tree[0] is the winner, tree[1..n-1] who lost the matches */
+	unsigned *tree = xmalloc(n * sizeof(tree[0]));
+	struct sort_line *last = NULL;
+	unsigned i, s;
+
+	for (i = 0; i < n; i++) {
+		xlseek(fd[i], 0, SEEK_SET);
+		runs[i].lr = line_reader_new(fd[i]);
+		runs[i].lr->delim = G.delim;
+		next_line(&runs[i]);
+		tree[i] = n;
+	}
+	/* Play the runs in, against "minus infinity" */
+	for (i = n; i--;)
+		play(runs, tree, i, n);
+	for (;;) {
+		s = tree[0];
+		if (!runs[s].line)
+			break;
+		if (option_mask32 & FLAG_u) {
+			/* Keep a copy, the run reuses its line */
+			if (put_line(out, runs[s].line, last) != last)
+				last = make_line(last, runs[s].line->str, runs[s].line->len);
+		} else
+			put_line(out, runs[s].line, NULL);
+		next_line(&runs[s]);
+		play(runs, tree, s, n);
+	}
+	for (i = 0; i < n; i++) {
+		line_reader_free(runs[i].lr);
+		close(fd[i]);
+	}
+	free(last);
+	free(tree);
+	free(runs);
+}
+
+/* Merge the last n runs into one */
+static void merge_tail(unsigned n)
+{
+	unsigned first = G.nruns - n;
+	int fd;
+	FILE *fp;
+
+	while (G.running)
+		wait_run();
+	fd = xmkstemp_unlinked(G.tmpdir, "sort");
+	fp = xfdopen_dup_for_write(fd);
+	merge(G.run_fd + first, n, fp);
+	xfclose_tmp(fp);
+	G.run_fd[first] = fd;
+	G.run_level[first]++;
+	G.nruns = first + 1;
+}
+
+/* Sort lines to a new run, frees them */
+static void spill(struct sort_line **lines, unsigned n)
+{
+	int fd = xmkstemp_unlinked(G.tmpdir, "sort");
+	unsigned i;
+
+	G.run_fd = xrealloc_vector(G.run_fd, 4, G.nruns);
+	G.run_level = xrealloc_vector(G.run_level, 4, G.nruns);
+	G.run_fd[G.nruns] = fd;
+	G.run_level[G.nruns++] = 0;
+#if BB_MMU
+	if (G.jobs > 1) {
+		pid_t pid;
+
+		if (G.running == G.jobs)
+			wait_run();
+		fflush_all();
+		pid = fork();
+		if (pid < 0)
+			bb_perror_msg_and_die("vfork" + 1);
+		if (pid) {
+			G.running++;
+			goto free_lines;
+		}
+	}
+#endif
+	{
+		FILE *fp = xfdopen_dup_for_write(fd);
+		qsort(lines, n, sizeof(lines[0]), compare_keys);
+		put_lines(fp, lines, n);
+		xfclose_tmp(fp);
+	}
+#if BB_MMU
+	if (G.jobs > 1)
+		_exit(EXIT_SUCCESS);
+ free_lines:
+#endif
+	for (i = 0; i < n; i++)
+		free(lines[i]);
+	G.mem = 0;
+	/* Like carry in a base MAX_MERGE counter: MAX_MERGE runs of one
+	 * level make one of the next. Keeps the count of runs (and fds)
+	 * low, and each line is merged only log(runs) times */
+	while (G.nruns >= MAX_MERGE
+	 && G.run_level[G.nruns - MAX_MERGE] == G.run_level[G.nruns - 1]
+	) {
+		merge_tail(MAX_MERGE);
+	}
+}
+#endif
+
 #if ENABLE_FEATURE_SORT_BIG
 static unsigned str2u(char **str)
 {
@@ -278,12 +563,14 @@ static unsigned str2u(char **str)
 int sort_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int sort_main(int argc UNUSED_PARAM, char **argv)
 {
-	char *line, **lines;
-	char *str_ignored, *str_o, *str_t;
+	struct sort_line *line, **lines;
+	char *str_S, *str_T, *str_o, *str_t;
 	llist_t *lst_k = NULL;
 	int i, flag;
 	int linecount;
 	unsigned opts;
+	IF_FEATURE_SORT_BIG(struct sort_line *prev = NULL;)
+	IF_FEATURE_SORT_EXTERNAL(unsigned long long mem_limit = 0;)
 
 	xfunc_error_retval = 2;
 
@@ -291,7 +578,7 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 	/* -o and -t can be given at most once */
 	opt_complementary = "o--o:t--t:" /* -t, -o: at most one of each */
 			"k::"; /* -k takes list */
-	opts = getopt32(argv, OPT_STR, &str_ignored, &str_ignored, &str_o, &lst_k, &str_t);
+	opts = getopt32(argv, OPT_STR, &str_S, &str_T, &str_o, &lst_k, &str_t);
 	/* global b strips leading and trailing spaces */
 	if (opts & FLAG_b)
 		option_mask32 |= FLAG_bb;
@@ -354,6 +641,33 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 	}
 #endif
 
+#if ENABLE_FEATURE_SORT_BIG
+	/* if no key, perform alphabetic sort */
+	if (!key_list)
+		add_key()->range[0] = 1;
+	/* keys without options use global ones */
+	{
+		struct sort_key *key;
+		for (key = key_list; key; key = key->next_key)
+			if (!key->flags)
+				key->flags = option_mask32;
+	}
+#endif
+#if ENABLE_FEATURE_SORT_EXTERNAL
+	if (opts & FLAG_S) {
+		mem_limit = xatoull_memsize(str_S);
+# if BB_MMU
+		G.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+		if (G.jobs > 8)
+			G.jobs = 8;
+		if (G.jobs > 1)
+			mem_limit /= G.jobs + 1;
+# endif
+	}
+	G.tmpdir = (opts & FLAG_T) ? str_T : NULL;
+#endif
+	G.delim = (option_mask32 & FLAG_z) ? '\0' : '\n';
+
 	/* Open input files and read data */
 	argv += optind;
 	if (!*argv)
@@ -363,50 +677,60 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 	do {
 		/* coreutils 6.9 compat: abort on first open error,
 		 * do not continue to next file: */
-		FILE *fp = xfopen_stdin(*argv);
-		for (;;) {
-			line = GET_LINE(fp);
-			if (!line)
-				break;
+		int fd = STDIN_FILENO;
+		line_reader_t *lr;
+		char *str;
+
+		if (NOT_LONE_DASH(*argv))
+			fd = xopen(*argv, O_RDONLY);
+		lr = line_reader_new(fd);
+		lr->delim = G.delim;
+		while ((str = line_reader_get(lr, NULL)) != NULL) {
+			line = make_line(NULL, str, lr->len);
+#if ENABLE_FEATURE_SORT_BIG
+			/* handle -c */
+			if (option_mask32 & FLAG_c) {
+				int j = (option_mask32 & FLAG_u) ? -1 : 0;
+				if (prev && compare_lines(prev, line, option_mask32) > j) {
+					fprintf(stderr, "Check line %u\n", linecount);
+					return EXIT_FAILURE;
+				}
+				free(prev);
+				prev = line;
+				linecount++;
+				continue;
+			}
+#endif
 			lines = xrealloc_vector(lines, 6, linecount);
 			lines[linecount++] = line;
+#if ENABLE_FEATURE_SORT_EXTERNAL
+			if (mem_limit && G.mem >= mem_limit) {
+				spill(lines, linecount);
+				linecount = 0;
+			}
+#endif
 		}
-		fclose_if_not_stdin(fp);
+		line_reader_free(lr);
+		if (fd != STDIN_FILENO)
+			close(fd);
 	} while (*++argv);
 
 #if ENABLE_FEATURE_SORT_BIG
-	/* if no key, perform alphabetic sort */
-	if (!key_list)
-		add_key()->range[0] = 1;
-	/* handle -c */
-	if (option_mask32 & FLAG_c) {
-		int j = (option_mask32 & FLAG_u) ? -1 : 0;
-		for (i = 1; i < linecount; i++) {
-			if (compare_keys(&lines[i-1], &lines[i]) > j) {
-				fprintf(stderr, "Check line %u\n", i);
-				return EXIT_FAILURE;
-			}
-		}
+	if (option_mask32 & FLAG_c)
 		return EXIT_SUCCESS;
-	}
+#endif
+#if ENABLE_FEATURE_SORT_EXTERNAL
+	if (G.nruns) {
+		if (linecount)
+			spill(lines, linecount);
+		while (G.nruns > MAX_MERGE)
+			merge_tail(MIN(G.nruns - MAX_MERGE + 1, MAX_MERGE));
+		while (G.running)
+			wait_run();
+	} else
 #endif
 	/* Perform the actual sort */
 	qsort(lines, linecount, sizeof(lines[0]), compare_keys);
-	/* handle -u */
-	if (option_mask32 & FLAG_u) {
-		flag = 0;
-		/* coreutils 6.3 drop lines for which only key is the same */
-		/* -- disabling last-resort compare... */
-		option_mask32 |= FLAG_s;
-		for (i = 1; i < linecount; i++) {
-			if (compare_keys(&lines[flag], &lines[i]) == 0)
-				free(lines[i]);
-			else
-				lines[++flag] = lines[i];
-		}
-		if (linecount)
-			linecount = flag+1;
-	}
 
 	/* Print it */
 #if ENABLE_FEATURE_SORT_BIG
@@ -414,9 +738,12 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 	if (option_mask32 & FLAG_o)
 		xmove_fd(xopen3(str_o, O_WRONLY, 0666), STDOUT_FILENO);
 #endif
-	flag = (option_mask32 & FLAG_z) ? '\0' : '\n';
-	for (i = 0; i < linecount; i++)
-		printf("%s%c", lines[i], flag);
+#if ENABLE_FEATURE_SORT_EXTERNAL
+	if (G.nruns)
+		merge(G.run_fd, G.nruns, stdout);
+	else
+#endif
+	put_lines(stdout, lines, linecount);
 
 	fflush_stdout_and_exit(EXIT_SUCCESS);
 }
@@ -12,29 +12,339 @@
 
 #include "libbb.h"
 
+enum {
+	OPT_c = 0x1,
+	OPT_d = 0x2, /* print only dups */
+	OPT_u = 0x4, /* print only uniq */
+	OPT_f = 0x8,
+	OPT_s = 0x10,
+	OPT_w = 0x20,
+	OPT_H = (0x40) * ENABLE_FEATURE_UNIQ_HASH,
+	OPT_S = (0x80) * ENABLE_FEATURE_UNIQ_HASH,
+};
+
+static struct {
+	unsigned skip_fields, skip_chars, max_chars;
+	unsigned opt;
+#if ENABLE_FEATURE_UNIQ_HASH
+	unsigned long long mem_limit;
+#endif
+} U;
+
+static const char *key_of(const char *line)
+{
+	unsigned i;
+
+	for (i = U.skip_fields; i; i--) {
+		line = skip_whitespace(line);
+		line = skip_non_whitespace(line);
+	}
+	for (i = U.skip_chars; *line && i; i--) {
+		++line;
+	}
+	return line;
+}
+
+static void print_line(unsigned long long count, const char *line)
+{
+	if (!(U.opt & (OPT_d << (count > 1)))) { /* (if dups, opt & OPT_u) */
+		if (U.opt & OPT_c) {
+			/* %7lu matches GNU coreutils 6.9 */
+			printf("%7llu ", count);
+		}
+		printf("%s\n", line);
+	}
+}
+
+#if ENABLE_FEATURE_UNIQ_HASH
+/* uniq -H: lines go into a hash table with their counts in one pass,
+ * so duplicates need not be adjacent. Lines are printed in the order
+ * they were first seen: at once without -c/-d/-u, at EOF with them.
+ *
+ * With -S SIZE, no new lines go into the table once it uses SIZE
+ * memory. Lines which are not in it are written to one of 16 temporary
+ * files, picked by the next 4 bits of their hash, and each file is
+ * done the same way after EOF. Those lines were all seen after the
+ * table's lines, so the table comes first and the files' results are
+ * merged by line number.
+ */
+
+enum { NPART = 16, PART_BITS = 4 };
+
+struct urec { /* header of a line in a temporary file */
+	unsigned long long seq;   /* line number of its first copy */
+	unsigned long long count;
+	unsigned len;
+};
+
+struct uentry {
+	struct uentry *next;      /* in first-seen order */
+	uint32_t hash;
+	unsigned key_ofs, key_len;
+	struct urec r;
+	char line[1];
+};
+
+struct utable {
+	struct uentry **slot;
+	unsigned mask;
+	struct uentry *head, **tail;
+	char *chunk;              /* entries are carved from 64k chunks */
+	unsigned chunk_left;
+	llist_t *chunks;
+	unsigned long long used;
+	smallint full;
+	unsigned level;
+	int part_fd[NPART];
+	FILE *part[NPART];
+};
+
+static uint32_t key_hash(const char *key, unsigned len)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261u;
+
+	while (len--)
+		h = (h ^ (unsigned char)*key++) * 16777619;
+	return h;
+}
+
+static unsigned key_len(const char *key)
+{
+	size_t len = strlen(key);
+	return len > U.max_chars ? U.max_chars : len;
+}
+
+/* Writes go through a dup of fd, which is rewound and read afterwards */
+static FILE *reopen_tmp(FILE *fp, int fd)
+{
+	if (fflush(fp) != 0 || ferror(fp))
+		bb_perror_msg_and_die(bb_msg_write_error);
+	fclose(fp);
+	xlseek(fd, 0, SEEK_SET);
+	return xfdopen_for_read(fd);
+}
+
+static void write_rec(FILE *fp, const struct urec *r, const char *line)
+{
+	fwrite(r, sizeof(*r), 1, fp);
+	fwrite(line, r->len, 1, fp);
+}
+
+static char *read_rec(FILE *fp, struct urec *r, char **buf, unsigned *size)
+{
+	if (fread(r, sizeof(*r), 1, fp) != 1)
+		return NULL;
+	if (r->len >= *size) {
+		*size = r->len + 1;
+		*buf = xrealloc(*buf, *size);
+	}
+	if (r->len && fread(*buf, r->len, 1, fp) != 1)
+		bb_error_msg_and_die(bb_msg_read_error);
+	(*buf)[r->len] = '\0';
+	return *buf;
+}
+
+static void table_grow(struct utable *t)
+{
+	unsigned size = (t->mask + 1) * 2;
+	struct uentry **slot = xzalloc(size * sizeof(slot[0]));
+	struct uentry *e;
+
+	for (e = t->head; e; e = e->next) {
+		unsigned i = e->hash & (size - 1);
+		while (slot[i])
+			i = (i + 1) & (size - 1);
+		slot[i] = e;
+	}
+	free(t->slot);
+	t->slot = slot;
+	t->used += (size - (t->mask + 1)) * sizeof(slot[0]);
+	t->mask = size - 1;
+}
+
+static struct uentry *table_add(struct utable *t, unsigned i, uint32_t hash,
+		const char *line, const struct urec *r, const char *key, unsigned klen)
+{
+	struct uentry *e;
+	unsigned size = offsetof(struct uentry, line) + r->len + 1;
+
+	size = (size + sizeof(void*) - 1) & ~(unsigned)(sizeof(void*) - 1);
+	if (size > t->chunk_left) {
+		unsigned csize = size > 64 * 1024 ? size : 64 * 1024;
+		t->chunk = xmalloc(csize);
+		t->chunk_left = csize;
+		llist_add_to(&t->chunks, t->chunk);
+		t->used += csize;
+	}
+	e = (void*)t->chunk;
+	t->chunk += size;
+	t->chunk_left -= size;
+
+	e->next = NULL;
+	e->hash = hash;
+	e->key_ofs = key - line;
+	e->key_len = klen;
+	e->r = *r;
+	memcpy(e->line, line, r->len + 1);
+	*t->tail = e;
+	t->tail = &e->next;
+	t->slot[i] = e;
+	return e;
+}
+
+/* Dedup lines from lr (level 0) or records from in, output goes to
+ * stdout (level 0) or to out as records */
+static void uniq_hash(struct utable *t, line_reader_t *lr, FILE *in, FILE *out)
+{
+	struct urec r;
+	struct uentry *e;
+	char *line;
+	char *buf = NULL;
+	unsigned bufsize = 0;
+	unsigned cnt = 0;
+	int streaming = !out && !(U.opt & (OPT_c | OPT_d | OPT_u));
+	unsigned i;
+
+	t->mask = 255;
+	t->slot = xzalloc(256 * sizeof(t->slot[0]));
+	t->used = 256 * sizeof(t->slot[0]);
+	t->tail = &t->head;
+	r.seq = 0;
+	r.count = 1;
+
+	for (;;) {
+		const char *key;
+		unsigned klen;
+		uint32_t hash;
+
+		if (lr) {
+			line = line_reader_get(lr, NULL);
+			if (!line)
+				break;
+			r.seq++;
+			r.len = strlen(line);
+		} else {
+			line = read_rec(in, &r, &buf, &bufsize);
+			if (!line)
+				break;
+		}
+		key = key_of(line);
+		klen = key_len(key);
+		hash = key_hash(key, klen);
+
+		i = hash & t->mask;
+		while ((e = t->slot[i]) != NULL) {
+			if (e->hash == hash
+			 && e->key_len == klen
+			 && memcmp(e->line + e->key_ofs, key, klen) == 0
+			) {
+				break;
+			}
+			i = (i + 1) & t->mask;
+		}
+		if (e) {
+			e->r.count += r.count;
+			continue;
+		}
+		if (!t->full) {
+			table_add(t, i, hash, line, &r, key, klen);
+			if (streaming)
+				printf("%s\n", line);
+			if (++cnt > t->mask / 4 * 3)
+				table_grow(t);
+			/* Past the last hash bits, keep going in memory */
+			if (U.mem_limit && t->used > U.mem_limit
+			 && (t->level + 1) * PART_BITS <= 32
+			) {
+				t->full = 1;
+			}
+			continue;
+		}
+		/* Table is full, spill by the next bits of the hash */
+		i = (hash >> (32 - (t->level + 1) * PART_BITS)) & (NPART - 1);
+		if (!t->part[i]) {
+			t->part_fd[i] = xmkstemp_unlinked(NULL, "uniq");
+			t->part[i] = xfdopen_dup_for_write(t->part_fd[i]);
+		}
+		write_rec(t->part[i], &r, line);
+	}
+	free(buf);
+
+	for (e = t->head; e; e = e->next) {
+		if (out)
+			write_rec(out, &e->r, e->line);
+		else if (!streaming)
+			print_line(e->r.count, e->line);
+	}
+	free(t->slot);
+	llist_free(t->chunks, free);
+
+	if (t->full) {
+		FILE *res[NPART];
+		int res_fd[NPART];
+		struct urec head[NPART];
+		char *hline[NPART];
+		unsigned hsize[NPART];
+
+		for (i = 0; i < NPART; i++) {
+			struct utable sub;
+
+			res[i] = NULL;
+			if (!t->part[i])
+				continue;
+			memset(&sub, 0, sizeof(sub));
+			sub.level = t->level + 1;
+			in = reopen_tmp(t->part[i], t->part_fd[i]);
+			res_fd[i] = xmkstemp_unlinked(NULL, "uniq");
+			res[i] = xfdopen_dup_for_write(res_fd[i]);
+			uniq_hash(&sub, NULL, in, res[i]);
+			fclose(in);
+			res[i] = reopen_tmp(res[i], res_fd[i]);
+			hline[i] = NULL;
+			hsize[i] = 0;
+			if (!read_rec(res[i], &head[i], &hline[i], &hsize[i])) {
+				fclose(res[i]);
+				res[i] = NULL;
+			}
+		}
+		for (;;) {
+			unsigned m = NPART;
+
+			for (i = 0; i < NPART; i++)
+				if (res[i] && (m == NPART || head[i].seq < head[m].seq))
+					m = i;
+			if (m == NPART)
+				break;
+			if (out)
+				write_rec(out, &head[m], hline[m]);
+			else
+				print_line(head[m].count, hline[m]);
+			if (!read_rec(res[m], &head[m], &hline[m], &hsize[m])) {
+				fclose(res[m]);
+				res[m] = NULL;
+				free(hline[m]);
+			}
+		}
+	}
+}
+#endif
+
 int uniq_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int uniq_main(int argc UNUSED_PARAM, char **argv)
 {
 	const char *input_filename;
-	unsigned skip_fields, skip_chars, max_chars;
-	unsigned opt;
 	char *cur_line;
 	const char *cur_compare;
+	line_reader_t *lr;
+	IF_FEATURE_UNIQ_HASH(const char *str_S;)
 
-	enum {
-		OPT_c = 0x1,
-		OPT_d = 0x2, /* print only dups */
-		OPT_u = 0x4, /* print only uniq */
-		OPT_f = 0x8,
-		OPT_s = 0x10,
-		OPT_w = 0x20,
-	};
-
-	skip_fields = skip_chars = 0;
-	max_chars = INT_MAX;
+	U.max_chars = INT_MAX;
 
 	opt_complementary = "f+:s+:w+";
-	opt = getopt32(argv, "cduf:s:w:", &skip_fields, &skip_chars, &max_chars);
+	U.opt = getopt32(argv, "cduf:s:w:" IF_FEATURE_UNIQ_HASH("HS:"),
+			&U.skip_fields, &U.skip_chars, &U.max_chars
+			IF_FEATURE_UNIQ_HASH(, &str_S));
 	argv += optind;
 
 	input_filename = argv[0];
@@ -58,10 +368,23 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 		}
 	}
 
+	lr = line_reader_new(STDIN_FILENO);
+
+#if ENABLE_FEATURE_UNIQ_HASH
+	if (U.opt & OPT_H) {
+		struct utable t;
+
+		if (U.opt & OPT_S)
+			U.mem_limit = xatoull_memsize(str_S);
+		memset(&t, 0, sizeof(t));
+		uniq_hash(&t, lr, NULL, NULL);
+		goto done;
+	}
+#endif
+
 	cur_compare = cur_line = NULL; /* prime the pump */
 
 	do {
-		unsigned i;
 		unsigned long dups;
 		char *old_line;
 		const char *old_compare;
@@ -71,37 +394,33 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 		dups = 0;
 
 		/* gnu uniq ignores newlines */
-		while ((cur_line = xmalloc_fgetline(stdin)) != NULL) {
-			cur_compare = cur_line;
-			for (i = skip_fields; i; i--) {
-				cur_compare = skip_whitespace(cur_compare);
-				cur_compare = skip_non_whitespace(cur_compare);
-			}
-			for (i = skip_chars; *cur_compare && i; i--) {
-				++cur_compare;
-			}
+		while ((cur_line = line_reader_get(lr, NULL)) != NULL) {
+			cur_compare = key_of(cur_line);
 
-			if (!old_line || strncmp(old_compare, cur_compare, max_chars)) {
+			if (!old_line || strncmp(old_compare, cur_compare, U.max_chars)) {
 				break;
 			}
 
-			free(cur_line);
 			++dups;	 /* testing for overflow seems excessive */
 		}
+		if (cur_line) {
+			/* First line of the next group, keep it */
+			char *p = line_reader_xdup(lr);
+			cur_compare = p + (cur_compare - cur_line);
+			cur_line = p;
+		}
 
 		if (old_line) {
-			if (!(opt & (OPT_d << !!dups))) { /* (if dups, opt & OPT_u) */
-				if (opt & OPT_c) {
-					/* %7lu matches GNU coreutils 6.9 */
-					printf("%7lu ", dups + 1);
-				}
-				printf("%s\n", old_line);
-			}
+			print_line(dups + 1, old_line);
 			free(old_line);
 		}
 	} while (cur_line);
+#if ENABLE_FEATURE_UNIQ_HASH
+ done:
+#endif
 
-	die_if_ferror(stdin, input_filename);
+	if (lr->error)
+		bb_error_msg_and_die("%s: I/O error", input_filename);
 
 	fflush_stdout_and_exit(EXIT_SUCCESS);
 }
@@ -16,6 +16,7 @@
 
 #define	MAXVARFMT       240
 #define	MINNVBLOCK      64
+#define	MINRSBUF        (32 * 1024)	/* input is read in blocks of about that */
 
 /* variable flags */
 #define	VF_NUMBER       0x0001	/* 1 = primary type is number */
@@ -75,6 +76,7 @@ typedef struct hash_item_s {
 		struct func_s f;        /* functions hash */
 	} data;
 	struct hash_item_s *next;       /* next in chain */
+	unsigned hval;                  /* hashidx(name) */
 	char name[1];                   /* really it's longer */
 } hash_item;
 
@@ -385,7 +387,9 @@ static const char vValues[] ALIGN1 =
 
 /* hash size may grow to these values */
 #define FIRST_PRIME 61
-static const uint16_t PRIMES[] ALIGN2 = { 251, 1021, 4093, 16381, 65521 };
+static const uint32_t PRIMES[] = {
+	251, 1021, 4093, 16381, 65521, 262139, 1048573, 4194301
+};
 
 
 /* Globals. Split in two parts so that first one is addressed
@@ -413,6 +417,8 @@ struct globals {
 	smallint nextrec;
 	smallint nextfile;
 	smallint is_f0_split;
+	int f0_nf;     /* fields in $0, once we started to split it */
+	char *f0_rest; /* not yet split part, if we did only some fields */
 };
 struct globals2 {
 	uint32_t t_info; /* often used */
@@ -425,6 +431,7 @@ struct globals2 {
 
 	/* former statics from various functions */
 	char *split_f0__fstrings;
+	unsigned split_f0__fsize;
 
 	uint32_t next_token__save_tclass;
 	uint32_t next_token__save_info;
@@ -477,6 +484,8 @@ struct globals2 {
 #define nextrec      (G1.nextrec     )
 #define nextfile     (G1.nextfile    )
 #define is_f0_split  (G1.is_f0_split )
+#define f0_nf        (G1.f0_nf       )
+#define f0_rest      (G1.f0_rest     )
 #define t_info       (G.t_info      )
 #define t_tclass     (G.t_tclass    )
 #define t_string     (G.t_string    )
@@ -497,6 +506,7 @@ static void handle_special(var *);
 static node *parse_expr(uint32_t);
 static void chain_group(void);
 static var *evaluate(node *, var *);
+static var *operand(node *, var *);
 static rstream *next_input_file(void);
 static int fmt_num(char *, int, const char *, double, int);
 static int awk_exit(int) NORETURN;
@@ -550,20 +560,28 @@ static xhash *hash_init(void)
 	return newhash;
 }
 
-/* find item in hash, return ptr to data, NULL if not found */
-static void *hash_search(xhash *hash, const char *name)
+static hash_item *hash_search_h(xhash *hash, const char *name, unsigned hval)
 {
 	hash_item *hi;
 
-	hi = hash->items[hashidx(name) % hash->csize];
+	hi = hash->items[hval % hash->csize];
 	while (hi) {
-		if (strcmp(hi->name, name) == 0)
-			return &(hi->data);
+		/* chains are up to 10 long, don't strcmp them all */
+		if (hi->hval == hval && strcmp(hi->name, name) == 0)
+			return hi;
 		hi = hi->next;
 	}
 	return NULL;
 }
 
+/* find item in hash, return ptr to data, NULL if not found */
+static void *hash_search(xhash *hash, const char *name)
+{
+	hash_item *hi = hash_search_h(hash, name, hashidx(name));
+
+	return hi ? &(hi->data) : NULL;
+}
+
 /* grow hash if it becomes too big */
 static void hash_rebuild(xhash *hash)
 {
@@ -581,7 +599,7 @@ static void hash_rebuild(xhash *hash)
 		while (hi) {
 			thi = hi;
 			hi = thi->next;
-			idx = hashidx(thi->name) % newsize;
+			idx = thi->hval % newsize;
 			thi->next = newitems[idx];
 			newitems[idx] = thi;
 		}
@@ -596,10 +614,11 @@ static void hash_rebuild(xhash *hash)
 static void *hash_find(xhash *hash, const char *name)
 {
 	hash_item *hi;
-	unsigned idx;
+	unsigned hval, idx;
 	int l;
 
-	hi = hash_search(hash, name);
+	hval = hashidx(name);
+	hi = hash_search_h(hash, name, hval);
 	if (!hi) {
 		if (++hash->nel / hash->csize > 10)
 			hash_rebuild(hash);
@@ -607,8 +626,9 @@ static void *hash_find(xhash *hash, const char *name)
 		l = strlen(name) + 1;
 		hi = xzalloc(sizeof(*hi) + l);
 		strcpy(hi->name, name);
+		hi->hval = hval;
 
-		idx = hashidx(name) % hash->csize;
+		idx = hval % hash->csize;
 		hi->next = hash->items[idx];
 		hash->items[idx] = hi;
 		hash->glen += l;
@@ -624,11 +644,12 @@ static void *hash_find(xhash *hash, const char *name)
 static void hash_remove(xhash *hash, const char *name)
 {
 	hash_item *hi, **phi;
+	unsigned hval = hashidx(name);
 
-	phi = &(hash->items[hashidx(name) % hash->csize]);
+	phi = &(hash->items[hval % hash->csize]);
 	while (*phi) {
 		hi = *phi;
-		if (strcmp(hi->name, name) == 0) {
+		if (hi->hval == hval && strcmp(hi->name, name) == 0) {
 			hash->glen -= (strlen(name) + 1);
 			hash->nel--;
 			*phi = hi->next;
@@ -1519,8 +1540,8 @@ static void qrealloc(char **b, int n, int *size)
 	}
 }
 
-/* resize field storage space */
-static void fsrealloc(int size)
+/* make room for size fields */
+static void fsreserve(int size)
 {
 	int i;
 
@@ -1533,6 +1554,14 @@ static void fsrealloc(int size)
 			Fields[i].string = NULL;
 		}
 	}
+}
+
+/* resize field storage space */
+static void fsrealloc(int size)
+{
+	int i;
+
+	fsreserve(size);
 
 	if (size < nfields) {
 		for (i = size; i < nfields; i++) {
@@ -1620,34 +1649,127 @@ static int awk_split(const char *s, node *spl, char **slist)
 	return n;
 }
 
-static void split_f0(void)
-{
-/* static char *fstrings; */
+/* With blanks or one char for FS, fields are cut out of the copy of $0
+ * in place, as far as the highest field used so far: "print $1" on long
+ * lines doesn't split the rest. The copy is reused for the next record.
+ * Other FS go through awk_split() at once */
 #define fstrings (G.split_f0__fstrings)
+#define fsize    (G.split_f0__fsize)
 
-	int i, n;
-	char *s;
+static char *f0_separators(char *c)
+{
+	c[0] = c[1] = (char)fsplitter.n.info;
+	c[2] = c[3] = '\0';
+	if (*getvar_s(intvar[RS]) == '\0')
+		c[2] = '\n';
+	if (icase) {
+		c[0] = toupper(c[0]);
+		c[1] = tolower(c[1]);
+	}
+	return c;
+}
 
-	if (is_f0_split)
-		return;
+static void split_f0_more(int upto)
+{
+	char c[4];
+	char *s = f0_rest;
+
+	f0_separators(c);
+	if (upto > f0_nf)
+		upto = f0_nf;
+	while (nfields < upto) {
+		char *e;
+
+		if ((char)fsplitter.n.info == ' ') {
+			s = skip_whitespace(s);
+			e = skip_non_whitespace(s);
+		} else {
+			e = strpbrk(s, c);
+			if (!e)
+				e = s + strlen(s);
+		}
+		Fields[nfields].string = s;
+		Fields[nfields].type |= (VF_FSTR | VF_USER | VF_DIRTY);
+		nfields++;
+		s = e;
+		if (*e) {
+			*e = '\0';
+			s++;
+		}
+	}
+	f0_rest = s;
+	if (nfields == f0_nf) {
+		f0_rest = NULL;
+		is_f0_split = TRUE;
+	}
+}
+
+static void split_f0_start(void)
+{
+	const char *f0 = getvar_s(intvar[F0]);
+	unsigned len = strlen(f0);
+	int n = 0;
+	char c[4];
+	char *s;
 
-	is_f0_split = TRUE;
-	free(fstrings);
 	fsrealloc(0);
-	n = awk_split(getvar_s(intvar[F0]), &fsplitter.n, &fstrings);
-	fsrealloc(n);
-	s = fstrings;
-	for (i = 0; i < n; i++) {
-		Fields[i].string = nextword(&s);
-		Fields[i].type |= (VF_FSTR | VF_USER | VF_DIRTY);
+	if ((fsplitter.n.info & OPCLSMASK) == OC_REGEXP
+	 || (char)fsplitter.n.info == '\0'
+	) {
+		free(fstrings);
+		n = awk_split(f0, &fsplitter.n, &fstrings);
+		fsize = 0; /* awk_split's string, don't reuse */
+		fsrealloc(n);
+		s = fstrings;
+		for (n = 0; n < nfields; n++) {
+			Fields[n].string = nextword(&s);
+			Fields[n].type |= (VF_FSTR | VF_USER | VF_DIRTY);
+		}
+		is_f0_split = TRUE;
+	} else {
+		if (len >= fsize) {
+			free(fstrings);
+			fsize = len + 1 + 256;
+			fstrings = xmalloc(fsize);
+		}
+		s = memcpy(fstrings, f0, len + 1);
+		/* Count the fields: NF is known and the Fields[] we hand out
+		 * won't move while the rest is split */
+		if ((char)fsplitter.n.info == ' ') {
+			while (*(s = skip_whitespace(s)) != '\0') {
+				n++;
+				s = skip_non_whitespace(s);
+			}
+		} else if (*s) {
+			f0_separators(c);
+			n = 1;
+			while ((s = strpbrk(s, c)) != NULL) {
+				s++;
+				n++;
+			}
+		}
+		fsreserve(n);
+		f0_nf = n;
+		f0_rest = fstrings;
 	}
 
 	/* set NF manually to avoid side effects */
 	clrvar(intvar[NF]);
 	intvar[NF]->type = VF_NUMBER | VF_SPECIAL;
-	intvar[NF]->number = nfields;
-#undef fstrings
+	intvar[NF]->number = f0_nf = n;
+}
+
+static void split_f0(void)
+{
+	if (is_f0_split)
+		return;
+	if (!f0_rest)
+		split_f0_start();
+	if (f0_rest)
+		split_f0_more(INT_MAX);
 }
+#undef fstrings
+#undef fsize
 
 /* perform additional actions when some internal variables changed */
 static void handle_special(var *v)
@@ -1684,20 +1806,30 @@ static void handle_special(var *v)
 			b[len] = '\0';
 		setvar_p(intvar[F0], b);
 		is_f0_split = TRUE;
+		f0_rest = NULL;
 
 	} else if (v == intvar[F0]) {
 		is_f0_split = FALSE;
+		f0_rest = NULL;
 
 	} else if (v == intvar[FS]) {
+		/* New FS is for the next record: finish splitting this one */
+		if (f0_rest)
+			split_f0_more(INT_MAX);
 		mk_splitter(getvar_s(v), &fsplitter);
 
 	} else if (v == intvar[RS]) {
+		if (f0_rest) /* RS="" makes newline a separator too */
+			split_f0_more(INT_MAX);
 		mk_splitter(getvar_s(v), &rsplitter);
 
 	} else if (v == intvar[IGNORECASE]) {
+		if (f0_rest)
+			split_f0_more(INT_MAX);
 		icase = istrue(v);
 
 	} else {				/* $n */
+		split_f0(); /* NF must be right, and all fields there */
 		n = getvar_i(intvar[NF]);
 		setvar_i(intvar[NF], n > v-Fields ? n : v-Fields+1);
 		/* right here v is invalid. Just to note... */
@@ -1757,7 +1889,7 @@ static int hashwalk_next(var *v)
 static int ptest(node *pattern)
 {
 	/* ptest__v is "static": to save stack space? */
-	return istrue(evaluate(pattern, &G.ptest__v));
+	return istrue(operand(pattern, &G.ptest__v));
 }
 
 /* read next record from stream rsm into a variable v */
@@ -1780,7 +1912,7 @@ static int awk_getline(rstream *rsm, var *v)
 	c = (char) rsplitter.n.info;
 	rp = 0;
 
-	if (!m) qrealloc(&m, 256, &size);
+	if (!m) qrealloc(&m, MINRSBUF, &size);
 	do {
 		b = m + a;
 		so = eo = p;
@@ -1905,7 +2037,7 @@ static char *awk_printf(node *n)
 		if (c != '\0') f++;
 		c1 = *f;
 		*f = '\0';
-		arg = evaluate(nextarg(&n), v);
+		arg = operand(nextarg(&n), v);
 
 		j = i;
 		if (c == 'c' || !c) {
@@ -2060,7 +2192,7 @@ static NOINLINE var *exec_builtin(node *op, var *res)
 	av[2] = av[3] = NULL;
 	for (i = 0; i < 4 && op; i++) {
 		an[i] = nextarg(&op);
-		if (isr & 0x09000000) av[i] = evaluate(an[i], &tv[i]);
+		if (isr & 0x09000000) av[i] = operand(an[i], &tv[i]);
 		if (isr & 0x08000000) as[i] = getvar_s(av[i]);
 		isr >>= 1;
 	}
@@ -2226,6 +2358,43 @@ static NOINLINE var *exec_builtin(node *op, var *res)
  */
 #define XC(n) ((n) >> 8)
 
+/* $i */
+static var *getfield(int i)
+{
+	if (i == 0)
+		return intvar[F0];
+	if (!is_f0_split) {
+		if (!f0_rest)
+			split_f0_start();
+		if (f0_rest && i > nfields)
+			split_f0_more(i);
+	}
+	if (i > nfields)
+		fsrealloc(i);
+	return &Fields[i - 1];
+}
+
+/* A variable, a constant, or a field with one of those for index:
+ * most operands are these, and they need neither a recursive
+ * evaluate() nor its temporaries. Variable references are
+ * resolved to var pointers by the parser, so we just take it */
+static ALWAYS_INLINE int is_plain_var(node *op)
+{
+	return (op->info & OPCLSMASK) == OC_VAR && !op->r.n
+		&& op->l.v != intvar[NF]; /* reading NF splits $0 */
+}
+
+static var *operand(node *op, var *res)
+{
+	if (op) {
+		if (is_plain_var(op))
+			return op->l.v;
+		if ((op->info & OPCLSMASK) == OC_FIELD && is_plain_var(op->r.n))
+			return getfield((int)getvar_i(op->r.n->l.v));
+	}
+	return evaluate(op, res);
+}
+
 static var *evaluate(node *op, var *res)
 {
 /* This procedure is recursive so we should count every byte */
@@ -2265,8 +2434,8 @@ static var *evaluate(node *op, var *res)
 
 		/* execute inevitable things */
 		op1 = op->l.n;
-		if (opinfo & OF_RES1) X.v = L.v = evaluate(op1, v1);
-		if (opinfo & OF_RES2) R.v = evaluate(op->r.n, v1+1);
+		if (opinfo & OF_RES1) X.v = L.v = operand(op1, v1);
+		if (opinfo & OF_RES2) R.v = operand(op->r.n, v1+1);
 		if (opinfo & OF_STR1) L.s = getvar_s(L.v);
 		if (opinfo & OF_STR2) R.s = getvar_s(R.v);
 		if (opinfo & OF_NUM1) L.d = getvar_i(L.v);
@@ -2335,7 +2504,7 @@ static var *evaluate(node *op, var *res)
 					fputs(getvar_s(intvar[F0]), X.F);
 				} else {
 					while (op1) {
-						L.v = evaluate(nextarg(&op1), v1);
+						L.v = operand(nextarg(&op1), v1);
 						if (L.v->type & VF_NUMBER) {
 							fmt_num(g_buf, MAXVARFMT, getvar_s(intvar[OFMT]),
 									getvar_i(L.v), TRUE);
@@ -2451,7 +2620,7 @@ static var *evaluate(node *op, var *res)
 
 			X.v = R.v = nvalloc(op->r.f->nargs + 1);
 			while (op1) {
-				L.v = evaluate(nextarg(&op1), v1);
+				L.v = operand(nextarg(&op1), v1);
 				copyvar(R.v, L.v);
 				R.v->type |= VF_CHILD;
 				R.v->x.parent = L.v;
@@ -2633,15 +2802,7 @@ static var *evaluate(node *op, var *res)
 			break;
 
 		case XC( OC_FIELD ):
-			R.i = (int)getvar_i(R.v);
-			if (R.i == 0) {
-				res = intvar[F0];
-			} else {
-				split_f0();
-				if (R.i > nfields)
-					fsrealloc(R.i);
-				res = &Fields[R.i - 1];
-			}
+			res = getfield((int)getvar_i(R.v));
 			break;
 
 		/* concatenation (" ") and index joining (",") */
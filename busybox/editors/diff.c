@@ -14,66 +14,34 @@
  */
 
 /*
- * The following code uses an algorithm due to Harold Stone,
- * which finds a pair of longest identical subsequences in
- * the two files.
+ * Lines are compared as small integers: each line is hashed once
+ * (honouring -b, -i and -w) and interned in a hash table, so lines
+ * that compare equal get the same equivalence class number and lines
+ * that don't never do. Both files are mmapped, or read into memory if
+ * they can't be.
  *
- * The major goal is to generate the match vector J.
- * J[i] is the index of the line in file1 corresponding
- * to line i in file0. J[i] = 0 if there is no
- * such line in file1.
+ * The line matching is Eugene W. Myers' O(ND) algorithm, "An O(ND)
+ * Difference Algorithm and Its Variations", Algorithmica 1(2), 1986,
+ * in its linear space form: the "middle snake" of an optimal edit
+ * path is found by running the greedy algorithm from both ends at
+ * once, and both halves are then done the same way. Memory is a few
+ * words per line. Unless -d is given, a search that gets expensive
+ * (more than sqrt(N) edits, but at least 256) is cut short at the
+ * furthest point reached from either end, which can make the diff a
+ * little bigger but keeps the time down on large, very different
+ * files.
  *
- * Lines are hashed so as to work in core. All potential
- * matches are located by sorting the lines of each file
- * on the hash (called "value"). In particular, this
- * collects the equivalence classes in file1 together.
- * Subroutine equiv replaces the value of each line in
- * file0 by the index of the first element of its
- * matching equivalence in (the reordered) file1.
- * To save space equiv squeezes file1 into a single
- * array member in which the equivalence classes
- * are simply concatenated, except that their first
- * members are flagged by changing sign.
+ * With -H, histogram diff (as in JGit and git --histogram) is used
+ * instead: the line of the old region which occurs there least often
+ * and also occurs in the new region anchors a run of common lines,
+ * and the regions before and after the run are done the same way.
+ * Regions without such a line (all their lines are too common) go to
+ * Myers. It tends to line up unique lines like function headers
+ * rather than braces and blank lines, and is fast on long files.
  *
- * Next the indices that point into member are unsorted into
- * array class according to the original order of file0.
- *
- * The cleverness lies in routine stone. This marches
- * through the lines of file0, developing a vector klist
- * of "k-candidates". At step i a k-candidate is a matched
- * pair of lines x,y (x in file0, y in file1) such that
- * there is a common subsequence of length k
- * between the first i lines of file0 and the first y
- * lines of file1, but there is no such subsequence for
- * any smaller y. x is the earliest possible mate to y
- * that occurs in such a subsequence.
- *
- * Whenever any of the members of the equivalence class of
- * lines in file1 matable to a line in file0 has serial number
- * less than the y of some k-candidate, that k-candidate
- * with the smallest such y is replaced. The new
- * k-candidate is chained (via pred) to the current
- * k-1 candidate so that the actual subsequence can
- * be recovered. When a member has serial number greater
- * that the y of all k-candidates, the klist is extended.
- * At the end, the longest subsequence is pulled out
- * and placed in the array J by unravel
- *
- * With J in hand, the matches there recorded are
- * checked against reality to assure that no spurious
- * matches have crept in due to hashing. If they have,
- * they are broken, and "jackpot" is recorded--a harmless
- * matter except that a true match for a spuriously
- * mated line may now be unnecessarily reported as a change.
- *
- * Much of the complexity of the program comes simply
- * from trying to minimize core utilization and
- * maximize the range of doable problems by dynamically
- * allocating what is needed and reusing what is not.
- * The core requirements for problems larger than somewhat
- * are (in words) 2*length(file0) + length(file1) +
- * 3*(number of k-candidates installed), typically about
- * 6n words for files of length n.
+ * Either way the result is the match vector J: J[i] is the index of
+ * the line in file1 corresponding to line i in file0, or 0 if there
+ * is no such line.
  */
 
 #include "libbb.h"
@@ -109,14 +77,16 @@ enum {                  /* Commandline flags */
 	FLAG_p,         /* not implemented */
 	FLAG_B,
 	FLAG_E,         /* not implemented */
+	FLAG_H,         /* histogram diff */
 };
 #define FLAG(x) (1 << FLAG_##x)
 
-/* We cache file position to avoid excessive seeking */
-typedef struct FILE_and_pos_t {
-	FILE *ft_fp;
-	off_t ft_pos;
-} FILE_and_pos_t;
+/* A file being compared, mapped or read into memory */
+typedef struct file_buf_t {
+	char *buf;
+	size_t size;
+	smallint mapped;
+} file_buf_t;
 
 struct globals {
 	smallint exit_status;
@@ -134,52 +104,42 @@ struct globals {
 	opt_U_context = 3; \
 } while (0)
 
-typedef int token_t;
-
 enum {
-	/* Public */
-	TOK_EMPTY = 1 << 9,  /* Line fully processed, you can proceed to the next */
-	TOK_EOF   = 1 << 10, /* File ended */
-	/* Private (Only to be used by read_token() */
-	TOK_EOL   = 1 << 11, /* we saw EOL (sticky) */
-	TOK_SPACE = 1 << 12, /* used -b code, means we are skipping spaces */
-	SHIFT_EOF = (sizeof(token_t)*8 - 8) - 1,
-	CHAR_MASK = 0x1ff,   /* 8th bit is used to distinguish EOF from 0xff */
+	EOF_CHAR  = 0x1ff,   /* end of a last line without '\n', != any real char */
+	MAX_CHAIN = 64,      /* histogram diff ignores lines more common than this */
 };
 
-/* Restores full EOF from one 8th bit: */
-//#define TOK2CHAR(t) (((t) << SHIFT_EOF) >> SHIFT_EOF)
-/* We don't really need the above, we only need to have EOF != any_real_char: */
-#define TOK2CHAR(t) ((t) & CHAR_MASK)
+/* Chars of a line as -b, -i and -w want them compared */
+struct line_reader {
+	const unsigned char *p, *end;
+	smallint eof_done;   /* line has '\n' or EOF_CHAR was returned */
+	smallint in_space;   /* -b: skipping the rest of a run of whitespace */
+};
 
-static void seek_ft(FILE_and_pos_t *ft, off_t pos)
+static void line_reader_init(struct line_reader *r, const char *p, unsigned len)
 {
-	if (ft->ft_pos != pos) {
-		ft->ft_pos = pos;
-		fseeko(ft->ft_fp, pos, SEEK_SET);
-	}
+	r->p = (const unsigned char *)p;
+	r->end = r->p + len;
+	r->eof_done = (len && p[len - 1] == '\n');
+	r->in_space = 0;
 }
 
-/* Reads tokens from given fp, handling -b and -w flags
- * The user must reset tok every line start
- */
-static int read_token(FILE_and_pos_t *ft, token_t tok)
+/* Returns -1 at the end of the line */
+static int next_char(struct line_reader *r)
 {
-	tok |= TOK_EMPTY;
-	while (!(tok & TOK_EOL)) {
+	while (1) {
 		bool is_space;
 		int t;
 
-		t = fgetc(ft->ft_fp);
-		if (t != EOF)
-			ft->ft_pos++;
-		is_space = (t == EOF || isspace(t));
-
-		/* If t == EOF (-1), set both TOK_EOF and TOK_EOL */
-		tok |= (t & (TOK_EOF + TOK_EOL));
-		/* Only EOL? */
-		if (t == '\n')
-			tok |= TOK_EOL;
+		if (r->p < r->end)
+			t = *r->p++;
+		else if (!r->eof_done) {
+			/* EOF counts as whitespace, so -b and -w ignore a missing '\n' */
+			r->eof_done = 1;
+			t = EOF_CHAR;
+		} else
+			return -1;
+		is_space = (t == EOF_CHAR || isspace(t));
 
 		if (option_mask32 & FLAG(i)) /* Handcoded tolower() */
 			t = (t >= 'A' && t <= 'Z') ? t - ('A' - 'a') : t;
@@ -187,64 +147,78 @@ static int read_token(FILE_and_pos_t *ft, token_t tok)
 		if ((option_mask32 & FLAG(w)) && is_space)
 			continue;
 
-		/* Trim char value to low 9 bits */
-		t &= CHAR_MASK;
-
 		if (option_mask32 & FLAG(b)) {
 			/* Was prev char whitespace? */
-			if (tok & TOK_SPACE) { /* yes */
+			if (r->in_space) { /* yes */
 				if (is_space) /* this one too, ignore it */
 					continue;
-				tok &= ~TOK_SPACE;
+				r->in_space = 0;
 			} else if (is_space) {
-				/* 1st whitespace char.
-				 * Set TOK_SPACE and replace char by ' ' */
-				t = TOK_SPACE + ' ';
+				/* 1st whitespace char, replace it by ' ' */
+				r->in_space = 1;
+				t = ' ';
 			}
 		}
-		/* Clear EMPTY */
-		tok &= ~(TOK_EMPTY + CHAR_MASK);
-		/* Assign char value (low 9 bits) and maybe set TOK_SPACE */
-		tok |= t;
-		break;
+		return t;
 	}
-#if 0
-	bb_error_msg("fp:%p tok:%x '%c'%s%s%s%s", fp, tok, tok & 0xff
-		, tok & TOK_EOF ? " EOF" : ""
-		, tok & TOK_EOL ? " EOL" : ""
-		, tok & TOK_EMPTY ? " EMPTY" : ""
-		, tok & TOK_SPACE ? " SPACE" : ""
-	);
-#endif
-	return tok;
 }
 
-struct cand {
-	int x;
-	int y;
-	int pred;
-};
-
-static int search(const int *c, int k, int y, const struct cand *list)
+static unsigned line_hash(const char *p, unsigned len)
 {
-	if (list[c[k]].y < y)	/* quick look for typical case */
-		return k + 1;
-
-	for (int i = 0, j = k + 1;;) {
-		const int l = (i + j) >> 1;
-		if (l > i) {
-			const int t = list[c[l]].y;
-			if (t > y)
-				j = l;
-			else if (t < y)
-				i = l;
-			else
-				return l;
-		} else
-			return l + 1;
+	unsigned hash = 0;
+
+	/* Hash algorithm taken from Robert Sedgewick, Algorithms in C, 3d ed., p 578. */
+	if (!(option_mask32 & (FLAG(b) | FLAG(i) | FLAG(w)))) {
+		while (len--)
+			hash = hash * 127 + (unsigned char)*p++;
+	} else {
+		struct line_reader r;
+		int t;
+
+		line_reader_init(&r, p, len);
+		while ((t = next_char(&r)) >= 0)
+			hash = hash * 127 + t;
 	}
+	return hash;
 }
 
+static bool line_equal(const char *p0, unsigned len0, const char *p1, unsigned len1)
+{
+	struct line_reader r0, r1;
+	int t;
+
+	if (!(option_mask32 & (FLAG(b) | FLAG(i) | FLAG(w))))
+		return len0 == len1 && memcmp(p0, p1, len0) == 0;
+	line_reader_init(&r0, p0, len0);
+	line_reader_init(&r1, p1, len1);
+	do {
+		t = next_char(&r0);
+		if (t != next_char(&r1))
+			return false;
+	} while (t >= 0);
+	return true;
+}
+
+struct line_class {
+	const char *p;
+	unsigned len;
+	unsigned hash;
+	int cls;
+};
+
+struct dctx {
+	int *a, *b;          /* equivalence classes of lines, from 1 */
+	char *chg[2];        /* chg[0][i]: line i of file0 is not matched */
+	int *fd, *bd;        /* Myers: furthest x reached on diagonal x - y */
+	unsigned mxcost;
+	int *head, *next;    /* histogram: occurrences of a class in file0 */
+	unsigned *cnt;       /* histogram: number of occurrences */
+};
+
+struct split {
+	int x, y;
+};
+
 static unsigned isqrt(unsigned n)
 {
 	unsigned x = 1;
@@ -256,139 +230,247 @@ static unsigned isqrt(unsigned n)
 	}
 }
 
-static void stone(const int *a, int n, const int *b, int *J, int pref)
+static void mark_changed(struct dctx *c, int xoff, int xlim, int yoff, int ylim)
 {
-	const unsigned isq = isqrt(n);
-	const unsigned bound =
-		(option_mask32 & FLAG(d)) ? UINT_MAX : MAX(256, isq);
-	int clen = 1;
-	int clistlen = 100;
-	int k = 0;
-	struct cand *clist = xzalloc(clistlen * sizeof(clist[0]));
-	int *klist = xzalloc((n + 2) * sizeof(klist[0]));
-	/*clist[0] = (struct cand){0}; - xzalloc did it */
-	/*klist[0] = 0; */
-
-	for (struct cand cand = {1}; cand.x <= n; cand.x++) {
-		int j = a[cand.x], oldl = 0;
-		unsigned numtries = 0;
-		if (j == 0)
-			continue;
-		cand.y = -b[j];
-		cand.pred = klist[0];
-		do {
-			int l, tc;
-			if (cand.y <= clist[cand.pred].y)
-				continue;
-			l = search(klist, k, cand.y, clist);
-			if (l != oldl + 1)
-				cand.pred = klist[l - 1];
-			if (l <= k && clist[klist[l]].y <= cand.y)
-				continue;
-			if (clen == clistlen) {
-				clistlen = clistlen * 11 / 10;
-				clist = xrealloc(clist, clistlen * sizeof(clist[0]));
-			}
-			clist[clen] = cand;
-			tc = klist[l];
-			klist[l] = clen++;
-			if (l <= k) {
-				cand.pred = tc;
-				oldl = l;
-				numtries++;
-			} else {
-				k++;
-				break;
-			}
-		} while ((cand.y = b[++j]) > 0 && numtries < bound);
-	}
-	/* Unravel */
-	for (struct cand *q = clist + klist[k]; q->y; q = clist + q->pred)
-		J[q->x + pref] = q->y + pref;
-	free(klist);
-	free(clist);
+	memset(c->chg[0] + xoff, 1, xlim - xoff);
+	memset(c->chg[1] + yoff, 1, ylim - yoff);
 }
 
-struct line {
-	/* 'serial' is not used in the begining, so we reuse it
-	 * to store line offsets, thus reducing memory pressure
-	 */
-	union {
-		unsigned serial;
-		off_t offset;
-	};
-	unsigned value;
-};
-
-static void equiv(struct line *a, int n, struct line *b, int m, int *c)
+/* Finds the middle of an optimal edit path through a[xoff..xlim)
+ * and b[yoff..ylim), which must not start or end with a common line */
+static void find_split(struct dctx *c, int xoff, int xlim, int yoff, int ylim,
+		struct split *s)
 {
-	int i = 1, j = 1;
+	const int *a = c->a, *b = c->b;
+	int *fd = c->fd, *bd = c->bd;
+	const int dmin = xoff - ylim, dmax = xlim - yoff;
+	const int fmid = xoff - yoff, bmid = xlim - ylim;
+	const bool odd = (fmid - bmid) & 1;
+	int fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+	int fbest, fbest1, bbest, bbest1;
+
+	fd[fmid] = xoff;
+	bd[bmid] = xlim;
+	for (unsigned ec = 1;; ec++) {
+		int d, x, y;
+
+		/* One more edit forward. Diagonals outside of the region
+		 * get sentinels, and the range keeps its parity */
+		if (fmin > dmin)
+			fd[--fmin - 1] = -1;
+		else
+			++fmin;
+		if (fmax < dmax)
+			fd[++fmax + 1] = -1;
+		else
+			--fmax;
+		for (d = fmax; d >= fmin; d -= 2) {
+			x = (fd[d - 1] >= fd[d + 1]) ? fd[d - 1] + 1 : fd[d + 1];
+			y = x - d;
+			while (x < xlim && y < ylim && a[x] == b[y])
+				x++, y++;
+			fd[d] = x;
+			if (odd && bmin <= d && d <= bmax && bd[d] <= x) {
+				s->x = x;
+				s->y = y;
+				return;
+			}
+		}
 
-	while (i <= n && j <= m) {
-		if (a[i].value < b[j].value)
-			a[i++].value = 0;
-		else if (a[i].value == b[j].value)
-			a[i++].value = j;
+		/* And backward */
+		if (bmin > dmin)
+			bd[--bmin - 1] = INT_MAX;
 		else
-			j++;
-	}
-	while (i <= n)
-		a[i++].value = 0;
-	b[m + 1].value = 0;
-	j = 0;
-	while (++j <= m) {
-		c[j] = -b[j].serial;
-		while (b[j + 1].value == b[j].value) {
-			j++;
-			c[j] = b[j].serial;
+			++bmin;
+		if (bmax < dmax)
+			bd[++bmax + 1] = INT_MAX;
+		else
+			--bmax;
+		for (d = bmax; d >= bmin; d -= 2) {
+			x = (bd[d - 1] < bd[d + 1]) ? bd[d - 1] : bd[d + 1] - 1;
+			y = x - d;
+			while (x > xoff && y > yoff && a[x - 1] == b[y - 1])
+				x--, y--;
+			bd[d] = x;
+			if (!odd && fmin <= d && d <= fmax && x <= fd[d]) {
+				s->x = x;
+				s->y = y;
+				return;
+			}
+		}
+
+		if ((option_mask32 & FLAG(d)) || ec < c->mxcost)
+			continue;
+
+		/* Too expensive: split where one of the searches got
+		 * furthest, measured by x + y */
+		fbest = fbest1 = -1;
+		for (d = fmax; d >= fmin; d -= 2) {
+			x = MIN(fd[d], xlim);
+			y = x - d;
+			if (y > ylim) {
+				x = ylim + d;
+				y = ylim;
+			}
+			if (fbest < x + y) {
+				fbest = x + y;
+				fbest1 = x;
+			}
 		}
+		bbest = INT_MAX;
+		bbest1 = -1;
+		for (d = bmax; d >= bmin; d -= 2) {
+			x = MAX(xoff, bd[d]);
+			y = x - d;
+			if (y < yoff) {
+				x = yoff + d;
+				y = yoff;
+			}
+			if (bbest > x + y) {
+				bbest = x + y;
+				bbest1 = x;
+			}
+		}
+		if ((xlim + ylim) - bbest < fbest - (xoff + yoff)) {
+			s->x = fbest1;
+			s->y = fbest - fbest1;
+		} else {
+			s->x = bbest1;
+			s->y = bbest - bbest1;
+		}
+		return;
 	}
-	c[j] = -1;
 }
 
-static void unsort(const struct line *f, int l, int *b)
+static void myers(struct dctx *c, int xoff, int xlim, int yoff, int ylim)
 {
-	int *a = xmalloc((l + 1) * sizeof(a[0]));
-	for (int i = 1; i <= l; i++)
-		a[f[i].serial] = f[i].value;
-	for (int i = 1; i <= l; i++)
-		b[i] = a[i];
-	free(a);
+	while (1) {
+		struct split s;
+
+		/* Common lines at both ends are matched */
+		while (xoff < xlim && yoff < ylim && c->a[xoff] == c->b[yoff])
+			xoff++, yoff++;
+		while (xoff < xlim && yoff < ylim && c->a[xlim - 1] == c->b[ylim - 1])
+			xlim--, ylim--;
+		if (xoff == xlim || yoff == ylim) {
+			mark_changed(c, xoff, xlim, yoff, ylim);
+			return;
+		}
+		find_split(c, xoff, xlim, yoff, ylim, &s);
+		myers(c, xoff, s.x, yoff, s.y);
+		xoff = s.x;
+		yoff = s.y;
+	}
 }
 
-static int line_compar(const void *a, const void *b)
+static void histogram(struct dctx *c, int xoff, int xlim, int yoff, int ylim)
 {
-#define l0 ((const struct line*)a)
-#define l1 ((const struct line*)b)
-	int r = l0->value - l1->value;
-	if (r)
-		return r;
-	return l0->serial - l1->serial;
-#undef l0
-#undef l1
+	const int *a = c->a, *b = c->b;
+
+	while (1) {
+		int as = 0, ae = 0, bs = 0, be = 0;
+		int best_len = 0;
+		unsigned best_cnt = MAX_CHAIN;
+		bool common = false;
+		int i, j;
+
+		while (xoff < xlim && yoff < ylim && a[xoff] == b[yoff])
+			xoff++, yoff++;
+		while (xoff < xlim && yoff < ylim && a[xlim - 1] == b[ylim - 1])
+			xlim--, ylim--;
+		if (xoff == xlim || yoff == ylim) {
+			mark_changed(c, xoff, xlim, yoff, ylim);
+			return;
+		}
+
+		for (i = xlim - 1; i >= xoff; i--) {
+			c->next[i] = c->head[a[i]];
+			c->head[a[i]] = i;
+			c->cnt[a[i]]++;
+		}
+		/* Find the longest run of common lines through the rarest line */
+		for (j = yoff; j < ylim;) {
+			unsigned cj = c->cnt[b[j]];
+			int jnext = j + 1;
+
+			common |= (cj != 0);
+			if (cj && cj <= best_cnt) {
+				for (i = c->head[b[j]]; i; i = c->next[i]) {
+					int x0 = i, x1 = i + 1, y0 = j, y1 = j + 1;
+					unsigned rc = cj;
+
+					while (x0 > xoff && y0 > yoff && a[x0 - 1] == b[y0 - 1]) {
+						x0--, y0--;
+						rc = MIN(rc, c->cnt[a[x0]]);
+					}
+					while (x1 < xlim && y1 < ylim && a[x1] == b[y1]) {
+						rc = MIN(rc, c->cnt[a[x1]]);
+						x1++, y1++;
+					}
+					/* Lines up to y1 can't start a better run */
+					if (jnext < y1)
+						jnext = y1;
+					if (best_len < x1 - x0 || rc < best_cnt) {
+						as = x0;
+						ae = x1;
+						bs = y0;
+						be = y1;
+						best_len = x1 - x0;
+						best_cnt = rc;
+					}
+				}
+			}
+			j = jnext;
+		}
+		for (i = xoff; i < xlim; i++) {
+			c->head[a[i]] = 0;
+			c->cnt[a[i]] = 0;
+		}
+
+		if (!common) {
+			mark_changed(c, xoff, xlim, yoff, ylim);
+			return;
+		}
+		if (!best_len) {
+			myers(c, xoff, xlim, yoff, ylim);
+			return;
+		}
+		/* Recurse into the smaller side, this keeps the stack short */
+		if ((as - xoff) + (bs - yoff) < (xlim - ae) + (ylim - be)) {
+			histogram(c, xoff, as, yoff, bs);
+			xoff = ae;
+			yoff = be;
+		} else {
+			histogram(c, ae, xlim, be, ylim);
+			xlim = as;
+			ylim = bs;
+		}
+	}
 }
 
-static void fetch(FILE_and_pos_t *ft, const off_t *ix, int a, int b, int ch)
+static void fetch(const file_buf_t *ft, const off_t *ix, int a, int b, int ch)
 {
 	for (int i = a; i <= b; i++) {
-		seek_ft(ft, ix[i - 1]);
+		const char *p = ft->buf + ix[i - 1];
+		size_t len = MIN(ix[i], (off_t)ft->size) - ix[i - 1];
+
 		putchar(ch);
 		if (option_mask32 & FLAG(T))
 			putchar('\t');
-		for (int j = 0, col = 0; j < ix[i] - ix[i - 1]; j++) {
-			int c = fgetc(ft->ft_fp);
-			if (c == EOF) {
-				printf("\n\\ No newline at end of file\n");
-				return;
-			}
-			ft->ft_pos++;
-			if (c == '\t' && (option_mask32 & FLAG(t)))
+		if (!(option_mask32 & FLAG(t)))
+			fwrite(p, 1, len, stdout);
+		else for (int j = 0, col = 0; j < len; j++) {
+			if (p[j] == '\t')
 				do putchar(' '); while (++col & 7);
 			else {
-				putchar(c);
+				putchar(p[j]);
 				col++;
 			}
 		}
+		if (ix[i] > (off_t)ft->size) {
+			printf("\n\\ No newline at end of file\n");
+			return;
+		}
 	}
 }
 
@@ -398,164 +480,123 @@ static void fetch(FILE_and_pos_t *ft, const off_t *ix, int a, int b, int ch)
  * being used instead to denote no corresponding line.
  * This vector is dynamically allocated and must be freed by the caller.
  *
- * * fp is an input parameter, where fp[0] and fp[1] are the open
+ * * ft is an input parameter, where ft[0] and ft[1] are the
  *   old file and new file respectively.
  * * nlen is an output variable, where nlen[0] and nlen[1]
  *   gets the number of lines in the old and new file respectively.
  * * ix is an output variable, where ix[0] and ix[1] gets
  *   assigned dynamically allocated vectors of the offsets of the lines
  *   of the old and new file respectively. These must be freed by the caller.
+ *   A last line without '\n' ends one past the end of the file.
  */
-static NOINLINE int *create_J(FILE_and_pos_t ft[2], int nlen[2], off_t *ix[2])
+static NOINLINE int *create_J(const file_buf_t ft[2], int nlen[2], off_t *ix[2])
 {
-	int *J, slen[2], *class, *member;
-	struct line *nfile[2], *sfile[2];
-	int pref = 0, suff = 0;
-
-	/* Lines of both files are hashed, and in the process
-	 * their offsets are stored in the array ix[fileno]
-	 * where fileno == 0 points to the old file, and
-	 * fileno == 1 points to the new one.
-	 */
+	struct dctx c;
+	struct line_class *tab;
+	unsigned mask;
+	int *J, *cls[2], nclass = 0;
+
+	/* Find the lines */
 	for (int i = 0; i < 2; i++) {
-		unsigned hash;
-		token_t tok;
-		size_t sz = 100;
-		nfile[i] = xmalloc((sz + 3) * sizeof(nfile[i][0]));
-		/* ft gets here without the correct position, cant use seek_ft */
-		fseeko(ft[i].ft_fp, 0, SEEK_SET);
-
-		nlen[i] = 0;
-		/* We could zalloc nfile, but then zalloc starts showing in gprof at ~1% */
-		nfile[i][0].offset = 0;
-		goto start; /* saves code */
-		while (1) {
-			tok = read_token(&ft[i], tok);
-			if (!(tok & TOK_EMPTY)) {
-				/* Hash algorithm taken from Robert Sedgewick, Algorithms in C, 3d ed., p 578. */
-				/*hash = hash * 128 - hash + TOK2CHAR(tok);
-				 * gcc insists on optimizing above to "hash * 127 + ...", thus... */
-				unsigned o = hash - TOK2CHAR(tok);
-				hash = hash * 128 - o; /* we want SPEED here */
-				continue;
-			}
-			if (nlen[i]++ == sz) {
+		const char *buf = ft[i].buf;
+		size_t pos = 0;
+		int sz = 100, n = 0;
+
+		ix[i] = xmalloc((sz + 2) * sizeof(ix[i][0]));
+		ix[i][0] = 0;
+		while (pos < ft[i].size) {
+			const char *nl = memchr(buf + pos, '\n', ft[i].size - pos);
+			if (++n == sz) {
 				sz = sz * 3 / 2;
-				nfile[i] = xrealloc(nfile[i], (sz + 3) * sizeof(nfile[i][0]));
-			}
-			/* line_compar needs hashes fit into positive int */
-			nfile[i][nlen[i]].value = hash & INT_MAX;
-			/* like ftello(ft[i].ft_fp) but faster (avoids lseek syscall) */
-			nfile[i][nlen[i]].offset = ft[i].ft_pos;
-			if (tok & TOK_EOF) {
-				/* EOF counts as a token, so we have to adjust it here */
-				nfile[i][nlen[i]].offset++;
-				break;
+				ix[i] = xrealloc(ix[i], (sz + 2) * sizeof(ix[i][0]));
 			}
-start:
-			hash = tok = 0;
+			/* EOF counts as the last line's end, to make fetch()'s job easier */
+			pos = nl ? nl + 1 - buf : ft[i].size + 1;
+			ix[i][n] = pos;
 		}
-		/* Exclude lone EOF line from the end of the file, to make fetch()'s job easier */
-		if (nfile[i][nlen[i]].offset - nfile[i][nlen[i] - 1].offset == 1)
-			nlen[i]--;
-		/* Now we copy the line offsets into ix */
-		ix[i] = xmalloc((nlen[i] + 2) * sizeof(ix[i][0]));
-		for (int j = 0; j < nlen[i] + 1; j++)
-			ix[i][j] = nfile[i][j].offset;
+		nlen[i] = n;
 	}
 
-	/* lenght of prefix and suffix is calculated */
-	for (; pref < nlen[0] && pref < nlen[1] &&
-	       nfile[0][pref + 1].value == nfile[1][pref + 1].value;
-	       pref++);
-	for (; suff < nlen[0] - pref && suff < nlen[1] - pref &&
-	       nfile[0][nlen[0] - suff].value == nfile[1][nlen[1] - suff].value;
-	       suff++);
-	/* Arrays are pruned by the suffix and prefix lenght,
-	 * the result being sorted and stored in sfile[fileno],
-	 * and their sizes are stored in slen[fileno]
-	 */
-	for (int j = 0; j < 2; j++) {
-		sfile[j] = nfile[j] + pref;
-		slen[j] = nlen[j] - pref - suff;
-		for (int i = 0; i <= slen[j]; i++)
-			sfile[j][i].serial = i;
-		qsort(sfile[j] + 1, slen[j], sizeof(*sfile[j]), line_compar);
+	/* Hash them, lines which are equal get the same class */
+	for (mask = 255; mask < 2 * (unsigned)(nlen[0] + nlen[1]); mask = mask * 2 + 1)
+		continue;
+	tab = xzalloc((mask + 1) * sizeof(tab[0]));
+	for (int i = 0; i < 2; i++) {
+		cls[i] = xmalloc((nlen[i] + 2) * sizeof(cls[i][0]));
+		for (int k = 1; k <= nlen[i]; k++) {
+			const char *p = ft[i].buf + ix[i][k - 1];
+			unsigned len = MIN(ix[i][k], (off_t)ft[i].size) - ix[i][k - 1];
+			unsigned hash = line_hash(p, len);
+			unsigned h = hash & mask;
+
+			while (tab[h].cls) {
+				if (tab[h].hash == hash
+				 && line_equal(tab[h].p, tab[h].len, p, len)
+				) {
+					break;
+				}
+				h = (h + 1) & mask;
+			}
+			if (!tab[h].cls) {
+				tab[h].p = p;
+				tab[h].len = len;
+				tab[h].hash = hash;
+				tab[h].cls = ++nclass;
+			}
+			cls[i][k] = tab[h].cls;
+		}
 	}
-	/* nfile arrays are reused to reduce memory pressure
-	 * The #if zeroed out section performs the same task as the
-	 * one in the #else section.
-	 * Peak memory usage is higher, but one array copy is avoided
-	 * by not using unsort()
-	 */
-#if 0
-	member = xmalloc((slen[1] + 2) * sizeof(member[0]));
-	equiv(sfile[0], slen[0], sfile[1], slen[1], member);
-	free(nfile[1]);
-
-	class = xmalloc((slen[0] + 1) * sizeof(class[0]));
-	for (int i = 1; i <= slen[0]; i++) /* Unsorting */
-		class[sfile[0][i].serial] = sfile[0][i].value;
-	free(nfile[0]);
-#else
-	member = (int *)nfile[1];
-	equiv(sfile[0], slen[0], sfile[1], slen[1], member);
-	member = xrealloc(member, (slen[1] + 2) * sizeof(member[0]));
+	free(tab);
+
+	memset(&c, 0, sizeof(c));
+	c.a = cls[0];
+	c.b = cls[1];
+	c.chg[0] = xzalloc(nlen[0] + 2);
+	c.chg[1] = xzalloc(nlen[1] + 2);
+	/* Diagonals x - y run from -nlen[1]-1 to nlen[0]+1 */
+	c.fd = xmalloc((nlen[0] + nlen[1] + 3) * sizeof(c.fd[0]));
+	c.bd = xmalloc((nlen[0] + nlen[1] + 3) * sizeof(c.bd[0]));
+	c.fd += nlen[1] + 1;
+	c.bd += nlen[1] + 1;
+	c.mxcost = MAX(256, isqrt(nlen[0] + nlen[1] + 3));
+	if (option_mask32 & FLAG(H)) {
+		c.head = xzalloc((nclass + 1) * sizeof(c.head[0]));
+		c.cnt = xzalloc((nclass + 1) * sizeof(c.cnt[0]));
+		c.next = xmalloc((nlen[0] + 1) * sizeof(c.next[0]));
+		histogram(&c, 1, nlen[0] + 1, 1, nlen[1] + 1);
+		free(c.head);
+		free(c.cnt);
+		free(c.next);
+	} else {
+		myers(&c, 1, nlen[0] + 1, 1, nlen[1] + 1);
+	}
+	free(c.fd - (nlen[1] + 1));
+	free(c.bd - (nlen[1] + 1));
+	free(cls[0]);
+	free(cls[1]);
 
-	class = (int *)nfile[0];
-	unsort(sfile[0], slen[0], (int *)nfile[0]);
-	class = xrealloc(class, (slen[0] + 2) * sizeof(class[0]));
-#endif
 	J = xmalloc((nlen[0] + 2) * sizeof(J[0]));
-	/* The elements of J which fall inside the prefix and suffix regions
-	 * are marked as unchanged, while the ones which fall outside
-	 * are initialized with 0 (no matches), so that function stone can
-	 * then assign them their right values
-	 */
-	for (int i = 0, delta = nlen[1] - nlen[0]; i <= nlen[0]; i++)
-		J[i] = i <= pref            ?  i :
-		       i > (nlen[0] - suff) ? (i + delta) : 0;
-	/* Here the magic is performed */
-	stone(class, slen[0], member, J, pref);
-	J[nlen[0] + 1] = nlen[1] + 1;
-
-	free(class);
-	free(member);
-
-	/* Both files are rescanned, in an effort to find any lines
-	 * which, due to limitations intrinsic to any hashing algorithm,
-	 * are different but ended up confounded as the same
-	 */
-	for (int i = 1; i <= nlen[0]; i++) {
-		if (!J[i])
+	J[0] = 0;
+	for (int i = 1, j = 1; i <= nlen[0]; i++) {
+		if (c.chg[0][i]) {
+			J[i] = 0;
 			continue;
-
-		seek_ft(&ft[0], ix[0][i - 1]);
-		seek_ft(&ft[1], ix[1][J[i] - 1]);
-
-		for (int j = J[i]; i <= nlen[0] && J[i] == j; i++, j++) {
-			token_t tok0 = 0, tok1 = 0;
-			do {
-				tok0 = read_token(&ft[0], tok0);
-				tok1 = read_token(&ft[1], tok1);
-
-				if (((tok0 ^ tok1) & TOK_EMPTY) != 0 /* one is empty (not both) */
-				 || (!(tok0 & TOK_EMPTY) && TOK2CHAR(tok0) != TOK2CHAR(tok1))
-				) {
-					J[i] = 0; /* Break the correspondence */
-				}
-			} while (!(tok0 & tok1 & TOK_EMPTY));
 		}
+		while (c.chg[1][j])
+			j++;
+		J[i] = j++;
 	}
+	J[nlen[0] + 1] = nlen[1] + 1;
+	free(c.chg[0]);
+	free(c.chg[1]);
 
 	return J;
 }
 
-static bool diff(FILE* fp[2], char *file[2])
+static bool diff(const file_buf_t ft[2], char *file[2])
 {
 	int nlen[2];
 	off_t *ix[2];
-	FILE_and_pos_t ft[2] = { { fp[0] }, { fp[1] } };
 	int *J = create_J(ft, nlen, ix);
 
 	bool anychange = false;
@@ -656,65 +697,74 @@ static bool diff(FILE* fp[2], char *file[2])
 	return anychange;
 }
 
+/* Maps the file, or reads it if it can't be mapped (pipes, /proc) */
+static int load_file(file_buf_t *ft, const char *file)
+{
+	struct stat st;
+	int fd = open_or_warn_stdin(file);
+
+	if (fd == -1)
+		return -1;
+	ft->mapped = 0;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+	 && st.st_size > 0 && st.st_size == (off_t)(size_t)st.st_size
+	) {
+		ft->size = st.st_size;
+		ft->buf = mmap(NULL, ft->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		ft->mapped = (ft->buf != MAP_FAILED);
+	}
+	if (!ft->mapped) {
+		ft->size = INT_MAX - 4095;
+		ft->buf = xmalloc_read(fd, &ft->size);
+	}
+	if (fd) /* Prevents closing of stdin */
+		close(fd);
+	if (!ft->buf) {
+		bb_simple_perror_msg(file);
+		return -1;
+	}
+	return 0;
+}
+
+static void unload_file(file_buf_t *ft)
+{
+	if (ft->mapped)
+		munmap(ft->buf, ft->size);
+	else
+		free(ft->buf);
+}
+
 static int diffreg(char *file[2])
 {
-	FILE *fp[2] = { stdin, stdin };
+	file_buf_t ft[2];
 	bool binary = false, differ = false;
 	int status = STATUS_SAME;
-
-	for (int i = 0; i < 2; i++) {
-		int fd = open_or_warn_stdin(file[i]);
-		if (fd == -1)
-			goto out;
-		/* Our diff implementation is using seek.
-		 * When we meet non-seekable file, we must make a temp copy.
-		 */
-		if (lseek(fd, 0, SEEK_SET) == -1 && errno == ESPIPE) {
-			char name[] = "/tmp/difXXXXXX";
-			int fd_tmp = mkstemp(name);
-			if (fd_tmp < 0)
-				bb_perror_msg_and_die("mkstemp");
-			unlink(name);
-			if (bb_copyfd_eof(fd, fd_tmp) < 0)
-				xfunc_die();
-			if (fd) /* Prevents closing of stdin */
-				close(fd);
-			fd = fd_tmp;
-		}
-		fp[i] = fdopen(fd, "r");
-	}
-
-	while (1) {
-		const size_t sz = COMMON_BUFSIZE / 2;
-		char *const buf0 = bb_common_bufsiz1;
-		char *const buf1 = buf0 + sz;
-		int i, j;
-		i = fread(buf0, 1, sz, fp[0]);
-		j = fread(buf1, 1, sz, fp[1]);
-		if (i != j) {
-			differ = true;
-			i = MIN(i, j);
-		}
-		if (i == 0)
-			break;
-		for (int k = 0; k < i; k++) {
-			if (!buf0[k] || !buf1[k])
-				binary = true;
-			if (buf0[k] != buf1[k])
-				differ = true;
-		}
+	size_t common;
+
+	if (load_file(&ft[0], file[0]) != 0)
+		return status;
+	if (load_file(&ft[1], file[1]) != 0)
+		goto out;
+
+	common = MIN(ft[0].size, ft[1].size);
+	if (ft[0].size != ft[1].size
+	 || memcmp(ft[0].buf, ft[1].buf, common) != 0
+	) {
+		differ = true;
 	}
+	if (memchr(ft[0].buf, '\0', common) || memchr(ft[1].buf, '\0', common))
+		binary = true;
 	if (differ) {
 		if (binary && !(option_mask32 & FLAG(a)))
 			status = STATUS_BINARY;
-		else if (diff(fp, file))
+		else if (diff(ft, file))
 			status = STATUS_DIFFER;
 	}
 	if (status != STATUS_SAME)
 		exit_status |= 1;
+	unload_file(&ft[1]);
 out:
-	fclose_if_not_stdin(fp[0]);
-	fclose_if_not_stdin(fp[1]);
+	unload_file(&ft[0]);
 
 	return status;
 }
@@ -877,6 +927,8 @@ static const char diff_longopts[] ALIGN1 =
 	"report-identical-files\0"   No_argument       "s"
 	"starting-file\0"            Required_argument "S"
 	"minimal\0"                  No_argument       "d"
+	"speed-large-files\0"        No_argument       "H"
+	"histogram\0"                No_argument       "H"
 	;
 #endif
 
@@ -894,7 +946,7 @@ int diff_main(int argc UNUSED_PARAM, char **argv)
 #if ENABLE_FEATURE_DIFF_LONG_OPTIONS
 	applet_long_options = diff_longopts;
 #endif
-	getopt32(argv, "abdiL:NqrsS:tTU:wupBE",
+	getopt32(argv, "abdiL:NqrsS:tTU:wupBEH",
 			&L_arg, &s_start, &opt_U_context);
 	argv += optind;
 	while (L_arg)
@@ -61,9 +61,12 @@
 #include "libbb.h"
 #include "xregex.h"
 
+/* stdio buffer size for sed -i input and output */
+#define SED_IOBUF (64 * 1024)
+
 /* Each sed command turns into one of these structures. */
 typedef struct sed_cmd_s {
-	/* Ordered by alignment requirements: currently 36 bytes on x86 */
+	/* Ordered by alignment requirements: currently 44 bytes on x86 */
 	struct sed_cmd_s *next; /* Next command (linked list, NULL terminated) */
 
 	/* address storage */
@@ -75,6 +78,8 @@ typedef struct sed_cmd_s {
 
 	FILE *sw_file;          /* File (sw) command writes to, -1 for none. */
 	char *string;           /* Data string for (saicytb) commands. */
+	char *sub_literal;      /* (s) sub_match is just this string, see subst_exec() */
+	unsigned sub_literal_len;
 
 	unsigned which_match;   /* (s) Which match to replace (0 for all) */
 
@@ -82,6 +87,8 @@ typedef struct sed_cmd_s {
 	unsigned invert:1;      /* the '!' after the address */
 	unsigned in_match:1;    /* Next line also included in match? */
 	unsigned sub_p:1;       /* (s) print option */
+	unsigned sub_bol:1;     /* (s) sub_literal is anchored with ^ */
+	unsigned sub_eol:1;     /* (s) sub_literal is anchored with $ */
 
 	char sw_last_char;      /* Last line written by (sw) had no '\n' */
 
@@ -152,6 +159,7 @@ static void sed_free_and_close_stuff(void)
 			regfree(sed_cmd->sub_match);
 			free(sed_cmd->sub_match);
 		}
+		free(sed_cmd->sub_literal);
 		free(sed_cmd->string);
 		free(sed_cmd);
 		sed_cmd = sed_cmd_next;
@@ -324,6 +332,31 @@ static int parse_file_cmd(/*sed_cmd_t *sed_cmd,*/ const char *filecmdstr, char *
 	return idx;
 }
 
+/* s/foo/, s/^foo/, s/foo$/ and s/^foo$/ are common enough
+ * to be worth doing without regexec, see subst_exec() */
+static void parse_subst_literal(sed_cmd_t *sed_cmd, const char *match)
+{
+	const char *end;
+
+	if (*match == '^') {
+		sed_cmd->sub_bol = 1;
+		match++;
+	}
+	end = match + strlen(match);
+	if (end != match && end[-1] == '$') {
+		sed_cmd->sub_eol = 1;
+		end--;
+	}
+	if (end == match
+	 || strcspn(match, (G.regex_type & REG_EXTENDED) ? "\\.[*^$+?(){}|" : "\\.[*^$") < (size_t)(end - match)
+	) {
+		sed_cmd->sub_bol = sed_cmd->sub_eol = 0;
+		return;
+	}
+	sed_cmd->sub_literal_len = end - match;
+	sed_cmd->sub_literal = xstrndup(match, end - match);
+}
+
 static int parse_subst_cmd(sed_cmd_t *sed_cmd, const char *substr)
 {
 	int cflags = G.regex_type;
@@ -401,6 +434,8 @@ out:
 		/* If match is empty, we use last regex used at runtime */
 		sed_cmd->sub_match = xmalloc(sizeof(regex_t));
 		xregcomp(sed_cmd->sub_match, match, cflags);
+		if (!(cflags & REG_ICASE))
+			parse_subst_literal(sed_cmd, match);
 	}
 	free(match);
 
@@ -587,6 +622,17 @@ static void pipe_putc(char c)
 	G.pipeline.buf[G.pipeline.idx++] = c;
 }
 
+static void pipe_write(const char *s, int n)
+{
+	if (G.pipeline.len - G.pipeline.idx < n) {
+		/* Grow geometrically, long lines must not cost a realloc per 64 bytes */
+		G.pipeline.len += G.pipeline.len + n;
+		G.pipeline.buf = xrealloc(G.pipeline.buf, G.pipeline.len);
+	}
+	memcpy(G.pipeline.buf + G.pipeline.idx, s, n);
+	G.pipeline.idx += n;
+}
+
 static void do_subst_w_backrefs(char *line, char *replace)
 {
 	int i, j;
@@ -600,8 +646,7 @@ static void do_subst_w_backrefs(char *line, char *replace)
 				/* print out the text held in G.regmatch[backref] */
 				if (G.regmatch[backref].rm_so != -1) {
 					j = G.regmatch[backref].rm_so;
-					while (j < G.regmatch[backref].rm_eo)
-						pipe_putc(line[j++]);
+					pipe_write(line + j, G.regmatch[backref].rm_eo - j);
 				}
 				continue;
 			}
@@ -615,8 +660,7 @@ static void do_subst_w_backrefs(char *line, char *replace)
 		/* if we find an unescaped '&' print out the whole matched text. */
 		if (replace[i] == '&') {
 			j = G.regmatch[0].rm_so;
-			while (j < G.regmatch[0].rm_eo)
-				pipe_putc(line[j++]);
+			pipe_write(line + j, G.regmatch[0].rm_eo - j);
 			continue;
 		}
 		/* Otherwise just output the character. */
@@ -624,6 +668,40 @@ static void do_subst_w_backrefs(char *line, char *replace)
 	}
 }
 
+/* regexec() for s///, unless the regex is a plain string */
+static int subst_exec(sed_cmd_t *sed_cmd, regex_t *re, const char *line, int eflags)
+{
+	const char *lit = sed_cmd->sub_literal;
+	unsigned len = sed_cmd->sub_literal_len;
+	const char *p;
+	int i;
+
+	if (!lit || re != sed_cmd->sub_match)
+		return regexec(re, line, 10, G.regmatch, eflags);
+
+	if (sed_cmd->sub_bol) {
+		if ((eflags & REG_NOTBOL) || strncmp(line, lit, len) != 0)
+			return REG_NOMATCH;
+		if (sed_cmd->sub_eol && line[len] != '\0')
+			return REG_NOMATCH;
+		p = line;
+	} else if (sed_cmd->sub_eol) {
+		size_t l = strlen(line);
+		if (l < len || memcmp(line + l - len, lit, len) != 0)
+			return REG_NOMATCH;
+		p = line + l - len;
+	} else {
+		p = strstr(line, lit);
+		if (!p)
+			return REG_NOMATCH;
+	}
+	G.regmatch[0].rm_so = p - line;
+	G.regmatch[0].rm_eo = p - line + len;
+	for (i = 1; i < 10; i++)
+		G.regmatch[i].rm_so = G.regmatch[i].rm_eo = -1;
+	return 0;
+}
+
 static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 {
 	char *line = *line_p;
@@ -641,7 +719,7 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 	G.previous_regex_ptr = current_regex;
 
 	/* Find the first match */
-	if (REG_NOMATCH == regexec(current_regex, line, 10, G.regmatch, 0))
+	if (REG_NOMATCH == subst_exec(sed_cmd, current_regex, line, 0))
 		return 0;
 
 	/* Initialize temporary output buffer. */
@@ -651,8 +729,6 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 
 	/* Now loop through, substituting for matches */
 	do {
-		int i;
-
 		/* Work around bug in glibc regexec, demonstrated by:
 		   echo " a.b" | busybox sed 's [^ .]* x g'
 		   The match_count check is so not to break
@@ -669,14 +745,13 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 		if (sed_cmd->which_match
 		 && (sed_cmd->which_match != match_count)
 		) {
-			for (i = 0; i < G.regmatch[0].rm_eo; i++)
-				pipe_putc(*line++);
+			pipe_write(line, G.regmatch[0].rm_eo);
+			line += G.regmatch[0].rm_eo;
 			continue;
 		}
 
 		/* print everything before the match */
-		for (i = 0; i < G.regmatch[0].rm_so; i++)
-			pipe_putc(line[i]);
+		pipe_write(line, G.regmatch[0].rm_so);
 
 		/* then print the substitution string */
 		do_subst_w_backrefs(line, sed_cmd->string);
@@ -691,15 +766,10 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 			break;
 
 //maybe (G.regmatch[0].rm_eo ? REG_NOTBOL : 0) instead of unconditional REG_NOTBOL?
-	} while (*line && regexec(current_regex, line, 10, G.regmatch, REG_NOTBOL) != REG_NOMATCH);
+	} while (*line && subst_exec(sed_cmd, current_regex, line, REG_NOTBOL) != REG_NOMATCH);
 
 	/* Copy rest of string into output pipeline */
-	while (1) {
-		char c = *line++;
-		pipe_putc(c);
-		if (c == '\0')
-			break;
-	}
+	pipe_write(line, strlen(line) + 1);
 
 	free(*line_p);
 	*line_p = G.pipeline.buf;
@@ -1314,6 +1384,7 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 	} else {
 		int i;
 		FILE *file;
+		char *iobuf = NULL;
 
 		for (i = 0; argv[i]; i++) {
 			struct stat statbuf;
@@ -1339,6 +1410,11 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 			if (-1 == nonstdoutfd)
 				bb_perror_msg_and_die("can't create temp file %s", G.outname);
 			G.nonstdout = xfdopen_for_write(nonstdoutfd);
+			/* Big files go through in fewer, larger reads and writes */
+			if (!iobuf)
+				iobuf = xmalloc(2 * SED_IOBUF);
+			setvbuf(file, iobuf, _IOFBF, SED_IOBUF);
+			setvbuf(G.nonstdout, iobuf + SED_IOBUF, _IOFBF, SED_IOBUF);
 
 			/* Set permissions/owner of output file */
 			fstat(fileno(file), &statbuf);
@@ -1346,7 +1422,9 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 			fchown(nonstdoutfd, statbuf.st_uid, statbuf.st_gid);
 			add_input_file(file);
 			process_files();
-			fclose(G.nonstdout);
+			/* Don't replace the file with a short copy */
+			if (fclose(G.nonstdout) != 0)
+				bb_perror_msg_and_die(bb_msg_write_error);
 
 			G.nonstdout = stdout;
 			/* unlink(argv[i]); */
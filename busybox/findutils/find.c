@@ -113,7 +113,7 @@ struct globals {
 	/* we have to zero it out because of NOEXEC */ \
 	memset(&G, 0, offsetof(struct globals, need_print)); \
 	G.need_print = 1; \
-	G.recurse_flags = ACTION_RECURSE; \
+	G.recurse_flags = ACTION_RECURSE | ACTION_PARALLEL; \
 } while (0)
 
 #if ENABLE_FEATURE_FIND_EXEC
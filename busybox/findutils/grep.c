@@ -29,6 +29,7 @@
 	IF_FEATURE_GREP_EGREP_ALIAS("E") \
 	IF_DESKTOP("w") \
 	IF_EXTRA_COMPAT("z") \
+	IF_FEATURE_GREP_PARALLEL("j:") \
 	"aI"
 
 /* ignored: -a "assume all files to be text" */
@@ -57,6 +58,7 @@ enum {
 	IF_FEATURE_GREP_EGREP_ALIAS(OPTBIT_E ,) /* extended regexp */
 	IF_DESKTOP(                 OPTBIT_w ,) /* whole word match */
 	IF_EXTRA_COMPAT(            OPTBIT_z ,) /* input is NUL terminated */
+	IF_FEATURE_GREP_PARALLEL(   OPTBIT_j ,) /* -j N: search files in N workers */
 	OPT_l = 1 << OPTBIT_l,
 	OPT_n = 1 << OPTBIT_n,
 	OPT_q = 1 << OPTBIT_q,
@@ -79,6 +81,7 @@ enum {
 	OPT_E = IF_FEATURE_GREP_EGREP_ALIAS((1 << OPTBIT_E)) + 0,
 	OPT_w = IF_DESKTOP(                 (1 << OPTBIT_w)) + 0,
 	OPT_z = IF_EXTRA_COMPAT(            (1 << OPTBIT_z)) + 0,
+	OPT_j = IF_FEATURE_GREP_PARALLEL(   (1 << OPTBIT_j)) + 0,
 };
 
 #define PRINT_FILES_WITH_MATCHES    (option_mask32 & OPT_l)
@@ -111,6 +114,11 @@ struct globals {
 	/* globals used internally */
 	llist_t *pattern_head;   /* growable list of patterns to match */
 	const char *cur_file;    /* the current file we are reading */
+#if ENABLE_FEATURE_GREP_FAST_PATTERNS && !ENABLE_EXTRA_COMPAT
+	smalluint block_scan;    /* look for candidate lines, see next_candidate() */
+	const char *needle;      /* what every matching line has, if !ac */
+	unsigned needle_len;
+#endif
 };
 #define G (*(struct globals*)&bb_common_bufsiz1)
 #define INIT_G() do { \
@@ -144,6 +152,9 @@ struct globals {
 #define last_line_printed (G.last_line_printed   )
 #define pattern_head      (G.pattern_head        )
 #define cur_file          (G.cur_file            )
+#define block_scan        (G.block_scan          )
+#define needle            (G.needle              )
+#define needle_len        (G.needle_len          )
 
 
 typedef struct grep_list_data_t {
@@ -159,6 +170,9 @@ typedef struct grep_list_data_t {
 #define ALLOCATED 1
 #define COMPILED 2
 	int flg_mem_alocated_compiled;
+#if ENABLE_FEATURE_GREP_FAST_PATTERNS
+	char *literal; /* is in every line the regex matches, or NULL */
+#endif
 } grep_list_data_t;
 
 #if !ENABLE_EXTRA_COMPAT
@@ -197,6 +211,201 @@ static void print_line(const char *line, size_t line_len, int linenum, char deco
 	}
 }
 
+#if ENABLE_FEATURE_GREP_FAST_PATTERNS
+/* Aho-Corasick automaton over all -F patterns: one pass over the line
+ * tells whether any of them is in it. Node 0 is the root; its
+ * transitions are a table, other nodes have lists of children
+ * (patterns mostly share only short prefixes, so lists are short). */
+struct ac_node {
+	int child;    /* first child */
+	int sibling;  /* next child of our parent */
+	int fail;     /* longest proper suffix which is in the trie */
+	unsigned char c;
+	smallint out; /* a pattern ends here, or at a suffix */
+};
+
+static struct ac {
+	struct ac_node *node;
+	int cnt;
+	int root[256];
+} *ac;
+
+static int ac_child(int n, unsigned char c)
+{
+	int i;
+
+	for (i = ac->node[n].child; i; i = ac->node[i].sibling)
+		if (ac->node[i].c == c)
+			return i;
+	return 0;
+}
+
+static void ac_add(const char *s)
+{
+	int n = 0;
+
+	for (; *s; s++) {
+		int i = ac_child(n, *s);
+		if (!i) {
+			ac->node = xrealloc_vector(ac->node, 8, ac->cnt);
+			i = ac->cnt++;
+			ac->node[i].c = *s;
+			ac->node[i].sibling = ac->node[n].child;
+			ac->node[n].child = i;
+		}
+		n = i;
+	}
+	ac->node[n].out = 1;
+}
+
+static void ac_build(void)
+{
+	llist_t *p;
+	int *queue;
+	int head, tail, i;
+
+	ac = xzalloc(sizeof(*ac));
+	ac->node = xrealloc_vector(ac->node, 8, 0);
+	ac->cnt = 1;
+	for (p = pattern_head; p; p = p->link)
+		ac_add(((grep_list_data_t *)p->data)->pattern);
+
+	/* Breadth first, so that fail links point to done nodes */
+	queue = xmalloc(ac->cnt * sizeof(queue[0]));
+	head = tail = 0;
+	for (i = ac->node[0].child; i; i = ac->node[i].sibling) {
+		ac->root[ac->node[i].c] = i;
+		queue[tail++] = i;
+	}
+	while (head < tail) {
+		int n = queue[head++];
+
+		for (i = ac->node[n].child; i; i = ac->node[i].sibling) {
+			int f = ac->node[n].fail;
+			int g;
+
+			while (f && !ac_child(f, ac->node[i].c))
+				f = ac->node[f].fail;
+			g = f ? ac_child(f, ac->node[i].c) : ac->root[ac->node[i].c];
+			ac->node[i].fail = g;
+			ac->node[i].out |= ac->node[g].out;
+			queue[tail++] = i;
+		}
+	}
+	free(queue);
+}
+
+static int ac_step(int n, unsigned char c)
+{
+	for (;;) {
+		int i;
+		if (n == 0)
+			return ac->root[c];
+		i = ac_child(n, c);
+		if (i)
+			return i;
+		n = ac->node[n].fail;
+	}
+}
+
+static int ac_match(const char *s)
+{
+	int n = 0;
+
+	if (ac->node[0].out) /* empty pattern */
+		return 1;
+	for (; *s; s++) {
+		n = ac_step(n, *s);
+		if (ac->node[n].out)
+			return 1;
+	}
+	return 0;
+}
+
+# if !ENABLE_EXTRA_COMPAT
+/* A string which must be in any line the regex matches: the literal
+ * text it starts with. NULL if there is none (or alternation makes
+ * it not a must) */
+static char *regex_literal(const char *re)
+{
+	const char *special = (reflags & REG_EXTENDED) ? "\\.[]*^$+?(){}|" : "\\.[]*^$";
+	const char *quant = (reflags & REG_EXTENDED) ? "*+?{" : "*";
+	const char *end;
+
+	if (strchr(re, '|')) /* ERE a|b, or GNU BRE a\|b */
+		return NULL;
+	if (*re == '^')
+		re++;
+	end = re;
+	while (*end && !strchr(special, *end))
+		end++;
+	/* ab* - b is optional. In UTF-8, b may be several bytes */
+	if (*end && (strchr(quant, *end) || (end[0] == '\\' && strchr("?+{", end[1])))) {
+		end--;
+		while (end > re && ((unsigned char)*end & 0xc0) == 0x80)
+			end--;
+	}
+	if (end - re < 2)
+		return NULL;
+	return xstrndup(re, end - re);
+}
+
+/* Where the first pattern occurrence in p..end ends, or NULL.
+ * Unlike ac_match, NULs don't stop us */
+static char *ac_scan(char *p, char *end)
+{
+	int n = 0;
+
+	if (ac->node[0].out)
+		return p;
+	for (; p < end; p++) {
+		n = ac_step(n, *p);
+		if (ac->node[n].out)
+			return p;
+	}
+	return NULL;
+}
+
+/* The line reader ends lines at NULs too */
+static unsigned count_lines(const char *p, const char *end)
+{
+	unsigned cnt = 0;
+
+	for (; p < end; p++)
+		cnt += (*p == '\n' || *p == '\0');
+	return cnt;
+}
+
+/* Next line which may match. Instead of taking lines one by one,
+ * search all of the buffer for the needle (or the -F patterns),
+ * and only cut out the line around a hit. Lines without one are
+ * skipped, just counted for -n */
+static char *next_candidate(line_reader_t *lr, int *linenum)
+{
+	for (;;) {
+		char *buf = lr->buf;
+		char *p = buf + lr->start;
+		char *end = buf + lr->end;
+		char *hit, *nl;
+
+		hit = ac ? ac_scan(p, end) : memmem(p, end - p, needle, needle_len);
+		/* Drop lines before the hit, or all but the partial
+		 * last line, which may be the start of one */
+		nl = memrchr(p, '\n', (hit ? hit : end) - p);
+		if (nl) {
+			if (PRINT_LINE_NUM)
+				*linenum += count_lines(p, nl + 1);
+			lr->start = lr->scan = nl + 1 - buf;
+		}
+		if (hit)
+			return line_reader_get(lr, NULL);
+		if (!line_reader_fill(lr))
+			return NULL;
+	}
+}
+# endif
+#endif
+
 #if ENABLE_EXTRA_COMPAT
 /* Unlike getline, this one removes trailing '\n' */
 static ssize_t FAST_FUNC bb_getline(char **line_ptr, size_t *line_alloc_len, FILE *file)
@@ -225,6 +434,7 @@ static int grep_file(FILE *file)
 	int nmatches = 0;
 #if !ENABLE_EXTRA_COMPAT
 	char *line;
+	line_reader_t *lr = line_reader_new(fileno(file));
 #else
 	char *line = NULL;
 	ssize_t line_len;
@@ -241,8 +451,10 @@ static int grep_file(FILE *file)
 #endif
 
 	while (
-#if !ENABLE_EXTRA_COMPAT
-		(line = xmalloc_fgetline(file)) != NULL
+#if ENABLE_FEATURE_GREP_FAST_PATTERNS && !ENABLE_EXTRA_COMPAT
+		(line = block_scan ? next_candidate(lr, &linenum) : line_reader_get(lr, NULL)) != NULL
+#elif !ENABLE_EXTRA_COMPAT
+		(line = line_reader_get(lr, NULL)) != NULL
 #else
 		(line_len = bb_getline(&line, &line_alloc_len, file)) >= 0
 #endif
@@ -252,6 +464,12 @@ static int grep_file(FILE *file)
 
 		linenum++;
 		found = 0;
+#if ENABLE_FEATURE_GREP_FAST_PATTERNS
+		if (ac) {
+			found = ac_match(line);
+			pattern_ptr = NULL;
+		}
+#endif
 		while (pattern_ptr) {
 			gl = (grep_list_data_t *)pattern_ptr->data;
 			if (FGREP_FLAG) {
@@ -273,6 +491,12 @@ static int grep_file(FILE *file)
 				gl->matched_range.rm_eo = 0;
 #endif
 				if (
+#if ENABLE_FEATURE_GREP_FAST_PATTERNS && !ENABLE_EXTRA_COMPAT
+					/* Cheap test for lines which can't match */
+					(!gl->literal
+					 || ((reflags & REG_ICASE) ? strcasestr(line, gl->literal) : strstr(line, gl->literal))
+					) &&
+#endif
 #if !ENABLE_EXTRA_COMPAT
 					regexec(&gl->compiled_regex, line, 1, &gl->matched_range, 0) == 0
 #else
@@ -309,7 +533,11 @@ static int grep_file(FILE *file)
 
 			/* quiet/print (non)matching file names only? */
 			if (option_mask32 & (OPT_q|OPT_l|OPT_L)) {
+#if !ENABLE_EXTRA_COMPAT
+				line_reader_free(lr);
+#else
 				free(line); /* we don't need line anymore */
+#endif
 				if (BE_QUIET) {
 					/* manpage says about -q:
 					 * "exit immediately with zero status
@@ -407,18 +635,19 @@ static int grep_file(FILE *file)
 			} else if (lines_before) {
 				/* Add the line to the circular 'before' buffer */
 				free(before_buf[curpos]);
+#if !ENABLE_EXTRA_COMPAT
+				before_buf[curpos] = line_reader_xdup(lr);
+#else
 				before_buf[curpos] = line;
-				IF_EXTRA_COMPAT(before_buf_size[curpos] = line_len;)
-				curpos = (curpos + 1) % lines_before;
+				before_buf_size[curpos] = line_len;
 				/* avoid free(line) - we took the line */
 				line = NULL;
+#endif
+				curpos = (curpos + 1) % lines_before;
 			}
 		}
 
 #endif /* ENABLE_FEATURE_GREP_CONTEXT */
-#if !ENABLE_EXTRA_COMPAT
-		free(line);
-#endif
 		/* Did we print all context after last requested match? */
 		if ((option_mask32 & OPT_m)
 		 && !print_n_lines_after
@@ -427,6 +656,9 @@ static int grep_file(FILE *file)
 			break;
 		}
 	} /* while (read line) */
+#if !ENABLE_EXTRA_COMPAT
+	line_reader_free(lr);
+#endif
 
 	/* special-case file post-processing for options where we don't print line
 	 * matches, just filenames and possibly match counts */
@@ -486,12 +718,99 @@ static void load_regexes_from_file(llist_t *fopt)
 	}
 }
 
+#if ENABLE_FEATURE_GREP_PARALLEL
+/* grep -j N: files are searched by N forked workers. A worker gets
+ * file names on its job pipe, greps each with its stdout going to a
+ * temporary file, then sends a struct grep_result and the output on
+ * its result pipe. We take the results in the order we sent the
+ * names, so output is as without -j. Each worker has at most
+ * two names sent and not collected: the next one is ready when it
+ * finishes the current one. */
+struct grep_job {
+	unsigned name_len; /* name follows */
+	smalluint print_name;
+};
+
+struct grep_result {
+	off_t out_len;
+	int nmatches;
+	int open_err;
+};
+
+struct grep_worker {
+	int job_fd;
+	int res_fd;
+	pid_t pid;
+	unsigned busy;
+};
+
+static struct {
+	unsigned cnt;
+	struct grep_worker *w;
+	unsigned *fifo; /* workers of names sent, oldest first */
+	unsigned head, tail;
+} J;
+
+static void grep_collect(int *matched)
+{
+	struct grep_worker *w = &J.w[J.fifo[J.head++ % (2 * J.cnt)]];
+	struct grep_result res;
+
+	if (full_read(w->res_fd, &res, sizeof(res)) != sizeof(res))
+		xfunc_die(); /* worker has said why */
+	if (res.out_len) {
+		fflush_all();
+		bb_copyfd_exact_size(w->res_fd, STDOUT_FILENO, res.out_len);
+	}
+	*matched += res.nmatches;
+	open_errors |= res.open_err;
+	w->busy--;
+}
+
+static void grep_collect_all(int *matched)
+{
+	while (J.head != J.tail)
+		grep_collect(matched);
+}
+
+static void grep_dispatch(const char *filename, int *matched)
+{
+	struct grep_worker *w;
+	struct grep_job job;
+	unsigned i;
+
+	for (;;) {
+		w = &J.w[0];
+		for (i = 1; i < J.cnt; i++)
+			if (J.w[i].busy < w->busy)
+				w = &J.w[i];
+		if (w->busy < 2)
+			break;
+		grep_collect(matched);
+	}
+	job.name_len = strlen(filename);
+	job.print_name = print_filename;
+	xwrite(w->job_fd, &job, sizeof(job));
+	xwrite(w->job_fd, filename, job.name_len);
+	w->busy++;
+	J.fifo[J.tail++ % (2 * J.cnt)] = w - J.w;
+}
+#endif
+
 static int FAST_FUNC file_action_grep(const char *filename,
 			struct stat *statbuf UNUSED_PARAM,
 			void* matched,
 			int depth UNUSED_PARAM)
 {
-	FILE *file = fopen_for_read(filename);
+	FILE *file;
+
+#if ENABLE_FEATURE_GREP_PARALLEL
+	if (J.cnt) {
+		grep_dispatch(filename, matched);
+		return 1;
+	}
+#endif
+	file = fopen_for_read(filename);
 	if (file == NULL) {
 		if (!SUPPRESS_ERR_MSGS)
 			bb_simple_perror_msg(filename);
@@ -504,6 +823,89 @@ static int FAST_FUNC file_action_grep(const char *filename,
 	return 1;
 }
 
+#if ENABLE_FEATURE_GREP_PARALLEL
+static void NORETURN grep_worker(int job_fd, int res_fd)
+{
+	struct grep_job job;
+
+	J.cnt = 0;
+	while (full_read(job_fd, &job, sizeof(job)) == sizeof(job)) {
+		struct grep_result res;
+		char *filename = xmalloc(job.name_len + 1);
+
+		xread(job_fd, filename, job.name_len);
+		filename[job.name_len] = '\0';
+		print_filename = job.print_name;
+		res.nmatches = 0;
+		open_errors = 0;
+		file_action_grep(filename, NULL, &res.nmatches, 0);
+		res.open_err = open_errors;
+		fflush_all();
+		res.out_len = xlseek(STDOUT_FILENO, 0, SEEK_CUR);
+		xwrite(res_fd, &res, sizeof(res));
+		if (res.out_len) {
+			xlseek(STDOUT_FILENO, 0, SEEK_SET);
+			bb_copyfd_exact_size(STDOUT_FILENO, res_fd, res.out_len);
+			xlseek(STDOUT_FILENO, 0, SEEK_SET);
+			if (ftruncate(STDOUT_FILENO, 0) != 0)
+				bb_perror_msg_and_die("ftruncate");
+		}
+		free(filename);
+	}
+	_exit(EXIT_SUCCESS);
+}
+
+static void grep_start_workers(unsigned cnt)
+{
+	unsigned i;
+
+	J.w = xzalloc(cnt * sizeof(J.w[0]));
+	J.fifo = xmalloc(2 * cnt * sizeof(J.fifo[0]));
+	fflush_all(); /* else workers flush our stdout too */
+	for (i = 0; i < cnt; i++) {
+		struct fd_pair job, res;
+		int out_fd = xmkstemp_unlinked(NULL, "grep");
+
+		xpiped_pair(job);
+		xpiped_pair(res);
+		J.w[i].pid = fork();
+		if (J.w[i].pid < 0)
+			bb_perror_msg_and_die("vfork" + 1);
+		if (J.w[i].pid == 0) {
+			/* Other workers must see EOF when we close their pipes */
+			while (i) {
+				i--;
+				close(J.w[i].job_fd);
+				close(J.w[i].res_fd);
+			}
+			close(job.wr);
+			close(res.rd);
+			xmove_fd(out_fd, STDOUT_FILENO);
+			grep_worker(job.rd, res.wr);
+		}
+		close(job.rd);
+		close(res.wr);
+		close(out_fd);
+		J.w[i].job_fd = job.wr;
+		J.w[i].res_fd = res.rd;
+	}
+	J.cnt = cnt;
+}
+
+static void grep_stop_workers(int *matched)
+{
+	unsigned i;
+
+	grep_collect_all(matched);
+	for (i = 0; i < J.cnt; i++) {
+		close(J.w[i].job_fd);
+		close(J.w[i].res_fd);
+		safe_waitpid(J.w[i].pid, NULL, 0);
+	}
+	J.cnt = 0;
+}
+#endif
+
 static int grep_dir(const char *dir)
 {
 	int matched = 0;
@@ -524,18 +926,21 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 	FILE *file;
 	int matched;
 	llist_t *fopt = NULL;
-
-	/* do normal option parsing */
 #if ENABLE_FEATURE_GREP_CONTEXT
 	int Copt;
+#endif
+	IF_FEATURE_GREP_PARALLEL(const char *opt_j;)
 
+	/* do normal option parsing */
+#if ENABLE_FEATURE_GREP_CONTEXT
 	/* -H unsets -h; -C unsets -A,-B; -e,-f are lists;
 	 * -m,-A,-B,-C have numeric param */
 	opt_complementary = "H-h:C-AB:e::f::m+:A+:B+:C+";
 	getopt32(argv,
 		OPTSTR_GREP,
 		&pattern_head, &fopt, &max_matches,
-		&lines_after, &lines_before, &Copt);
+		&lines_after, &lines_before, &Copt
+		IF_FEATURE_GREP_PARALLEL(, &opt_j));
 
 	if (option_mask32 & OPT_C) {
 		/* -C unsets prev -A and -B, but following -A or -B
@@ -559,7 +964,8 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 	/* -H unsets -h; -c,-q or -l unset -n; -e,-f are lists; -m N */
 	opt_complementary = "H-h:c-n:q-n:l-n:e::f::m+";
 	getopt32(argv, OPTSTR_GREP,
-		&pattern_head, &fopt, &max_matches);
+		&pattern_head, &fopt, &max_matches
+		IF_FEATURE_GREP_PARALLEL(, &opt_j));
 #endif
 	invert_search = ((option_mask32 & OPT_v) != 0); /* 0 | 1 */
 
@@ -575,6 +981,15 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 
 	if (ENABLE_FEATURE_GREP_FGREP_ALIAS && applet_name[0] == 'f')
 		option_mask32 |= OPT_F;
+#if ENABLE_FEATURE_GREP_FAST_PATTERNS
+	/* For one pattern, libc's strstr is as good. -o wants
+	 * to know which pattern matched */
+	if (FGREP_FLAG && !(option_mask32 & OPT_o)
+	 && pattern_head && pattern_head->link
+	) {
+		ac_build();
+	}
+#endif
 
 #if !ENABLE_EXTRA_COMPAT
 	if (!(option_mask32 & (OPT_o | OPT_w)))
@@ -617,6 +1032,31 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 		llist_add_to(&pattern_head, pattern);
 	}
 
+#if ENABLE_FEATURE_GREP_FAST_PATTERNS && !ENABLE_EXTRA_COMPAT
+	if (!FGREP_FLAG) {
+		llist_t *cur;
+
+		for (cur = pattern_head; cur; cur = cur->link) {
+			grep_list_data_t *gl = (grep_list_data_t *)cur->data;
+			gl->literal = regex_literal(gl->pattern);
+		}
+	}
+	/* Without -v or context, only lines with the literal text
+	 * (or with one of the -F patterns) matter */
+	if (!invert_search
+	 IF_FEATURE_GREP_CONTEXT(&& !lines_before && !lines_after)
+	) {
+		grep_list_data_t *gl = (grep_list_data_t *)pattern_head->data;
+
+		if (!pattern_head->link)
+			needle = FGREP_FLAG ? gl->pattern
+				: (reflags & REG_ICASE) ? NULL : gl->literal;
+		if (needle)
+			needle_len = strlen(needle);
+		block_scan = (ac || needle);
+	}
+#endif
+
 	/* argv[0..(argc-1)] should be names of file to grep through. If
 	 * there is more than one file to grep, we will print the filenames. */
 	if (argv[0] && argv[1])
@@ -627,6 +1067,23 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 	if (option_mask32 & OPT_h)
 		print_filename = 0;
 
+#if ENABLE_FEATURE_GREP_PARALLEL
+	/* -q exits on the first match, context lines and "--"
+	 * depend on what was printed before: keep them serial */
+	if ((option_mask32 & OPT_j) && !BE_QUIET
+	 IF_FEATURE_GREP_CONTEXT(&& !lines_before && !lines_after)
+	) {
+		unsigned jobs = xatou_range(opt_j, 0, 64);
+		if (jobs == 0) {
+			jobs = sysconf(_SC_NPROCESSORS_ONLN);
+			if (jobs > 8)
+				jobs = 8;
+		}
+		if (jobs > 1)
+			grep_start_workers(jobs);
+	}
+#endif
+
 	/* If no files were specified, or '-' was specified, take input from
 	 * stdin. Otherwise, we grep through all the files specified. */
 	matched = 0;
@@ -635,6 +1092,7 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 		file = stdin;
 		if (!cur_file || LONE_DASH(cur_file)) {
 			cur_file = "(standard input)";
+			IF_FEATURE_GREP_PARALLEL(grep_collect_all(&matched);)
 		} else {
 			if (option_mask32 & OPT_r) {
 				struct stat st;
@@ -645,6 +1103,12 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 					goto grep_done;
 				}
 			}
+#if ENABLE_FEATURE_GREP_PARALLEL
+			if (J.cnt) {
+				grep_dispatch(cur_file, &matched);
+				continue;
+			}
+#endif
 			/* else: fopen(dir) will succeed, but reading won't */
 			file = fopen_for_read(cur_file);
 			if (file == NULL) {
@@ -658,6 +1122,7 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 		fclose_if_not_stdin(file);
  grep_done: ;
 	} while (*argv && *++argv);
+	IF_FEATURE_GREP_PARALLEL(grep_stop_workers(&matched);)
 
 	/* destroy all the elments in the pattern list */
 	if (ENABLE_FEATURE_CLEAN_UP) {
@@ -275,6 +275,9 @@ enum {	/* DO NOT CHANGE THESE VALUES!  cp.c, mv.c, install.c depend on them. */
 	FILEUTILS_PRESERVE_SECURITY_CONTEXT = 1 << 9, /* -c */
 	FILEUTILS_SET_SECURITY_CONTEXT = 1 << 10,
 #endif
+	/* Not options, cp sets them: above getopt32's bits */
+	FILEUTILS_SPARSE          = 1 << 20, /* --sparse=auto */
+	FILEUTILS_SPARSE_ZEROES   = 1 << 21, /* --sparse=always */
 };
 #define FILEUTILS_CP_OPTSTR "pdRfilsLH" IF_SELINUX("c")
 extern int remove_file(const char *path, int flags) FAST_FUNC;
@@ -283,21 +286,31 @@ extern int remove_file(const char *path, int flags) FAST_FUNC;
  * This makes "cp /dev/null file" and "install /dev/null file" (!!!)
  * work coreutils-compatibly. */
 extern int copy_file(const char *source, const char *dest, int flags) FAST_FUNC;
+/* Let copy_file() copy up to n files at once in child processes */
+extern void copy_file_jobs(unsigned n) FAST_FUNC;
+extern int copy_file_wait_jobs(void) FAST_FUNC;
 
 enum {
 	ACTION_RECURSE        = (1 << 0),
 	ACTION_FOLLOWLINKS    = (1 << 1),
 	ACTION_FOLLOWLINKS_L0 = (1 << 2),
 	ACTION_DEPTHFIRST     = (1 << 3),
-	/*ACTION_REVERSE      = (1 << 4), - unused */
+	ACTION_UNORDERED      = (1 << 4),
 	ACTION_QUIET          = (1 << 5),
 	ACTION_DANGLING_OK    = (1 << 6),
+	ACTION_PARALLEL       = (1 << 7),
 };
 typedef uint8_t recurse_flags_t;
 extern int recursive_action(const char *fileName, unsigned flags,
 	int FAST_FUNC (*fileAction)(const char *fileName, struct stat* statbuf, void* userData, int depth),
 	int FAST_FUNC (*dirAction)(const char *fileName, struct stat* statbuf, void* userData, int depth),
 	void* userData, unsigned depth) FAST_FUNC;
+/* For walks of their own, see recursive_action.c */
+char **read_dir_by_inode(const char *path) FAST_FUNC;
+#if ENABLE_FEATURE_PARALLEL_TREEWALK
+void treewalk_prefetch_start(const char *dirName) FAST_FUNC;
+void treewalk_prefetch_stop(void) FAST_FUNC;
+#endif
 extern int device_open(const char *device, int mode) FAST_FUNC;
 enum { GETPTY_BUFSIZE = 16 }; /* more than enough for "/dev/ttyXXX" */
 extern int xgetpty(char *line) FAST_FUNC;
@@ -308,6 +321,15 @@ extern char *find_block_device(const char *path) FAST_FUNC;
 extern off_t bb_copyfd_eof(int fd1, int fd2) FAST_FUNC;
 extern off_t bb_copyfd_size(int fd1, int fd2, off_t size) FAST_FUNC;
 extern void bb_copyfd_exact_size(int fd1, int fd2, off_t size) FAST_FUNC;
+/* Copy a regular file keeping its holes, with zeroes != 0 also turning
+ * blocks of zeroes into holes. Plain copy if either fd can't seek */
+extern off_t bb_copyfd_sparse(int fd1, int fd2, int zeroes) FAST_FUNC;
+/* Move *start to the next data region of fd, return its end */
+extern off_t bb_find_data(int fd, off_t *start, off_t end) FAST_FUNC;
+#ifndef SEEK_DATA
+# define SEEK_DATA 3
+# define SEEK_HOLE 4
+#endif
 /* "short" copy can be detected by return value < size */
 /* this helper yells "short read!" if param is not -1 */
 extern void complain_copyfd_and_die(off_t sz) NORETURN FAST_FUNC;
@@ -400,6 +422,7 @@ void xchroot(const char *path) FAST_FUNC;
 void xsetenv(const char *key, const char *value) FAST_FUNC;
 void bb_unsetenv(const char *key) FAST_FUNC;
 void xunlink(const char *pathname) FAST_FUNC;
+int xmkstemp_unlinked(const char *dir, const char *prefix) FAST_FUNC;
 void xstat(const char *pathname, struct stat *buf) FAST_FUNC;
 int xopen(const char *pathname, int flags) FAST_FUNC;
 int xopen_nonblocking(const char *pathname) FAST_FUNC;
@@ -660,6 +683,25 @@ extern char *xmalloc_fgets(FILE *file) FAST_FUNC RETURNS_MALLOC;
 extern char *xmalloc_fgetline(FILE *file) FAST_FUNC RETURNS_MALLOC;
 /* Same, but doesn't try to conserve space (may have some slack after the end) */
 /* extern char *xmalloc_fgetline_fast(FILE *file) FAST_FUNC RETURNS_MALLOC; */
+/* Buffered line reader on fd, lines are valid until the next call */
+typedef struct line_reader_t {
+	char *buf;
+	char *line;      /* last line returned */
+	unsigned len;    /* its length, without delimiter */
+	unsigned size;
+	unsigned start;  /* of the next line */
+	unsigned scan;   /* no '\n' in start..scan */
+	unsigned end;
+	int fd;
+	char delim;
+	smallint eof;
+	smallint error;
+} line_reader_t;
+extern line_reader_t *line_reader_new(int fd) FAST_FUNC RETURNS_MALLOC;
+extern char *line_reader_get(line_reader_t *lr, int *lineno) FAST_FUNC;
+extern int line_reader_fill(line_reader_t *lr) FAST_FUNC;
+extern char *line_reader_xdup(line_reader_t *lr) FAST_FUNC RETURNS_MALLOC;
+extern void line_reader_free(line_reader_t *lr) FAST_FUNC;
 
 void die_if_ferror(FILE *file, const char *msg) FAST_FUNC;
 void die_if_ferror_stdout(void) FAST_FUNC;
@@ -678,6 +720,7 @@ FILE* fopen_for_write(const char *path) FAST_FUNC;
 FILE* xfopen_for_write(const char *path) FAST_FUNC;
 FILE* xfdopen_for_read(int fd) FAST_FUNC;
 FILE* xfdopen_for_write(int fd) FAST_FUNC;
+FILE* xfdopen_dup_for_write(int fd) FAST_FUNC;
 
 int bb_pstrcmp(const void *a, const void *b) /* not FAST_FUNC! */;
 void qsort_string_vector(char **sv, unsigned count) FAST_FUNC;
@@ -731,6 +774,8 @@ struct suffix_mult {
 int xatoi_u(const char *numstr) FAST_FUNC;
 /* Useful for reading port numbers */
 uint16_t xatou16(const char *numstr) FAST_FUNC;
+/* sort/uniq -S SIZE */
+unsigned long long xatoull_memsize(const char *numstr) FAST_FUNC;
 
 
 /* These parse entries in /etc/passwd and /etc/group.  This is desirable
@@ -1070,6 +1115,7 @@ enum {
 };
 typedef struct parser_t {
 	FILE *fp;
+	line_reader_t *lr;
 	char *line;
 	char *data;
 	int lineno;
@@ -1450,6 +1496,24 @@ typedef struct md5_ctx_t {
 void md5_begin(md5_ctx_t *ctx) FAST_FUNC;
 void md5_hash(const void *data, size_t length, md5_ctx_t *ctx) FAST_FUNC;
 void md5_end(void *resbuf, md5_ctx_t *ctx) FAST_FUNC;
+#if ENABLE_HASH_MULTIBUF
+/* Feed len[i] bytes of data[i] to ctx[i], i < n. Contexts must be
+ * of one kind; their whole blocks are hashed side by side. */
+void md5_hash_multi(md5_ctx_t *ctx[], const void *data[], const size_t len[], unsigned n) FAST_FUNC;
+void sha1_hash_multi(sha1_ctx_t *ctx[], const void *data[], const size_t len[], unsigned n) FAST_FUNC;
+#define sha256_hash_multi sha1_hash_multi
+/* The driver they share. lanes() hashes nblocks 64-byte blocks
+ * from each data[i] into hash[i][], i < HASH_LANES */
+#define HASH_LANES 8
+typedef void hash_lanes_fn(uint32_t **hash, const uint8_t **data, size_t nblocks);
+struct hash_multi_ops {
+	void FAST_FUNC (*hash)(const void *data, size_t len, void *ctx);
+	unsigned state_ofs; /* of the uint32_t state words in ctx */
+	unsigned total_ofs; /* of the uint64_t count of bytes hashed */
+};
+void hash_multi(void *ctx[], const void *data[], const size_t len[], unsigned n,
+		hash_lanes_fn *lanes, const struct hash_multi_ops *ops) FAST_FUNC;
+#endif
 
 
 uint32_t *crc32_filltable(uint32_t *tbl256, int endian) FAST_FUNC;
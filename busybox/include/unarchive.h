@@ -10,6 +10,13 @@ typedef struct file_header_t {
 #if ENABLE_FEATURE_TAR_UNAME_GNAME
 	char *tar__uname;
 	char *tar__gname;
+#endif
+#if ENABLE_FEATURE_TAR_SPARSE
+	/* GNU sparse member: offset/length pairs of the data regions,
+	 * stored back to back in the archive; size is their sum */
+	off_t *tar__sparse;
+	unsigned tar__sparse_cnt;
+	off_t tar__sparse_size; /* real size of the file */
 #endif
 	off_t size;
 	uid_t uid;
@@ -59,6 +66,10 @@ typedef struct archive_handle_t {
 	char* tar__longname;
 	char* tar__linkname;
 # endif
+# if ENABLE_FEATURE_TAR_INDEX
+	/* Where the current member's first header starts */
+	off_t tar__hdr_offset;
+# endif
 #endif
 #if ENABLE_CPIO || ENABLE_RPM2CPIO || ENABLE_RPM
 	uoff_t cpio__blocks;
@@ -104,6 +115,12 @@ extern void unpack_ar_archive(archive_handle_t *ar_archive) FAST_FUNC;
 extern void data_skip(archive_handle_t *archive_handle) FAST_FUNC;
 extern void data_extract_all(archive_handle_t *archive_handle) FAST_FUNC;
 extern void data_extract_to_stdout(archive_handle_t *archive_handle) FAST_FUNC;
+#if ENABLE_FEATURE_TAR_JOBS
+extern void data_extract_parallel_start(archive_handle_t *archive_handle, unsigned jobs) FAST_FUNC;
+extern void data_extract_parallel(archive_handle_t *archive_handle) FAST_FUNC;
+extern int data_extract_parallel_wait(void) FAST_FUNC;
+extern void data_extract_parallel_close(void) FAST_FUNC;
+#endif
 
 extern void header_skip(const file_header_t *file_header) FAST_FUNC;
 extern void header_list(const file_header_t *file_header) FAST_FUNC;
@@ -115,6 +132,7 @@ extern char get_header_tar(archive_handle_t *archive_handle) FAST_FUNC;
 extern char get_header_tar_gz(archive_handle_t *archive_handle) FAST_FUNC;
 extern char get_header_tar_bz2(archive_handle_t *archive_handle) FAST_FUNC;
 extern char get_header_tar_lzma(archive_handle_t *archive_handle) FAST_FUNC;
+extern char get_header_tar_xz(archive_handle_t *archive_handle) FAST_FUNC;
 
 extern void seek_by_jump(int fd, off_t amount) FAST_FUNC;
 extern void seek_by_read(int fd, off_t amount) FAST_FUNC;
@@ -139,11 +157,41 @@ IF_DESKTOP(long long) int inflate_unzip(inflate_unzip_result *res, off_t compr_s
 IF_DESKTOP(long long) int unpack_lzma_stream(int src_fd, int dst_fd) FAST_FUNC;
 /* the rest wants 2 first bytes already skipped by the caller */
 IF_DESKTOP(long long) int unpack_bz2_stream(int src_fd, int dst_fd) FAST_FUNC;
+#if ENABLE_FEATURE_BUNZIP2_PARALLEL
+/* Workers unpack_bz2_stream() uses, 0: one per online CPU (up to 8) */
+extern unsigned unpack_bz2_jobs;
+#endif
 IF_DESKTOP(long long) int unpack_gz_stream(int src_fd, int dst_fd) FAST_FUNC;
+#if ENABLE_FEATURE_TAR_INDEX
+/* A point in a gzip file where inflating can restart: the input
+ * position at a deflate block boundary and the last 32k of output */
+typedef struct gz_checkpoint_t {
+	off_t out_ofs;  /* output offset of window[0] */
+	off_t in_ofs;   /* next byte of src_fd to read */
+	uint32_t bitbuf;
+	uint32_t bitcnt;
+	uint32_t wpos;  /* window[0..wpos) is new output, the rest is older */
+	unsigned char window[0x8000];
+} gz_checkpoint_t;
+/* Output bytes between checkpoints */
+#define GZ_CHECKPOINT_SPAN (1024 * 1024)
+/* src_fd must be a file. If checkpoint_fd >= 0, checkpoints are written
+ * there. If resume != NULL, output starts at resume->out_ofs */
+IF_DESKTOP(long long) int unpack_gz_stream_indexed(int src_fd, int dst_fd,
+		int checkpoint_fd, const gz_checkpoint_t *resume) FAST_FUNC;
+#endif
 IF_DESKTOP(long long) int unpack_gz_stream_with_info(int src_fd, int dst_fd, unpack_info_t *info) FAST_FUNC;
 IF_DESKTOP(long long) int unpack_Z_stream(int fd_in, int fd_out) FAST_FUNC;
+/* xz unpacker wants the 6 byte magic already skipped too */
+IF_DESKTOP(long long) int unpack_xz_stream(int src_fd, int dst_fd) FAST_FUNC;
+#if ENABLE_FEATURE_XZ_PARALLEL
+/* Workers unpack_xz_stream() uses, 0: one per online CPU (up to 8) */
+extern unsigned unpack_xz_jobs;
+#endif
 /* wrapper which checks first two bytes to be "BZ" */
 IF_DESKTOP(long long) int unpack_bz2_stream_prime(int src_fd, int dst_fd) FAST_FUNC;
+/* wrapper which checks the xz magic */
+IF_DESKTOP(long long) int unpack_xz_stream_prime(int src_fd, int dst_fd) FAST_FUNC;
 
 int bbunpack(char **argv,
 	     char* (*make_new_name)(char *filename),
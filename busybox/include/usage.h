@@ -197,6 +197,9 @@
      "\nOptions:" \
      "\n	-c	Write to standard output" \
      "\n	-f	Force" \
+	IF_FEATURE_BUNZIP2_PARALLEL( \
+     "\n	-T N	Use N workers (0: one per CPU)" \
+	) \
 
 #define bzip2_trivial_usage \
        "[OPTIONS] [FILE]..."
@@ -212,7 +215,7 @@
        "Hello world!\n"
 
 #define lzop_trivial_usage \
-       "[-cfvd123456789CF] [FILE]..."
+       "[-cfvd123456789CF] "IF_FEATURE_LZOP_PARALLEL("[-T N] ")"[FILE]..."
 #define lzop_full_usage "\n\n" \
        "	-c	Write to standard output" \
      "\n	-f	Force" \
@@ -221,6 +224,9 @@
      "\n	-F	Don't store or verify checksum" \
      "\n	-C	Also write checksum of compressed block" \
      "\n	-1..9	Compression level" \
+	IF_FEATURE_LZOP_PARALLEL( \
+     "\n	-T N	Use N workers (0: one per CPU)" \
+	) \
 
 #define lzopcat_trivial_usage \
        "[-vCF] [FILE]..."
@@ -254,6 +260,22 @@
 #define lzmacat_full_usage "\n\n" \
        "Uncompress to stdout"
 
+#define unxz_trivial_usage \
+       "[OPTIONS] [FILE]"
+#define unxz_full_usage "\n\n" \
+       "Uncompress FILE (or standard input)\n" \
+     "\nOptions:" \
+     "\n	-c	Write to standard output" \
+     "\n	-f	Force" \
+	IF_FEATURE_XZ_PARALLEL( \
+     "\n	-T N	Use N workers (0: one per CPU)" \
+	) \
+
+#define xzcat_trivial_usage \
+       "FILE"
+#define xzcat_full_usage "\n\n" \
+       "Uncompress to stdout"
+
 #define cal_trivial_usage \
        "[-jy] [[month] year]"
 #define cal_full_usage "\n\n" \
@@ -559,6 +581,12 @@
      "\n	-f	Force overwrite" \
      "\n	-i	Prompt before overwrite" \
      "\n	-l,-s	Create (sym)links" \
+	IF_FEATURE_CP_SPARSE( \
+     "\n	--sparse=always|auto|never	Make holes of zeroes/keep holes/none" \
+	) \
+	IF_FEATURE_CP_JOBS( \
+     "\n	--jobs N	Copy N files at once" \
+	) \
 
 #define cpio_trivial_usage \
        "[-dmvu] [-F FILE]" IF_FEATURE_CPIO_O(" [-H newc]") \
@@ -737,7 +765,8 @@
 
 #define dd_trivial_usage \
        "[if=FILE] [of=FILE] " IF_FEATURE_DD_IBS_OBS("[ibs=N] [obs=N] ") "[bs=N] [count=N] [skip=N]\n" \
-       "	[seek=N]" IF_FEATURE_DD_IBS_OBS(" [conv=notrunc|noerror|sync|fsync]")
+       "	[seek=N]" IF_FEATURE_DD_IBS_OBS(" [conv=notrunc|noerror|sync|fsync|sparse]\n" \
+       "	[iflag=direct|fullblock" IF_FEATURE_DD_ASYNC("|async") "] [oflag=direct]")
 #define dd_full_usage "\n\n" \
        "Copy a file with converting and formatting\n" \
      "\nOptions:" \
@@ -758,6 +787,13 @@
      "\n	conv=noerror	Continue after read errors" \
      "\n	conv=sync	Pad blocks with zeros" \
      "\n	conv=fsync	Physically write data out before finishing" \
+     "\n	conv=sparse	Seek over blocks of zeros instead of writing them" \
+     "\n	iflag=direct	Read with O_DIRECT" \
+     "\n	iflag=fullblock	Read full blocks from pipes" \
+	IF_FEATURE_DD_ASYNC( \
+     "\n	iflag=async	Read next block while writing this one" \
+	) \
+     "\n	oflag=direct	Write with O_DIRECT" \
 	) \
      "\n" \
      "\nNumbers may be suffixed by c (x1), w (x2), b (x512), kD (x1000), k (x1024)," \
@@ -852,7 +888,7 @@
        "Relay DHCP requests between clients and server" \
 
 #define diff_trivial_usage \
-       "[-abBdiNqrTstw] [-L LABEL] [-S FILE] [-U LINES] FILE1 FILE2"
+       "[-abBdHiNqrTstw] [-L LABEL] [-S FILE] [-U LINES] FILE1 FILE2"
 #define diff_full_usage "\n\n" \
        "Compare files line by line and output the differences between them.\n" \
        "This implementation supports unified diffs only.\n" \
@@ -861,6 +897,7 @@
      "\n	-b	Ignore changes in the amount of whitespace" \
      "\n	-B	Ignore changes whose lines are all blank" \
      "\n	-d	Try hard to find a smaller set of changes" \
+     "\n	-H	Use histogram diff, faster on large files" \
      "\n	-i	Ignore case differences" \
      "\n	-L	Use LABEL instead of the filename in the unified header" \
      "\n	-N	Treat absent files as empty" \
@@ -1508,7 +1545,7 @@
 	IF_FEATURE_GREP_EGREP_ALIAS("E") \
 	IF_FEATURE_GREP_CONTEXT("ABC") \
 	IF_EXTRA_COMPAT("z") \
-       "] PATTERN [FILE]..."
+       "]" IF_FEATURE_GREP_PARALLEL(" [-j N]") " PATTERN [FILE]..."
 #define grep_full_usage "\n\n" \
        "Search for PATTERN in each FILE or standard input\n" \
      "\nOptions:" \
@@ -1538,6 +1575,8 @@
      "\n	-C N	Print N lines of output context") \
 	IF_EXTRA_COMPAT( \
      "\n	-z	Input is NUL terminated") \
+	IF_FEATURE_GREP_PARALLEL( \
+     "\n	-j N	Search N files at a time (0: one per CPU)") \
 
 #define grep_example_usage \
        "$ grep root /etc/passwd\n" \
@@ -2622,6 +2661,12 @@
      "\n	-c	Check sums against given list" \
      "\n	-s	Don't output anything, status code shows success" \
      "\n	-w	Warn about improperly formatted checksum lines" \
+	) \
+	IF_FEATURE_MD5_SHA1_SUM_JOBS( \
+	IF_NOT_FEATURE_MD5_SHA1_SUM_CHECK( "\n" \
+     "\nOptions:" \
+	) \
+     "\n	-j N	Hash N files in parallel" \
 	)
 
 #define md5sum_example_usage \
@@ -2644,6 +2689,12 @@
      "\n	-c	Check sums against given list" \
      "\n	-s	Don't output anything, status code shows success" \
      "\n	-w	Warn about improperly formatted checksum lines" \
+	) \
+	IF_FEATURE_MD5_SHA1_SUM_JOBS( \
+	IF_NOT_FEATURE_MD5_SHA1_SUM_CHECK( "\n" \
+     "\nOptions:" \
+	) \
+     "\n	-j N	Hash N files in parallel" \
 	)
 
 #define sha256sum_trivial_usage \
@@ -2656,6 +2707,12 @@
      "\n	-c	Check sums against given list" \
      "\n	-s	Don't output anything, status code shows success" \
      "\n	-w	Warn about improperly formatted checksum lines" \
+	) \
+	IF_FEATURE_MD5_SHA1_SUM_JOBS( \
+	IF_NOT_FEATURE_MD5_SHA1_SUM_CHECK( "\n" \
+     "\nOptions:" \
+	) \
+     "\n	-j N	Hash N files in parallel" \
 	)
 
 #define sha512sum_trivial_usage \
@@ -2668,6 +2725,12 @@
      "\n	-c	Check sums against given list" \
      "\n	-s	Don't output anything, status code shows success" \
      "\n	-w	Warn about improperly formatted checksum lines" \
+	) \
+	IF_FEATURE_MD5_SHA1_SUM_JOBS( \
+	IF_NOT_FEATURE_MD5_SHA1_SUM_CHECK( "\n" \
+     "\nOptions:" \
+	) \
+     "\n	-j N	Hash N files in parallel" \
 	)
 
 #define mdev_trivial_usage \
@@ -4045,6 +4108,7 @@
 #define sort_trivial_usage \
        "[-nru" \
 	IF_FEATURE_SORT_BIG("gMcszbdfimSTokt] [-o FILE] [-k start[.offset][opts][,end[.offset][opts]] [-t CHAR") \
+	IF_FEATURE_SORT_EXTERNAL("] [-S SIZE] [-T DIR") \
        "] [FILE]..."
 #define sort_full_usage "\n\n" \
        "Sort lines of text\n" \
@@ -4072,7 +4136,12 @@
      "\n	-u	Suppress duplicate lines" \
 	IF_FEATURE_SORT_BIG( \
      "\n	-z	Lines are terminated by NUL, not newline" \
+	IF_NOT_FEATURE_SORT_EXTERNAL( \
      "\n	-mST	Ignored for GNU compatibility") \
+	IF_FEATURE_SORT_EXTERNAL( \
+     "\n	-S SIZE	Use at most SIZE memory (k,M,G), spill to temporary files" \
+     "\n	-T DIR	Temporary files in DIR" \
+     "\n	-m	Ignored for GNU compatibility")) \
 
 #define sort_example_usage \
        "$ echo -e \"e\\nf\\nb\\nd\\nc\\na\" | sort\n" \
@@ -4408,7 +4477,9 @@
 #define tar_trivial_usage \
        "-[" IF_FEATURE_TAR_CREATE("c") "xt" IF_FEATURE_SEAMLESS_GZ("z") \
 	IF_FEATURE_SEAMLESS_BZ2("j") IF_FEATURE_SEAMLESS_LZMA("a") \
-	IF_FEATURE_SEAMLESS_Z("Z") IF_FEATURE_TAR_NOPRESERVE_TIME("m") "vO] " \
+	IF_FEATURE_SEAMLESS_XZ("J") \
+	IF_FEATURE_SEAMLESS_Z("Z") IF_FEATURE_TAR_NOPRESERVE_TIME("m") \
+	IF_FEATURE_TAR_CREATE(IF_FEATURE_TAR_SPARSE("S")) "vO] " \
 	IF_FEATURE_TAR_FROM("[-X FILE] ") \
        "[-f TARFILE] [-C DIR] [FILE]..."
 #define tar_full_usage "\n\n" \
@@ -4430,6 +4501,9 @@
 	) \
 	IF_FEATURE_SEAMLESS_LZMA( \
      "\n	a	Filter the archive through lzma" \
+	) \
+	IF_FEATURE_SEAMLESS_XZ( \
+     "\n	J	Filter the archive through xz" \
 	) \
 	IF_FEATURE_SEAMLESS_Z( \
      "\n	Z	Filter the archive through compress" \
@@ -4440,6 +4514,9 @@
      "\nFile selection:" \
      "\n	f	Name of TARFILE or \"-\" for stdin" \
      "\n	O	Extract to stdout" \
+	IF_FEATURE_TAR_CREATE(IF_FEATURE_TAR_SPARSE( \
+     "\n	S	Store holes of sparse files" \
+	)) \
 	IF_FEATURE_TAR_FROM( \
 	IF_FEATURE_TAR_LONG_OPTIONS( \
      "\n	exclude	File to exclude" \
@@ -4448,6 +4525,12 @@
 	) \
      "\n	C	Change to DIR before operation" \
      "\n	v	Verbose" \
+	IF_FEATURE_TAR_JOBS( \
+     "\n	jobs N	Extract files in N processes" \
+	) \
+	IF_FEATURE_TAR_INDEX( \
+     "\n	index FILE Offsets of members, made if missing (can be the .tar.gz)" \
+	) \
 
 #define tar_example_usage \
        "$ zcat /tmp/tarball.tar.gz | tar -xf -\n" \
@@ -4918,7 +5001,7 @@
 	)
 
 #define uniq_trivial_usage \
-       "[-fscduw]... [INPUT [OUTPUT]]"
+       "[-fscduw" IF_FEATURE_UNIQ_HASH("H] [-S SIZE") "]... [INPUT [OUTPUT]]"
 #define uniq_full_usage "\n\n" \
        "Discard duplicate lines\n" \
      "\nOptions:" \
@@ -4928,6 +5011,10 @@
      "\n	-f N	Skip first N fields" \
      "\n	-s N	Skip first N chars (after any skipped fields)" \
      "\n	-w N	Compare N characters in line" \
+	IF_FEATURE_UNIQ_HASH( \
+     "\n	-H	Duplicates need not be adjacent, keep first-seen order" \
+     "\n	-S SIZE	With -H, use at most SIZE memory (k,M,G)" \
+	) \
 
 #define uniq_example_usage \
        "$ echo -e \"a\\na\\nb\\nc\\nc\\na\" | sort | uniq\n" \
@@ -4947,6 +5034,9 @@
      "\n	-q	Quiet" \
      "\n	-x	Exclude these files" \
      "\n	-d	Extract files into this directory" \
+	IF_FEATURE_UNZIP_PARALLEL( \
+     "\n	-T N	Use N workers (0: one per CPU)" \
+	) \
 
 #define uptime_trivial_usage \
        ""
@@ -67,10 +67,58 @@ static int ask_and_unlink(const char *dest, int flags)
 	return 1; /* ok (to try again) */
 }
 
+#if ENABLE_FEATURE_CP_JOBS
+/* With copy_file_jobs(N), data of regular files is copied by up to N
+ * child processes. Everything that changes directories (creating
+ * files, links and subdirectories, fixing up directory modes and times)
+ * is still done here, in order: a child only fills in a file we have
+ * already created and then sets its mode, owner and times. Hardlinks
+ * to a file can be made before its data is there. */
+static unsigned copy_jobs_max;
+static unsigned copy_jobs_running;
+static smallint copy_jobs_failed;
+/* Running copies, oldest first from copy_job_head, in a ring */
+static pid_t *copy_job_pid;
+static unsigned copy_job_head;
+
+void FAST_FUNC copy_file_jobs(unsigned n)
+{
+	copy_jobs_max = n;
+	copy_job_pid = xzalloc(n * sizeof(copy_job_pid[0]));
+}
+
+/* Wait for the oldest copy. Not with wait(): cp -R has tree walk
+ * helpers (treewalk_prefetch_start) too, which are killed by pid
+ * when the walk is done, and must not be reaped before */
+static void reap_copy_job(void)
+{
+	pid_t pid = copy_job_pid[copy_job_head];
+	int status;
+
+	copy_job_head = (copy_job_head + 1) % copy_jobs_max;
+	copy_jobs_running--;
+	if (safe_waitpid(pid, &status, 0) < 0
+	 || !WIFEXITED(status) || WEXITSTATUS(status) != 0
+	) {
+		copy_jobs_failed = 1;
+	}
+}
+
+/* Wait for all copies, return -1 if any of them failed */
+int FAST_FUNC copy_file_wait_jobs(void)
+{
+	while (copy_jobs_running)
+		reap_copy_job();
+	return copy_jobs_failed ? -1 : 0;
+}
+#endif
+
 /* Return:
  * -1 error, copy not made
  *  0 copy is made or user answered "no" in interactive mode
  *    (failures to preserve mode/owner/times are not reported in exit code)
+ * With copy_file_jobs(), errors while copying data show up only
+ * in copy_file_wait_jobs().
  */
 int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 {
@@ -81,6 +129,9 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 	signed char retval = 0;
 	signed char dest_exists = 0;
 	signed char ovr;
+#if ENABLE_FEATURE_CP_JOBS
+	smallint is_job = 0;
+#endif
 
 /* Inverse of cp -d ("cp without -d") */
 #define FLAGS_DEREF (flags & (FILEUTILS_DEREFERENCE + FILEUTILS_DEREFERENCE_L0))
@@ -128,9 +179,9 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 #endif
 
 	if (S_ISDIR(source_stat.st_mode)) {
-		DIR *dp;
+		char **names;
+		unsigned i;
 		const char *tp;
-		struct dirent *d;
 		mode_t saved_umask = 0;
 
 		if (!(flags & FILEUTILS_RECUR)) {
@@ -180,26 +231,25 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 		 * NULL: name is not remembered */
 		add_to_ino_dev_hashtable(&dest_stat, NULL);
 
-		/* Recursively copy files in SOURCE */
-		dp = opendir(source);
-		if (dp == NULL) {
+		/* Recursively copy files in SOURCE, in inode order */
+		names = read_dir_by_inode(source);
+		if (names == NULL) {
 			retval = -1;
 			goto preserve_mode_ugid_time;
 		}
 
-		while ((d = readdir(dp)) != NULL) {
+		for (i = 0; names[i]; i++) {
 			char *new_source, *new_dest;
 
-			new_source = concat_subpath_file(source, d->d_name);
-			if (new_source == NULL)
-				continue;
-			new_dest = concat_path_file(dest, d->d_name);
+			new_source = concat_path_file(source, names[i]);
+			new_dest = concat_path_file(dest, names[i]);
 			if (copy_file(new_source, new_dest, flags & ~FILEUTILS_DEREFERENCE_L0) < 0)
 				retval = -1;
 			free(new_source);
 			free(new_dest);
+			free(names[i]);
 		}
-		closedir(dp);
+		free(names);
 
 		if (!dest_exists
 		 && chmod(dest, source_stat.st_mode & ~saved_umask) < 0
@@ -313,6 +363,31 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 				freecon(con);
 			}
 		}
+#endif
+#if ENABLE_FEATURE_CP_JOBS
+		if (copy_jobs_max > 1 && S_ISREG(source_stat.st_mode)) {
+			pid_t pid;
+
+			if (copy_jobs_running >= copy_jobs_max)
+				reap_copy_job();
+			pid = fork();
+			if (pid > 0) {
+				copy_job_pid[(copy_job_head + copy_jobs_running) % copy_jobs_max] = pid;
+				copy_jobs_running++;
+				close(dst_fd);
+				close(src_fd);
+				return 0;
+			}
+			/* pid < 0: copy it ourself */
+			if (pid == 0)
+				is_job = 1;
+		}
+#endif
+#if ENABLE_FEATURE_CP_SPARSE
+		if (flags & (FILEUTILS_SPARSE | FILEUTILS_SPARSE_ZEROES)) {
+			if (bb_copyfd_sparse(src_fd, dst_fd, flags & FILEUTILS_SPARSE_ZEROES) == -1)
+				retval = -1;
+		} else
 #endif
 		if (bb_copyfd_eof(src_fd, dst_fd) == -1)
 			retval = -1;
@@ -389,5 +464,9 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 			bb_perror_msg("can't preserve %s of '%s'", "permissions", dest);
 	}
 
+#if ENABLE_FEATURE_CP_JOBS
+	if (is_job)
+		_exit(retval < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+#endif
 	return retval;
 }
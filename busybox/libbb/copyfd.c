@@ -8,9 +8,121 @@
  */
 
 #include "libbb.h"
+#if ENABLE_FEATURE_COPYFD_ZEROCOPY
+# include <sys/sendfile.h>
+# include <sys/syscall.h>
+#endif
 
 /* Used by NOFORK applets (e.g. cat) - must not use xmalloc */
 
+#if ENABLE_FEATURE_COPYFD_ZEROCOPY
+enum {
+	ZC_CHUNK = 64 * 1024, /* pipe capacity */
+	ZC_MAX = 0x7ffff000, /* most the kernel moves in one go */
+};
+
+static ssize_t copy_range(int src_fd, int dst_fd, size_t count)
+{
+#ifdef __NR_copy_file_range
+	return syscall(__NR_copy_file_range, src_fd, NULL, dst_fd, NULL, count, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* Move data out of an intermediate pipe when dst_fd turned out
+ * not to support splice */
+static int drain_pipe(int pipe_fd, int dst_fd, size_t count)
+{
+	char buf[4 * 1024];
+
+	while (count) {
+		ssize_t rd = safe_read(pipe_fd, buf, count > sizeof(buf) ? sizeof(buf) : count);
+		if (rd <= 0 || full_write(dst_fd, buf, rd) != rd)
+			return -1;
+		count -= rd;
+	}
+	return 0;
+}
+
+/* Copy up to size bytes (0: until EOF) with the data staying in the
+ * kernel: copy_file_range between regular files, sendfile from a file
+ * to a socket, splice when either end is a pipe (or through a pipe
+ * of our own when reading a socket). File offsets move as with
+ * read/write. Returns the number of bytes copied, which may be short:
+ * it stops at the first EOF, error or unsupported case, and the
+ * read/write loop goes on from there (and reports real errors).
+ * Only returns -1 after having reported an error it can't hand over. */
+static off_t zero_copy(int src_fd, int dst_fd, off_t size)
+{
+	struct stat src_st, dst_st;
+	off_t total = 0;
+	int pfd[2] = { -1, -1 };
+	smallint how;
+	enum { COPY_RANGE, SENDFILE, SPLICE, SPLICE_PIPE };
+
+	if (fstat(src_fd, &src_st) != 0 || fstat(dst_fd, &dst_st) != 0)
+		return 0;
+	if (S_ISREG(src_st.st_mode) && S_ISREG(dst_st.st_mode))
+		how = COPY_RANGE;
+	else if (S_ISFIFO(src_st.st_mode) || S_ISFIFO(dst_st.st_mode))
+		how = SPLICE;
+	else if (S_ISREG(src_st.st_mode) && S_ISSOCK(dst_st.st_mode))
+		how = SENDFILE;
+	else if (S_ISSOCK(src_st.st_mode)) {
+		if (pipe(pfd) != 0)
+			return 0;
+		how = SPLICE_PIPE;
+	} else
+		return 0;
+
+	while (!size || total < size) {
+		size_t count = (how >= SPLICE) ? ZC_CHUNK : ZC_MAX;
+		ssize_t n;
+
+		if (size && size - total < (off_t)count)
+			count = size - total;
+		if (how == COPY_RANGE)
+			n = copy_range(src_fd, dst_fd, count);
+		else if (how == SENDFILE)
+			n = sendfile(dst_fd, src_fd, NULL, count);
+		else if (how == SPLICE)
+			n = splice(src_fd, NULL, dst_fd, NULL, count, SPLICE_F_MOVE | SPLICE_F_MORE);
+		else {
+			n = splice(src_fd, NULL, pfd[1], NULL, count, SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (n > 0) {
+				ssize_t left = n;
+				while (left) {
+					ssize_t wr = splice(pfd[0], NULL, dst_fd, NULL, left, SPLICE_F_MOVE | SPLICE_F_MORE);
+					if (wr <= 0) {
+						if (drain_pipe(pfd[0], dst_fd, left) != 0) {
+							bb_perror_msg(bb_msg_write_error);
+							total = -1;
+							goto out;
+						}
+						/* and don't splice into dst_fd again */
+						total += left;
+						goto out;
+					}
+					left -= wr;
+				}
+			}
+		}
+		/* EOF is confirmed (and errors reported) by the caller */
+		if (n <= 0)
+			break;
+		total += n;
+	}
+ out:
+	if (pfd[0] >= 0) {
+		close(pfd[0]);
+		close(pfd[1]);
+	}
+	return total;
+}
+#endif
+
 static off_t bb_full_fd_action(int src_fd, int dst_fd, off_t size)
 {
 	int status = -1;
@@ -38,6 +150,22 @@ static off_t bb_full_fd_action(int src_fd, int dst_fd, off_t size)
 	if (src_fd < 0)
 		goto out;
 
+#if ENABLE_FEATURE_COPYFD_ZEROCOPY
+	/* dst_fd == -1 is a fake, nothing to copy to */
+	if (dst_fd >= 0) {
+		total = zero_copy(src_fd, dst_fd, size);
+		if (total < 0)
+			goto out;
+		if (size) {
+			size -= total;
+			if (!size) {
+				status = 0;
+				goto out;
+			}
+		}
+	}
+#endif
+
 	if (!size) {
 		size = buffer_size;
 		status = 1; /* copy until eof */
@@ -0,0 +1,131 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Utility routines.
+ *
+ * Licensed under GPLv2 or later, see file LICENSE in this tarball for details.
+ */
+
+#include "libbb.h"
+
+/* Not in copyfd.c: these allocate and die, NOFORK applets can't use them */
+
+/* Without SEEK_DATA support in the kernel or filesystem,
+ * everything up to end is one data region */
+off_t FAST_FUNC bb_find_data(int fd, off_t *start, off_t end)
+{
+	off_t data, hole;
+
+	data = lseek(fd, *start, SEEK_DATA);
+	if (data < 0) {
+		/* ENXIO: only a hole is left */
+		if (errno == ENXIO)
+			*start = end;
+		return end;
+	}
+	*start = data;
+	hole = lseek(fd, data, SEEK_HOLE);
+	if (hole < 0 || hole > end)
+		hole = end;
+	return hole;
+}
+
+static int is_all_zero(const char *buf, size_t len)
+{
+	return buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0;
+}
+
+/* Copy size bytes, seeking dst_fd over 4k blocks of zeroes.
+ * *hole tells whether the last block was skipped */
+static off_t copy_zeroes_as_holes(int src_fd, int dst_fd, off_t size, smallint *hole)
+{
+	enum { BLK = 4 * 1024, BUFSIZE = 64 * 1024 };
+	char *buf = xmalloc(BUFSIZE);
+	off_t total = 0;
+
+	while (size) {
+		ssize_t rd, ofs, run;
+
+		rd = safe_read(src_fd, buf, size > BUFSIZE ? BUFSIZE : size);
+		if (rd <= 0) {
+			if (rd < 0) {
+				bb_perror_msg(bb_msg_read_error);
+				total = -1;
+			}
+			break;
+		}
+		/* Write runs of non-zero blocks at once */
+		for (ofs = run = 0; ofs < rd; ofs += BLK) {
+			ssize_t len = MIN(BLK, rd - ofs);
+
+			if (!is_all_zero(buf + ofs, len))
+				continue;
+			if (ofs > run && full_write(dst_fd, buf + run, ofs - run) != ofs - run)
+				goto write_err;
+			if (lseek(dst_fd, len, SEEK_CUR) < 0)
+				goto write_err;
+			run = ofs + len;
+		}
+		*hole = (run == rd);
+		if (rd > run && full_write(dst_fd, buf + run, rd - run) != rd - run)
+			goto write_err;
+		total += rd;
+		size -= rd;
+	}
+	free(buf);
+	return total;
+ write_err:
+	bb_perror_msg(bb_msg_write_error);
+	free(buf);
+	return -1;
+}
+
+off_t FAST_FUNC bb_copyfd_sparse(int src_fd, int dst_fd, int zeroes)
+{
+	struct stat st;
+	off_t pos, end, total;
+	smallint hole;
+
+	if (fstat(dst_fd, &st) != 0 || !S_ISREG(st.st_mode)
+	 || fstat(src_fd, &st) != 0 || !S_ISREG(st.st_mode)
+	 || (pos = lseek(src_fd, 0, SEEK_CUR)) < 0
+	) {
+		return bb_copyfd_eof(src_fd, dst_fd);
+	}
+	end = st.st_size;
+	total = 0;
+	hole = 0;
+	while (pos < end) {
+		off_t data = pos;
+		off_t data_end = bb_find_data(src_fd, &data, end);
+		off_t n;
+
+		if (data > pos) {
+			if (lseek(dst_fd, data - pos, SEEK_CUR) < 0)
+				goto write_err;
+			hole = 1;
+			total += data - pos;
+		}
+		if (data >= end)
+			break;
+		xlseek(src_fd, data, SEEK_SET);
+		if (zeroes) {
+			n = copy_zeroes_as_holes(src_fd, dst_fd, data_end - data, &hole);
+		} else {
+			n = bb_copyfd_size(src_fd, dst_fd, data_end - data);
+			hole = 0;
+		}
+		if (n < 0)
+			return n;
+		total += n;
+		if (n != data_end - data) /* file shrank */
+			break;
+		pos = data_end;
+	}
+	/* Holes at the end don't make the file longer by themselves */
+	if (hole && ftruncate(dst_fd, lseek(dst_fd, 0, SEEK_CUR)) < 0)
+		goto write_err;
+	return total;
+ write_err:
+	bb_perror_msg(bb_msg_write_error);
+	return -1;
+}
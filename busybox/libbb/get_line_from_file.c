@@ -31,10 +31,11 @@ char* FAST_FUNC bb_get_chunk_with_continuation(FILE *file, int *end, int *lineno
 	char *linebuf = NULL;
 	int linebufsz = 0;
 
-	while ((ch = getc(file)) != EOF) {
+	/* We are not threaded, don't lock the FILE for every char */
+	while ((ch = getc_unlocked(file)) != EOF) {
 		/* grow the line buffer as necessary */
 		if (idx >= linebufsz) {
-			linebufsz += 256;
+			linebufsz = linebufsz * 2 + 256;
 			linebuf = xrealloc(linebuf, linebufsz);
 		}
 		linebuf[idx++] = (char) ch;
@@ -88,6 +89,121 @@ char* FAST_FUNC xmalloc_fgetline(FILE *file)
 	return c;
 }
 
+/* Line reader: reads fd in big chunks and hands out lines from its
+ * buffer, without a malloc per line. As with bb_get_chunk_from_file,
+ * a line ends at lr->delim ('\n' unless caller changes it) or at
+ * a NUL byte, so callers can treat it as a C string.
+ *
+ * The line is NUL terminated (in place of delimiter) and stays valid until
+ * the next line_reader_get(), callers which keep it use line_reader_xdup().
+ * If lineno is not NULL, *lineno is incremented for each line,
+ * and trailing '\' is recognized as line continuation.
+ *
+ * Returns NULL on EOF or read error (lr->error is set then). */
+enum { LINE_READER_BUFSIZE = 32 * 1024 };
+
+line_reader_t* FAST_FUNC line_reader_new(int fd)
+{
+	line_reader_t *lr = xzalloc(sizeof(*lr));
+	lr->fd = fd;
+	lr->delim = '\n';
+	lr->size = LINE_READER_BUFSIZE;
+	lr->buf = xmalloc(LINE_READER_BUFSIZE);
+	return lr;
+}
+
+/* Read more after what is in the buffer, which may move.
+ * Returns 0 at EOF or error */
+int FAST_FUNC line_reader_fill(line_reader_t *lr)
+{
+	char *buf = lr->buf;
+	ssize_t r;
+
+	/* Make room: drop consumed lines, or grow */
+	if (lr->start != 0) {
+		lr->end -= lr->start;
+		lr->scan -= lr->start;
+		memmove(buf, buf + lr->start, lr->end);
+		lr->start = 0;
+	}
+	if (lr->size - lr->end < LINE_READER_BUFSIZE / 2) {
+		lr->size *= 2;
+		lr->buf = buf = xrealloc(buf, lr->size);
+	}
+	r = safe_read(lr->fd, buf + lr->end, lr->size - 1 - lr->end);
+	if (r <= 0) {
+		if (r < 0)
+			lr->error = 1;
+		lr->eof = 1;
+		return 0;
+	}
+	lr->end += r;
+	return r;
+}
+
+char* FAST_FUNC line_reader_get(line_reader_t *lr, int *lineno)
+{
+	char *buf = lr->buf;
+	char *nl;
+
+	for (;;) {
+		char *nul;
+
+		nl = memchr(buf + lr->scan, lr->delim, lr->end - lr->scan);
+		nul = memchr(buf + lr->scan, '\0', (nl ? nl : buf + lr->end) - (buf + lr->scan));
+		if (nul) {
+			nl = nul;
+			break;
+		}
+		if (nl) {
+			if (lineno) {
+				(*lineno)++;
+				if (nl > buf + lr->start && nl[-1] == '\\') {
+					/* Drop backslash-newline: move what we have
+					 * of the line up to the next line */
+					unsigned len = nl - 1 - (buf + lr->start);
+					memmove(buf + lr->start + 2, buf + lr->start, len);
+					lr->start += 2;
+					lr->scan = nl + 1 - buf;
+					continue;
+				}
+			}
+			break;
+		}
+		lr->scan = lr->end;
+		if (lr->eof) {
+			if (lr->start == lr->end)
+				return NULL;
+			/* Last line has no '\n', we kept a byte for NUL */
+			nl = buf + lr->end;
+			break;
+		}
+		line_reader_fill(lr);
+		buf = lr->buf;
+	}
+	*nl = '\0';
+	lr->line = buf + lr->start;
+	lr->len = nl - lr->line;
+	lr->start = lr->scan = (lr->end == nl - buf) ? lr->end : nl + 1 - buf;
+	return lr->line;
+}
+
+/* Copy of the last line, to keep */
+char* FAST_FUNC line_reader_xdup(line_reader_t *lr)
+{
+	char *s = xmalloc(lr->len + 1);
+	memcpy(s, lr->line, lr->len + 1);
+	return s;
+}
+
+void FAST_FUNC line_reader_free(line_reader_t *lr)
+{
+	if (lr) {
+		free(lr->buf);
+		free(lr);
+	}
+}
+
 #if 0
 /* GNUism getline() should be faster (not tested) than a loop with fgetc */
 
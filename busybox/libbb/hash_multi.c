@@ -0,0 +1,83 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Utility routines.
+ *
+ * Multi-buffer driver for md5_hash_multi() and sha1_hash_multi().
+ *
+ * Licensed under GPLv2 or later, see file LICENSE in this tarball for details.
+ */
+
+#include "libbb.h"
+
+/* Feed len[i] bytes of data[i] to ctx[i], i < n. Messages go HASH_LANES
+ * at a time: what was buffered is topped up to a whole block, then whole
+ * blocks go through lanes() while two or more messages have some (spare
+ * lanes hash junk), and the tail goes back to ops->hash().
+ * With lanes == NULL it all goes to ops->hash(). */
+void FAST_FUNC hash_multi(void *ctx[], const void *data[], const size_t len[], unsigned n,
+		hash_lanes_fn *lanes, const struct hash_multi_ops *ops)
+{
+	unsigned base, i;
+
+#define STATE(c) ((uint32_t *)((char *)(c) + ops->state_ofs))
+#define TOTAL(c) (*(uint64_t *)((char *)(c) + ops->total_ofs))
+	for (base = 0; base < n; base += HASH_LANES) {
+		uint32_t *hash[HASH_LANES];
+		const uint8_t *p[HASH_LANES];
+		const uint8_t *lp[HASH_LANES];
+		size_t left[HASH_LANES];
+		uint32_t dummy[HASH_LANES][8];
+		unsigned m = MIN(n - base, HASH_LANES);
+
+		for (i = 0; i < m; i++) {
+			void *c = ctx[base + i];
+			unsigned in_buf = TOTAL(c) & 63;
+
+			p[i] = data[base + i];
+			left[i] = len[base + i];
+			if (in_buf) {
+				unsigned k = MIN(left[i], 64 - in_buf);
+				ops->hash(p[i], k, c);
+				p[i] += k;
+				left[i] -= k;
+			}
+		}
+
+		while (lanes) {
+			size_t nblocks = (size_t)-1;
+			unsigned active = 0, first = 0;
+
+			for (i = 0; i < m; i++) {
+				if (left[i] >= 64) {
+					if (!active++)
+						first = i;
+					nblocks = MIN(nblocks, left[i] / 64);
+				}
+			}
+			if (active < 2)
+				break;
+			for (i = 0; i < HASH_LANES; i++) {
+				if (i < m && left[i] >= 64) {
+					hash[i] = STATE(ctx[base + i]);
+					lp[i] = p[i];
+				} else {
+					hash[i] = dummy[i];
+					lp[i] = p[first];
+				}
+			}
+			lanes(hash, lp, nblocks);
+			for (i = 0; i < m; i++) {
+				if (left[i] >= 64) {
+					p[i] += nblocks * 64;
+					left[i] -= nblocks * 64;
+					TOTAL(ctx[base + i]) += nblocks * 64;
+				}
+			}
+		}
+
+		for (i = 0; i < m; i++)
+			ops->hash(p[i], left[i], ctx[base + i]);
+	}
+#undef STATE
+#undef TOTAL
+}
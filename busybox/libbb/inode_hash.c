@@ -10,18 +10,89 @@
 
 #include "libbb.h"
 
-typedef struct ino_dev_hash_bucket_struct {
-	struct ino_dev_hash_bucket_struct *next;
+/*
+ * Open addressing with linear probing. The table doubles when it gets
+ * 3/4 full, so lookups stay short however many files du or cp -a see.
+ * Names are packed into big chunks, which never move: pointers handed
+ * out by is_in_ino_dev_hashtable() stay valid until the reset.
+ */
+typedef struct ino_dev_hash_slot {
 	ino_t ino;
 	dev_t dev;
-	char name[1];
-} ino_dev_hashtable_bucket_t;
+	char *name; /* NULL: free slot */
+} ino_dev_hash_slot_t;
+
+typedef struct name_chunk {
+	struct name_chunk *next;
+	char data[1];
+} name_chunk_t;
+
+#define INITIAL_SIZE	256	/* Must be a power of 2 */
+#define CHUNK_SIZE	(16 * 1024)
 
-#define HASH_SIZE	311		/* Should be prime */
-#define hash_inode(i)	((i) % HASH_SIZE)
+static struct {
+	ino_dev_hash_slot_t *slot;
+	unsigned mask; /* size - 1 */
+	unsigned used;
+	name_chunk_t *chunks;
+	char *arena;
+	unsigned arena_left;
+} ino_dev_hashtable;
 
-/* array of [HASH_SIZE] elements */
-static ino_dev_hashtable_bucket_t **ino_dev_hashtable;
+#define T ino_dev_hashtable
+
+static unsigned hash_inode(ino_t ino, dev_t dev)
+{
+	uint64_t h = ((uint64_t)ino ^ ((uint64_t)dev << 32 | (uint64_t)dev >> 32))
+			* 0x9e3779b97f4a7c15ULL;
+	return h >> 32 ^ h;
+}
+
+static ino_dev_hash_slot_t *find_slot(ino_t ino, dev_t dev)
+{
+	unsigned i = hash_inode(ino, dev);
+
+	for (;;) {
+		ino_dev_hash_slot_t *s = &T.slot[i & T.mask];
+		if (!s->name || (s->ino == ino && s->dev == dev))
+			return s;
+		i++;
+	}
+}
+
+static void grow_table(void)
+{
+	ino_dev_hash_slot_t *old = T.slot;
+	unsigned old_size = old ? T.mask + 1 : 0;
+	unsigned i;
+
+	T.mask = old ? T.mask * 2 + 1 : INITIAL_SIZE - 1;
+	T.slot = xzalloc((T.mask + 1) * sizeof(T.slot[0]));
+	for (i = 0; i < old_size; i++) {
+		if (old[i].name)
+			*find_slot(old[i].ino, old[i].dev) = old[i];
+	}
+	free(old);
+}
+
+static char *store_name(const char *name)
+{
+	unsigned len = strlen(name) + 1;
+
+	if (len == 1)
+		return (char*)"";
+	if (len > T.arena_left) {
+		unsigned size = MAX(len, CHUNK_SIZE);
+		name_chunk_t *c = xmalloc(sizeof(*c) + size);
+		c->next = T.chunks;
+		T.chunks = c;
+		T.arena = c->data;
+		T.arena_left = size;
+	}
+	T.arena_left -= len;
+	T.arena += len;
+	return memcpy(T.arena - len, name, len);
+}
 
 /*
  * Return name if statbuf->st_ino && statbuf->st_dev are recorded in
@@ -29,59 +100,42 @@ static ino_dev_hashtable_bucket_t **ino_dev_hashtable;
  */
 char* FAST_FUNC is_in_ino_dev_hashtable(const struct stat *statbuf)
 {
-	ino_dev_hashtable_bucket_t *bucket;
-
-	if (!ino_dev_hashtable)
+	if (!T.slot)
 		return NULL;
 
-	bucket = ino_dev_hashtable[hash_inode(statbuf->st_ino)];
-	while (bucket != NULL) {
-		if ((bucket->ino == statbuf->st_ino)
-		 && (bucket->dev == statbuf->st_dev)
-		) {
-			return bucket->name;
-		}
-		bucket = bucket->next;
-	}
-	return NULL;
+	return find_slot(statbuf->st_ino, statbuf->st_dev)->name;
 }
 
 /* Add statbuf to statbuf hash table */
 void FAST_FUNC add_to_ino_dev_hashtable(const struct stat *statbuf, const char *name)
 {
-	int i;
-	ino_dev_hashtable_bucket_t *bucket;
+	ino_dev_hash_slot_t *s;
 
-	i = hash_inode(statbuf->st_ino);
 	if (!name)
 		name = "";
-	bucket = xmalloc(sizeof(ino_dev_hashtable_bucket_t) + strlen(name));
-	bucket->ino = statbuf->st_ino;
-	bucket->dev = statbuf->st_dev;
-	strcpy(bucket->name, name);
-
-	if (!ino_dev_hashtable)
-		ino_dev_hashtable = xzalloc(HASH_SIZE * sizeof(*ino_dev_hashtable));
+	if (!T.slot || T.used >= (T.mask + 1) / 4 * 3)
+		grow_table();
 
-	bucket->next = ino_dev_hashtable[i];
-	ino_dev_hashtable[i] = bucket;
+	s = find_slot(statbuf->st_ino, statbuf->st_dev);
+	if (!s->name)
+		T.used++;
+	/* A re-added inode gets the new name, as the most recent
+	 * entry used to shadow older ones in the chained table */
+	s->ino = statbuf->st_ino;
+	s->dev = statbuf->st_dev;
+	s->name = store_name(name);
 }
 
 #if ENABLE_DU || ENABLE_FEATURE_CLEAN_UP
 /* Clear statbuf hash table */
 void FAST_FUNC reset_ino_dev_hashtable(void)
 {
-	int i;
-	ino_dev_hashtable_bucket_t *bucket;
-
-	for (i = 0; ino_dev_hashtable && i < HASH_SIZE; i++) {
-		while (ino_dev_hashtable[i] != NULL) {
-			bucket = ino_dev_hashtable[i]->next;
-			free(ino_dev_hashtable[i]);
-			ino_dev_hashtable[i] = bucket;
-		}
+	while (T.chunks) {
+		name_chunk_t *next = T.chunks->next;
+		free(T.chunks);
+		T.chunks = next;
 	}
-	free(ino_dev_hashtable);
-	ino_dev_hashtable = NULL;
+	free(T.slot);
+	memset(&T, 0, sizeof(T));
 }
 #endif
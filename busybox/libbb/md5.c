@@ -356,8 +356,9 @@ static void md5_hash_block(const void *buffer, md5_ctx_t *ctx)
 	ctx->D = D;
 }
 
-/* Feed data through a temporary buffer to call md5_hash_aligned_block()
- * with chunks of data that are 4-byte aligned and a multiple of 64 bytes.
+/* Feed data through a temporary buffer to call md5_hash_block()
+ * with chunks of data that are 4-byte aligned and a multiple of 64 bytes
+ * (aligned input blocks are passed on directly).
  * This function's internal buffer remembers previous data until it has 64
  * bytes worth to pass on.  Call md5_end() to flush this buffer. */
 void FAST_FUNC md5_hash(const void *buffer, size_t len, md5_ctx_t *ctx)
@@ -372,6 +373,14 @@ void FAST_FUNC md5_hash(const void *buffer, size_t len, md5_ctx_t *ctx)
 	while (len) {
 		unsigned i = 64 - ctx->buflen;
 
+		/* Whole aligned blocks need no copying */
+		if (i == 64 && len >= 64 && !((uintptr_t)buf & 3)) {
+			md5_hash_block(buf, ctx);
+			buf += 64;
+			len -= 64;
+			continue;
+		}
+
 		/* Copy data into aligned buffer. */
 		if (i > len) i = len;
 		memcpy(ctx->buffer + ctx->buflen, buf, i);
@@ -387,6 +396,136 @@ void FAST_FUNC md5_hash(const void *buffer, size_t len, md5_ctx_t *ctx)
 	}
 }
 
+#if ENABLE_HASH_MULTIBUF
+/*
+ * Multi-buffer hashing: HASH_LANES independent messages are hashed
+ * side by side, one per 32-bit lane of a vector (see also sha1.c).
+ */
+typedef uint32_t lane_t __attribute__((vector_size(HASH_LANES * 4)));
+
+static ALWAYS_INLINE void load_le_lanes(lane_t *v, const uint8_t *const *data, unsigned ofs)
+{
+	unsigned i;
+
+	for (i = 0; i < HASH_LANES; i++) {
+		uint32_t w;
+		move_from_unaligned32(w, data[i] + ofs);
+		(*v)[i] = SWAP_LE32(w);
+	}
+}
+
+static ALWAYS_INLINE void md5_lanes(uint32_t **hash, const uint8_t **data, size_t nblocks)
+{
+	static const uint32_t C_array[] = {
+		0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+		0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+		0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+		0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+		0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+		0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+		0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+		0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+		0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+		0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+		0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+		0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+		0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+		0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+		0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+		0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+	};
+	static const char P_array[] ALIGN1 = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		1, 6, 11, 0, 5, 10, 15, 4, 9, 14, 3, 8, 13, 2, 7, 12,
+		5, 8, 11, 14, 1, 4, 7, 10, 13, 0, 3, 6, 9, 12, 15, 2,
+		0, 7, 14, 5, 12, 3, 10, 1, 8, 15, 6, 13, 4, 11, 2, 9
+	};
+	static const char S_array[] ALIGN1 = {
+		7, 12, 17, 22,
+		5, 9, 14, 20,
+		4, 11, 16, 23,
+		6, 10, 15, 21
+	};
+	lane_t A, B, C, D, X[16];
+	unsigned i;
+
+	for (i = 0; i < HASH_LANES; i++) {
+		A[i] = hash[i][0];
+		B[i] = hash[i][1];
+		C[i] = hash[i][2];
+		D[i] = hash[i][3];
+	}
+	while (nblocks--) {
+		lane_t A_save = A, B_save = B, C_save = C, D_save = D;
+
+		for (i = 0; i < 16; i++)
+			load_le_lanes(&X[i], data, i * 4);
+#define OP(f) \
+	do { \
+		lane_t temp = A + (f) + X[(int)P_array[i]] + C_array[i]; \
+		unsigned s = S_array[(i >> 2 & ~3) + (i & 3)]; \
+		temp = ((temp << s) | (temp >> (32 - s))) + B; \
+		A = D; \
+		D = C; \
+		C = B; \
+		B = temp; \
+	} while (0)
+		for (i = 0; i < 16; i++)
+			OP(FF(B, C, D));
+		for (/*i = 16*/; i < 32; i++)
+			OP(FG(B, C, D));
+		for (/*i = 32*/; i < 48; i++)
+			OP(FH(B, C, D));
+		for (/*i = 48*/; i < 64; i++)
+			OP(FI(B, C, D));
+#undef OP
+		A += A_save;
+		B += B_save;
+		C += C_save;
+		D += D_save;
+		for (i = 0; i < HASH_LANES; i++)
+			data[i] += 64;
+	}
+	for (i = 0; i < HASH_LANES; i++) {
+		hash[i][0] = A[i];
+		hash[i][1] = B[i];
+		hash[i][2] = C[i];
+		hash[i][3] = D[i];
+	}
+}
+
+static void md5_lanes_generic(uint32_t **hash, const uint8_t **data, size_t nblocks)
+{
+	md5_lanes(hash, data, nblocks);
+}
+# if (defined(__i386__) || defined(__x86_64__)) \
+  && (defined(__clang__) || __GNUC__ >= 5)
+#  define MD5_AVX2 1
+static void __attribute__((target("avx2")))
+md5_lanes_avx2(uint32_t **hash, const uint8_t **data, size_t nblocks)
+{
+	md5_lanes(hash, data, nblocks);
+}
+# endif
+
+void FAST_FUNC md5_hash_multi(md5_ctx_t *ctx[], const void *data[], const size_t len[], unsigned n)
+{
+	static const struct hash_multi_ops md5_ops = {
+		(void *)md5_hash,
+		offsetof(md5_ctx_t, A), /* A-D are consecutive */
+		offsetof(md5_ctx_t, total),
+	};
+	hash_lanes_fn *lanes;
+
+	lanes = md5_lanes_generic;
+# ifdef MD5_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		lanes = md5_lanes_avx2;
+# endif
+	hash_multi((void **)ctx, data, len, n, lanes, &md5_ops);
+}
+#endif
+
 /* Process the remaining bytes in the buffer and put result from CTX
  * in first 16 bytes following RESBUF.  The result is always in little
  * endian byte order, so that a byte-wise output yields to the wanted
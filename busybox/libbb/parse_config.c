@@ -71,6 +71,7 @@ parser_t* FAST_FUNC config_open2(const char *filename, FILE* FAST_FUNC (*fopen_f
 		return NULL;
 	parser = xzalloc(sizeof(*parser));
 	parser->fp = fp;
+	parser->lr = line_reader_new(fileno(fp));
 	return parser;
 }
 
@@ -81,7 +82,7 @@ parser_t* FAST_FUNC config_open(const char *filename)
 
 static void config_free_data(parser_t *parser)
 {
-	free(parser->line);
+	/* parser->line is in parser->lr's buffer */
 	parser->line = NULL;
 	if (PARSE_KEEP_COPY) { /* compile-time constant */
 		free(parser->data);
@@ -93,6 +94,7 @@ void FAST_FUNC config_close(parser_t *parser)
 {
 	if (parser) {
 		config_free_data(parser);
+		line_reader_free(parser->lr);
 		fclose(parser->fp);
 		free(parser);
 	}
@@ -126,7 +128,7 @@ int FAST_FUNC config_read(parser_t *parser, char **tokens, unsigned flags, const
 {
 	char *line;
 	int ntokens, mintokens;
-	int t, len;
+	int t;
 
 	ntokens = flags & 0xFF;
 	mintokens = (flags & 0xFF00) >> 8;
@@ -139,15 +141,11 @@ again:
 	config_free_data(parser);
 
 	/* Read one line (handling continuations with backslash) */
-	line = bb_get_chunk_with_continuation(parser->fp, &len, &parser->lineno);
+	line = line_reader_get(parser->lr, &parser->lineno);
 	if (line == NULL)
 		return 0;
 	parser->line = line;
 
-	/* Strip trailing line-feed if any */
-	if (len && line[len-1] == '\n')
-		line[len-1] = '\0';
-
 	/* Skip token in the start of line? */
 	if (flags & PARSE_TRIM)
 		line += strspn(line, delims + 1);
@@ -10,6 +10,7 @@
 #include "libbb.h"
 
 #define ZIPPED (ENABLE_FEATURE_SEAMLESS_LZMA \
+	|| ENABLE_FEATURE_SEAMLESS_XZ \
 	|| ENABLE_FEATURE_SEAMLESS_BZ2 \
 	|| ENABLE_FEATURE_SEAMLESS_GZ \
 	/* || ENABLE_FEATURE_SEAMLESS_Z */ \
@@ -332,6 +333,21 @@ int FAST_FUNC open_zipped(const char *fname)
 			/* .lzma has no header/signature, just trust it */
 			open_transformer(fd, unpack_lzma_stream, "unlzma");
 		else
+		if (ENABLE_FEATURE_SEAMLESS_XZ && strcmp(sfx, ".xz") == 0) {
+			/* unpack_xz_stream wants the 6-byte magic skipped */
+			unsigned char xz_magic[6];
+
+			xread(fd, &xz_magic, 6);
+			if (memcmp(xz_magic, "\xfd" "7zXZ\0", 6) != 0)
+				bb_error_msg_and_die("no xz magic");
+#if !BB_MMU
+			/* NOMMU version of open_transformer execs
+			 * an external unzipper that wants
+			 * file position at the start of the file */
+			xlseek(fd, 0, SEEK_SET);
+#endif
+			open_transformer(fd, unpack_xz_stream, "unxz");
+		} else
 		if ((ENABLE_FEATURE_SEAMLESS_GZ && strcmp(sfx, ".gz") == 0)
 		 || (ENABLE_FEATURE_SEAMLESS_BZ2 && strcmp(sfx, ".bz2") == 0)
 		) {
@@ -8,6 +8,10 @@
  */
 
 #include "libbb.h"
+#include <sys/syscall.h>
+#if ENABLE_FEATURE_PARALLEL_TREEWALK
+# include <sys/prctl.h>
+#endif
 
 #undef DEBUG_RECURS_ACTION
 
@@ -51,39 +55,259 @@ static int FAST_FUNC true_action(const char *fileName UNUSED_PARAM,
  * ACTION_FOLLOWLINKS mainly controls handling of links to dirs.
  * 0: lstat(statbuf). Calls fileAction on link name even if points to dir.
  * 1: stat(statbuf). Calls dirAction and optionally recurse on link to dir.
+ *
+ * ACTION_UNORDERED: the caller doesn't care in which order the entries
+ * of a directory come. They are then visited in inode number order,
+ * which is mostly the order they lie on disk.
+ *
+ * ACTION_PARALLEL: with FEATURE_PARALLEL_TREEWALK, a few child processes
+ * walk the tree ahead of us, so that on a cold cache the disk sees many
+ * requests at once and we mostly find directories and inodes in memory.
+ * The callbacks are still called by us only, in the usual order.
+ *
+ * cp -R and rm -r have walks of their own: read_dir_by_inode() and
+ * treewalk_prefetch_start/stop() give them the same two things.
  */
 
-int FAST_FUNC recursive_action(const char *fileName,
-		unsigned flags,
-		int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
-		int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
-		void* userData,
-		unsigned depth)
+typedef struct walk_t {
+	unsigned flags;
+	int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth);
+	int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth);
+	void* userData;
+} walk_t;
+
+/* Directories are read with getdents64 straight into a big buffer */
+struct dirent64_t {
+	uint64_t d_ino;
+	int64_t  d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char     d_name[1];
+};
+enum { DENTS_BUFSIZE = 32 * 1024 };
+
+static int read_dents(int fd, char *buf)
+{
+	return syscall(__NR_getdents64, fd, buf, DENTS_BUFSIZE);
+}
+
+#define next_dent(buf, ofs) ((struct dirent64_t *)((buf) + (ofs)))
+
+#if ENABLE_FEATURE_PARALLEL_TREEWALK
+/* Touch every directory and inode under name, stat only what d_type
+ * doesn't tell. Never follows symlinks or leaves the filesystem. */
+static void prefetch_dir(int dir_fd, const char *name, dev_t dev)
+{
+	struct stat st;
+	char *buf;
+	int fd, n;
+
+	fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) != 0 || st.st_dev != dev) {
+		close(fd);
+		return;
+	}
+	buf = xmalloc(DENTS_BUFSIZE);
+	while ((n = read_dents(fd, buf)) > 0) {
+		int ofs;
+		for (ofs = 0; ofs < n; ofs += next_dent(buf, ofs)->d_reclen) {
+			struct dirent64_t *d = next_dent(buf, ofs);
+
+			if (DOT_OR_DOTDOT(d->d_name))
+				continue;
+			if (d->d_type == DT_DIR
+			 || (fstatat(fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+			    && d->d_type == DT_UNKNOWN && S_ISDIR(st.st_mode))
+			) {
+				prefetch_dir(fd, d->d_name, dev);
+			}
+		}
+	}
+	free(buf);
+	close(fd);
+}
+
+static pid_t *prefetch_pid;
+static unsigned prefetch_cnt;
+
+/* The top directory's entries are handed out through a shared
+ * counter: a child that is done with a subtree takes the next
+ * one, so big subtrees don't hold up the rest */
+void FAST_FUNC treewalk_prefetch_start(const char *dirName)
+{
+	unsigned *next_idx;
+	unsigned i;
+	long ncpu;
+
+	if (!is_directory(dirName, /*followLinks:*/ TRUE, NULL))
+		return;
+	next_idx = mmap(NULL, sizeof(*next_idx), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (next_idx == MAP_FAILED)
+		return;
+	*next_idx = 0;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	/* They mostly wait for the disk */
+	prefetch_cnt = (ncpu > 4) ? 8 : (ncpu > 1) ? ncpu * 2 : 2;
+	prefetch_pid = xmalloc(prefetch_cnt * sizeof(prefetch_pid[0]));
+	for (i = 0; i < prefetch_cnt; i++) {
+		struct stat st;
+		char **names;
+		unsigned cnt, idx;
+		int fd, n;
+		char *buf;
+
+		prefetch_pid[i] = fork();
+		if (prefetch_pid[i] < 0) {
+			prefetch_cnt = i;
+			break;
+		}
+		if (prefetch_pid[i])
+			continue;
+
+		/* child: must not keep pipes open, or linger */
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+		fd = open(bb_dev_null, O_RDWR);
+		xdup2(fd, STDIN_FILENO);
+		xdup2(fd, STDOUT_FILENO);
+		xdup2(fd, STDERR_FILENO);
+		close(fd);
+
+		fd = open(dirName, O_RDONLY | O_DIRECTORY);
+		if (fd < 0 || fstat(fd, &st) != 0)
+			_exit(EXIT_SUCCESS);
+		names = NULL;
+		cnt = 0;
+		buf = xmalloc(DENTS_BUFSIZE);
+		while ((n = read_dents(fd, buf)) > 0) {
+			int ofs;
+			for (ofs = 0; ofs < n; ofs += next_dent(buf, ofs)->d_reclen) {
+				const char *name = next_dent(buf, ofs)->d_name;
+				if (DOT_OR_DOTDOT(name))
+					continue;
+				names = xrealloc_vector(names, 6, cnt);
+				names[cnt++] = xstrdup(name);
+			}
+		}
+		while ((idx = __sync_fetch_and_add(next_idx, 1)) < cnt) {
+			struct stat sub;
+			if (fstatat(fd, names[idx], &sub, AT_SYMLINK_NOFOLLOW) == 0
+			 && S_ISDIR(sub.st_mode)
+			) {
+				prefetch_dir(fd, names[idx], st.st_dev);
+			}
+		}
+		_exit(EXIT_SUCCESS);
+	}
+	munmap(next_idx, sizeof(*next_idx));
+}
+
+void FAST_FUNC treewalk_prefetch_stop(void)
+{
+	unsigned i;
+
+	for (i = 0; i < prefetch_cnt; i++) {
+		kill(prefetch_pid[i], SIGKILL);
+		safe_waitpid(prefetch_pid[i], NULL, 0);
+	}
+	free(prefetch_pid);
+	prefetch_pid = NULL;
+	prefetch_cnt = 0;
+}
+#endif
+
+struct unordered_ent {
+	uint64_t ino;
+	char *name;
+};
+
+static int FAST_FUNC ino_cmp(const void *a, const void *b)
+{
+	const struct unordered_ent *x = a, *y = b;
+
+	return (x->ino > y->ino) - (x->ino < y->ino);
+}
+
+/* Entries of path but . and .., in ACTION_UNORDERED order, as
+ * a NULL terminated vector of malloced names. NULL if path
+ * can't be read, with errno set */
+char** FAST_FUNC read_dir_by_inode(const char *path)
+{
+	struct unordered_ent *ents;
+	char **names;
+	char *buf;
+	unsigned cnt, i;
+	int fd, n;
+
+	fd = open(path, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return NULL;
+	ents = NULL;
+	cnt = 0;
+	buf = xmalloc(DENTS_BUFSIZE);
+	while ((n = read_dents(fd, buf)) > 0) {
+		int ofs;
+		for (ofs = 0; ofs < n; ofs += next_dent(buf, ofs)->d_reclen) {
+			struct dirent64_t *d = next_dent(buf, ofs);
+
+			if (DOT_OR_DOTDOT(d->d_name))
+				continue;
+			ents = xrealloc_vector(ents, 6, cnt);
+			ents[cnt].ino = d->d_ino;
+			ents[cnt].name = xstrdup(d->d_name);
+			cnt++;
+		}
+	}
+	free(buf);
+	if (n < 0) {
+		int err = errno;
+		for (i = 0; i < cnt; i++)
+			free(ents[i].name);
+		free(ents);
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	close(fd);
+	qsort(ents, cnt, sizeof(ents[0]), ino_cmp);
+	names = xmalloc((cnt + 1) * sizeof(names[0]));
+	for (i = 0; i < cnt; i++)
+		names[i] = ents[i].name;
+	names[cnt] = NULL;
+	free(ents);
+	return names;
+}
+
+/* name is relative to dir_fd, fileName is what callbacks see */
+static int walk(walk_t *w, int dir_fd, const char *name,
+		const char *fileName, unsigned depth)
 {
 	struct stat statbuf;
 	unsigned follow;
 	int status;
-	DIR *dir;
-	struct dirent *next;
-
-	if (!fileAction) fileAction = true_action;
-	if (!dirAction) dirAction = true_action;
+	int fd, n;
+	char *buf;
+	struct unordered_ent *ents;
+	unsigned cnt, i;
 
 	follow = ACTION_FOLLOWLINKS;
 	if (depth == 0)
 		follow = ACTION_FOLLOWLINKS | ACTION_FOLLOWLINKS_L0;
-	follow &= flags;
-	status = (follow ? stat : lstat)(fileName, &statbuf);
+	follow &= w->flags;
+	status = fstatat(dir_fd, name, &statbuf, follow ? 0 : AT_SYMLINK_NOFOLLOW);
 	if (status < 0) {
 #ifdef DEBUG_RECURS_ACTION
-		bb_error_msg("status=%d flags=%x", status, flags);
+		bb_error_msg("status=%d flags=%x", status, w->flags);
 #endif
-		if ((flags & ACTION_DANGLING_OK)
+		if ((w->flags & ACTION_DANGLING_OK)
 		 && errno == ENOENT
-		 && lstat(fileName, &statbuf) == 0
+		 && fstatat(dir_fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0
 		) {
 			/* Dangling link */
-			return fileAction(fileName, &statbuf, userData, depth);
+			return w->fileAction(fileName, &statbuf, w->userData, depth);
 		}
 		goto done_nak_warn;
 	}
@@ -94,63 +318,104 @@ int FAST_FUNC recursive_action(const char *fileName,
 	if ( /* (!(flags & ACTION_FOLLOWLINKS) && S_ISLNK(statbuf.st_mode)) || */
 	 !S_ISDIR(statbuf.st_mode)
 	) {
-		return fileAction(fileName, &statbuf, userData, depth);
+		return w->fileAction(fileName, &statbuf, w->userData, depth);
 	}
 
 	/* It's a directory (or a link to one, and followLinks is set) */
 
-	if (!(flags & ACTION_RECURSE)) {
-		return dirAction(fileName, &statbuf, userData, depth);
+	if (!(w->flags & ACTION_RECURSE)) {
+		return w->dirAction(fileName, &statbuf, w->userData, depth);
 	}
 
-	if (!(flags & ACTION_DEPTHFIRST)) {
-		status = dirAction(fileName, &statbuf, userData, depth);
+	if (!(w->flags & ACTION_DEPTHFIRST)) {
+		status = w->dirAction(fileName, &statbuf, w->userData, depth);
 		if (!status)
 			goto done_nak_warn;
 		if (status == SKIP)
 			return TRUE;
 	}
 
-	dir = opendir(fileName);
-	if (!dir) {
+	fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
 		/* findutils-4.1.20 reports this */
 		/* (i.e. it doesn't silently return with exit code 1) */
 		/* To trigger: "find -exec rm -rf {} \;" */
 		goto done_nak_warn;
 	}
+	close_on_exec_on(fd);
+#if ENABLE_FEATURE_PARALLEL_TREEWALK
+	if (depth == 0 && (w->flags & ACTION_PARALLEL))
+		treewalk_prefetch_start(fileName);
+#endif
 	status = TRUE;
-	while ((next = readdir(dir)) != NULL) {
-		char *nextFile;
+	ents = NULL;
+	cnt = 0;
+	buf = xmalloc(DENTS_BUFSIZE);
+	while ((n = read_dents(fd, buf)) > 0) {
+		int ofs;
+		for (ofs = 0; ofs < n; ofs += next_dent(buf, ofs)->d_reclen) {
+			struct dirent64_t *d = next_dent(buf, ofs);
+			char *nextFile;
 
-		nextFile = concat_subpath_file(fileName, next->d_name);
-		if (nextFile == NULL)
-			continue;
-		/* process every file (NB: ACTION_RECURSE is set in flags) */
-		if (!recursive_action(nextFile, flags, fileAction, dirAction,
-						userData, depth + 1))
-			status = FALSE;
-//		s = recursive_action(nextFile, flags, fileAction, dirAction,
-//						userData, depth + 1);
-		free(nextFile);
-//#define RECURSE_RESULT_ABORT 3
-//		if (s == RECURSE_RESULT_ABORT) {
-//			closedir(dir);
-//			return s;
-//		}
-//		if (s == FALSE)
-//			status = FALSE;
+			if (DOT_OR_DOTDOT(d->d_name))
+				continue;
+			if (w->flags & ACTION_UNORDERED) {
+				ents = xrealloc_vector(ents, 6, cnt);
+				ents[cnt].ino = d->d_ino;
+				ents[cnt].name = xstrdup(d->d_name);
+				cnt++;
+				continue;
+			}
+			nextFile = concat_path_file(fileName, d->d_name);
+			/* process every file (NB: ACTION_RECURSE is set in flags) */
+			if (!walk(w, fd, d->d_name, nextFile, depth + 1))
+				status = FALSE;
+			free(nextFile);
+		}
 	}
-	closedir(dir);
+	free(buf);
+	if (cnt) {
+		qsort(ents, cnt, sizeof(ents[0]), ino_cmp);
+		for (i = 0; i < cnt; i++) {
+			char *nextFile = concat_path_file(fileName, ents[i].name);
+			if (!walk(w, fd, ents[i].name, nextFile, depth + 1))
+				status = FALSE;
+			free(nextFile);
+			free(ents[i].name);
+		}
+	}
+	free(ents);
+	close(fd);
+#if ENABLE_FEATURE_PARALLEL_TREEWALK
+	if (depth == 0 && (w->flags & ACTION_PARALLEL))
+		treewalk_prefetch_stop();
+#endif
 
-	if (flags & ACTION_DEPTHFIRST) {
-		if (!dirAction(fileName, &statbuf, userData, depth))
+	if (w->flags & ACTION_DEPTHFIRST) {
+		if (!w->dirAction(fileName, &statbuf, w->userData, depth))
 			goto done_nak_warn;
 	}
 
 	return status;
 
  done_nak_warn:
-	if (!(flags & ACTION_QUIET))
+	if (!(w->flags & ACTION_QUIET))
 		bb_simple_perror_msg(fileName);
 	return FALSE;
 }
+
+int FAST_FUNC recursive_action(const char *fileName,
+		unsigned flags,
+		int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
+		int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
+		void* userData,
+		unsigned depth)
+{
+	walk_t w;
+
+	w.flags = flags;
+	w.fileAction = fileAction ? fileAction : true_action;
+	w.dirAction = dirAction ? dirAction : true_action;
+	w.userData = userData;
+	return walk(&w, AT_FDCWD, fileName, fileName, depth);
+}
@@ -28,8 +28,8 @@ int FAST_FUNC remove_file(const char *path, int flags)
 	}
 
 	if (S_ISDIR(path_stat.st_mode)) {
-		DIR *dp;
-		struct dirent *d;
+		char **names;
+		unsigned i;
 		int status = 0;
 
 		if (!(flags & FILEUTILS_RECUR)) {
@@ -46,26 +46,22 @@ int FAST_FUNC remove_file(const char *path, int flags)
 				return 0;
 		}
 
-		dp = opendir(path);
-		if (dp == NULL) {
+		/* Unlinking in inode order spares the disk a lot of seeks */
+		names = read_dir_by_inode(path);
+		if (names == NULL) {
 			return -1;
 		}
 
-		while ((d = readdir(dp)) != NULL) {
+		for (i = 0; names[i]; i++) {
 			char *new_path;
 
-			new_path = concat_subpath_file(path, d->d_name);
-			if (new_path == NULL)
-				continue;
+			new_path = concat_path_file(path, names[i]);
 			if (remove_file(new_path, flags) < 0)
 				status = -1;
 			free(new_path);
+			free(names[i]);
 		}
-
-		if (closedir(dp) < 0) {
-			bb_perror_msg("can't close '%s'", path);
-			return -1;
-		}
+		free(names);
 
 		if (flags & FILEUTILS_INTERACTIVE) {
 			fprintf(stderr, "%s: remove directory '%s'? ", applet_name, path);
@@ -30,6 +30,17 @@
 
 #include "libbb.h"
 
+/* SHA-NI code needs intrinsics usable from target("sha") functions */
+#if (defined(__i386__) || defined(__x86_64__)) \
+ && (defined(__clang__) || __GNUC__ >= 5)
+# define SHA_X86 1
+#else
+# define SHA_X86 0
+#endif
+#if (ENABLE_SHA1_HWACCEL || ENABLE_SHA256_HWACCEL) && SHA_X86
+# include <immintrin.h>
+#endif
+
 #define rotl32(x,n) (((x) << (n)) | ((x) >> (32 - (n))))
 #define rotr32(x,n) (((x) >> (n)) | ((x) << (32 - (n))))
 /* for sha512: */
@@ -120,6 +131,97 @@ static void FAST_FUNC sha1_process_block64(sha1_ctx_t *ctx)
 	ctx->hash[4] += e;
 }
 
+#if (ENABLE_SHA1_HWACCEL || ENABLE_SHA256_HWACCEL) && SHA_X86
+static void cpuid(unsigned *eax, unsigned *ebx, unsigned *ecx, unsigned *edx)
+{
+	asm ("cpuid"
+		: "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+		: "0"(*eax), "1"(*ebx), "2"(*ecx), "3"(*edx)
+	);
+}
+
+/* 1: CPU has SHA-NI, -1: it has not, 0: not checked yet */
+static smallint shaNI;
+
+static ALWAYS_INLINE int have_shaNI(void)
+{
+	if (!shaNI) {
+		unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+		cpuid(&eax, &ebx, &ecx, &edx);
+		shaNI = -1;
+		if (eax >= 7) {
+			eax = 1;
+			ecx = 0;
+			cpuid(&eax, &ebx, &ecx, &edx);
+			/* SSE4.1 is used too, every SHA-NI CPU has it */
+			if (ecx & (1 << 19)) {
+				eax = 7;
+				ecx = 0;
+				cpuid(&eax, &ebx, &ecx, &edx);
+				if (ebx & (1 << 29))
+					shaNI = 1;
+			}
+		}
+	}
+	return shaNI > 0;
+}
+
+#endif
+
+#if ENABLE_SHA1_HWACCEL && SHA_X86
+/* Each sha1rnds4 does 4 rounds, sha1nexte makes E for the next 4
+ * from the A four rounds back, sha1msg1/sha1msg2 extend the schedule. */
+static void FAST_FUNC __attribute__((target("sha,sse4.1")))
+sha1_process_block64_shaNI(sha1_ctx_t *ctx)
+{
+	/* Big endian words, and W[0] goes to the top lane */
+	const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e_save, e1, W[20];
+	unsigned t;
+
+	abcd = _mm_loadu_si128((const __m128i *)ctx->hash);
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	e0 = _mm_set_epi32(ctx->hash[4], 0, 0, 0);
+	abcd_save = abcd;
+	e_save = e0;
+
+	for (t = 0; t < 4; t++)
+		W[t] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(ctx->wbuffer + t * 16)), bswap);
+	for (/*t = 4*/; t < 20; t++)
+		W[t] = _mm_sha1msg2_epu32(
+			_mm_xor_si128(_mm_sha1msg1_epu32(W[t - 4], W[t - 3]), W[t - 2]),
+			W[t - 1]);
+
+	/* e0/e1: the two alternating "E + W" registers */
+	e0 = _mm_add_epi32(e0, W[0]);
+	e1 = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+#define ROUNDS4(t, f) \
+	do { \
+		e1 = _mm_sha1nexte_epu32(e1, W[t]); \
+		e0 = abcd; \
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, f); \
+		e1 = e0; \
+	} while (0)
+	for (t = 1; t < 5; t++)
+		ROUNDS4(t, 0);
+	for (/*t = 5*/; t < 10; t++)
+		ROUNDS4(t, 1);
+	for (/*t = 10*/; t < 15; t++)
+		ROUNDS4(t, 2);
+	for (/*t = 15*/; t < 20; t++)
+		ROUNDS4(t, 3);
+#undef ROUNDS4
+
+	e0 = _mm_sha1nexte_epu32(e1, e_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+
+	abcd = _mm_shuffle_epi32(abcd, 0x1b);
+	_mm_storeu_si128((__m128i *)ctx->hash, abcd);
+	ctx->hash[4] = _mm_extract_epi32(e0, 3);
+}
+#endif
+
 /* Constants for SHA512 from FIPS 180-2:4.2.3.
  * SHA256 constants from FIPS 180-2:4.2.2
  * are the most significant half of first 64 elements
@@ -243,6 +345,73 @@ static void FAST_FUNC sha256_process_block64(sha256_ctx_t *ctx)
 	ctx->hash[7] += h;
 }
 
+#if ENABLE_SHA256_HWACCEL && SHA_X86
+/* sha_K[] has them in the upper halves, this wants them packed */
+static const uint32_t sha256_K[64] ALIGNED(16) = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* sha256rnds2 does 2 rounds on state kept as ABEF/CDGH,
+ * sha256msg1/sha256msg2 extend the schedule 4 words at a time. */
+static void FAST_FUNC __attribute__((target("sha,sse4.1")))
+sha256_process_block64_shaNI(sha256_ctx_t *ctx)
+{
+	/* Big endian words */
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1, tmp, msg, abef_save, cdgh_save, W[16];
+	unsigned t;
+
+	tmp = _mm_loadu_si128((const __m128i *)&ctx->hash[0]);    /* DCBA */
+	state1 = _mm_loadu_si128((const __m128i *)&ctx->hash[4]); /* HGFE */
+	tmp = _mm_shuffle_epi32(tmp, 0xb1);          /* CDAB */
+	state1 = _mm_shuffle_epi32(state1, 0x1b);    /* EFGH */
+	state0 = _mm_alignr_epi8(tmp, state1, 8);    /* ABEF */
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0); /* CDGH */
+	abef_save = state0;
+	cdgh_save = state1;
+
+	for (t = 0; t < 16; t++) {
+		if (t < 4) {
+			W[t] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(ctx->wbuffer + t * 16)), bswap);
+		} else {
+			/* W[t] from W[t-4..t-1], kept in a ring of 4 */
+			__m128i w = _mm_sha256msg1_epu32(W[t & 3], W[(t + 1) & 3]);
+			w = _mm_add_epi32(w, _mm_alignr_epi8(W[(t + 3) & 3], W[(t + 2) & 3], 4));
+			W[t & 3] = _mm_sha256msg2_epu32(w, W[(t + 3) & 3]);
+		}
+		msg = _mm_add_epi32(W[t & 3], _mm_load_si128((const __m128i *)&sha256_K[t * 4]));
+		state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+		msg = _mm_shuffle_epi32(msg, 0x0e);
+		state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+	}
+
+	state0 = _mm_add_epi32(state0, abef_save);
+	state1 = _mm_add_epi32(state1, cdgh_save);
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b);       /* FEBA */
+	state1 = _mm_shuffle_epi32(state1, 0xb1);    /* DCHG */
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0); /* DCBA */
+	state1 = _mm_alignr_epi8(state1, tmp, 8);    /* HGFE */
+	_mm_storeu_si128((__m128i *)&ctx->hash[0], state0);
+	_mm_storeu_si128((__m128i *)&ctx->hash[4], state1);
+}
+#endif
+
 static void FAST_FUNC sha512_process_block128(sha512_ctx_t *ctx)
 {
 	unsigned t;
@@ -308,6 +477,16 @@ static void FAST_FUNC sha512_process_block128(sha512_ctx_t *ctx)
 }
 
 
+/* sha1 and sha256 share the context, tell them apart */
+static int is_sha1(sha1_ctx_t *ctx)
+{
+	return ctx->process_block == sha1_process_block64
+#if ENABLE_SHA1_HWACCEL && SHA_X86
+		|| ctx->process_block == sha1_process_block64_shaNI
+#endif
+	;
+}
+
 void FAST_FUNC sha1_begin(sha1_ctx_t *ctx)
 {
 	ctx->hash[0] = 0x67452301;
@@ -317,6 +496,10 @@ void FAST_FUNC sha1_begin(sha1_ctx_t *ctx)
 	ctx->hash[4] = 0xc3d2e1f0;
 	ctx->total64 = 0;
 	ctx->process_block = sha1_process_block64;
+#if ENABLE_SHA1_HWACCEL && SHA_X86
+	if (have_shaNI())
+		ctx->process_block = sha1_process_block64_shaNI;
+#endif
 }
 
 static const uint32_t init256[] = {
@@ -347,6 +530,10 @@ void FAST_FUNC sha256_begin(sha256_ctx_t *ctx)
 	memcpy(ctx->hash, init256, sizeof(init256));
 	ctx->total64 = 0;
 	ctx->process_block = sha256_process_block64;
+#if ENABLE_SHA256_HWACCEL && SHA_X86
+	if (have_shaNI())
+		ctx->process_block = sha256_process_block64_shaNI;
+#endif
 }
 
 /* Initialize structure containing state of computation.
@@ -360,6 +547,162 @@ void FAST_FUNC sha512_begin(sha512_ctx_t *ctx)
 }
 
 
+#if ENABLE_HASH_MULTIBUF
+/*
+ * Multi-buffer hashing: HASH_LANES independent messages are hashed
+ * side by side, one per 32-bit lane of a vector. The code is the plain
+ * algorithm written with gcc vector types, compiled once for the
+ * baseline and, on x86, once more for AVX2 (which has all 8 lanes
+ * in one register).
+ */
+typedef uint32_t lane_t __attribute__((vector_size(HASH_LANES * 4)));
+
+#define lrotl(x,n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define lrotr(x,n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static ALWAYS_INLINE void load_be_lanes(lane_t *v, const uint8_t *const *data, unsigned ofs)
+{
+	unsigned i;
+
+	for (i = 0; i < HASH_LANES; i++) {
+		uint32_t w;
+		move_from_unaligned32(w, data[i] + ofs);
+		(*v)[i] = ntohl(w);
+	}
+}
+
+/* Hashes nblocks 64-byte blocks from each data[i] into hash[i][] */
+static ALWAYS_INLINE void sha1_lanes(uint32_t **hash, const uint8_t **data, size_t nblocks)
+{
+	lane_t a, b, c, d, e, W[16];
+	unsigned i, t;
+
+	for (i = 0; i < HASH_LANES; i++) {
+		a[i] = hash[i][0];
+		b[i] = hash[i][1];
+		c[i] = hash[i][2];
+		d[i] = hash[i][3];
+		e[i] = hash[i][4];
+	}
+	while (nblocks--) {
+		lane_t sa = a, sb = b, sc = c, sd = d, se = e;
+
+#define rnd(f,k) \
+	do { \
+		lane_t T; \
+		if (t < 16) { \
+			load_be_lanes(&W[t], data, t * 4); \
+		} else { \
+			T = W[(t - 3) & 15] ^ W[(t - 8) & 15] ^ W[(t - 14) & 15] ^ W[t & 15]; \
+			W[t & 15] = lrotl(T, 1); \
+		} \
+		T = lrotl(a, 5) + (f) + e + (k) + W[t & 15]; \
+		e = d; \
+		d = c; \
+		c = lrotl(b, 30); \
+		b = a; \
+		a = T; \
+	} while (0)
+		for (t = 0; t < 20; t++)
+			rnd(d ^ (b & (c ^ d)), 0x5a827999);
+		for (/*t = 20*/; t < 40; t++)
+			rnd(b ^ c ^ d, 0x6ed9eba1);
+		for (/*t = 40*/; t < 60; t++)
+			rnd((b & c) | (d & (b | c)), 0x8f1bbcdc);
+		for (/*t = 60*/; t < 80; t++)
+			rnd(b ^ c ^ d, 0xca62c1d6);
+#undef rnd
+		a += sa;
+		b += sb;
+		c += sc;
+		d += sd;
+		e += se;
+		for (i = 0; i < HASH_LANES; i++)
+			data[i] += 64;
+	}
+	for (i = 0; i < HASH_LANES; i++) {
+		hash[i][0] = a[i];
+		hash[i][1] = b[i];
+		hash[i][2] = c[i];
+		hash[i][3] = d[i];
+		hash[i][4] = e[i];
+	}
+}
+
+static ALWAYS_INLINE void sha256_lanes(uint32_t **hash, const uint8_t **data, size_t nblocks)
+{
+	lane_t st[8], W[16];
+	unsigned i, t;
+
+	for (i = 0; i < HASH_LANES; i++)
+		for (t = 0; t < 8; t++)
+			st[t][i] = hash[i][t];
+	while (nblocks--) {
+		lane_t a = st[0], b = st[1], c = st[2], d = st[3];
+		lane_t e = st[4], f = st[5], g = st[6], h = st[7];
+
+		for (t = 0; t < 64; t++) {
+			lane_t T1, T2;
+
+			if (t < 16) {
+				load_be_lanes(&W[t], data, t * 4);
+			} else {
+				lane_t w15 = W[(t - 15) & 15], w2 = W[(t - 2) & 15];
+				W[t & 15] += (lrotr(w2, 17) ^ lrotr(w2, 19) ^ (w2 >> 10))
+					+ W[(t - 7) & 15]
+					+ (lrotr(w15, 7) ^ lrotr(w15, 18) ^ (w15 >> 3));
+			}
+			T1 = h + (lrotr(e, 6) ^ lrotr(e, 11) ^ lrotr(e, 25))
+				+ (g ^ (e & (f ^ g))) + (uint32_t)(sha_K[t] >> 32) + W[t & 15];
+			T2 = (lrotr(a, 2) ^ lrotr(a, 13) ^ lrotr(a, 22))
+				+ ((a & b) | (c & (a | b)));
+			h = g;
+			g = f;
+			f = e;
+			e = d + T1;
+			d = c;
+			c = b;
+			b = a;
+			a = T1 + T2;
+		}
+		st[0] += a;
+		st[1] += b;
+		st[2] += c;
+		st[3] += d;
+		st[4] += e;
+		st[5] += f;
+		st[6] += g;
+		st[7] += h;
+		for (i = 0; i < HASH_LANES; i++)
+			data[i] += 64;
+	}
+	for (i = 0; i < HASH_LANES; i++)
+		for (t = 0; t < 8; t++)
+			hash[i][t] = st[t][i];
+}
+
+static void sha1_lanes_generic(uint32_t **hash, const uint8_t **data, size_t nblocks)
+{
+	sha1_lanes(hash, data, nblocks);
+}
+static void sha256_lanes_generic(uint32_t **hash, const uint8_t **data, size_t nblocks)
+{
+	sha256_lanes(hash, data, nblocks);
+}
+# if SHA_X86
+static void __attribute__((target("avx2")))
+sha1_lanes_avx2(uint32_t **hash, const uint8_t **data, size_t nblocks)
+{
+	sha1_lanes(hash, data, nblocks);
+}
+static void __attribute__((target("avx2")))
+sha256_lanes_avx2(uint32_t **hash, const uint8_t **data, size_t nblocks)
+{
+	sha256_lanes(hash, data, nblocks);
+}
+# endif
+#endif
+
 /* Used also for sha256 */
 void FAST_FUNC sha1_hash(const void *buffer, size_t len, sha1_ctx_t *ctx)
 {
@@ -380,6 +723,41 @@ void FAST_FUNC sha1_hash(const void *buffer, size_t len, sha1_ctx_t *ctx)
 	memcpy(ctx->wbuffer + in_buf, buffer, len);
 }
 
+#if ENABLE_HASH_MULTIBUF
+/* Used also for sha256. All contexts must be of the same kind. */
+void FAST_FUNC sha1_hash_multi(sha1_ctx_t *ctx[], const void *data[], const size_t len[], unsigned n)
+{
+	static const struct hash_multi_ops sha1_ops = {
+		(void *)sha1_hash,
+		offsetof(sha1_ctx_t, hash),
+		offsetof(sha1_ctx_t, total64),
+	};
+	hash_lanes_fn *lanes;
+	unsigned i;
+
+	if (n == 0)
+		return;
+	lanes = is_sha1(ctx[0]) ? sha1_lanes_generic : sha256_lanes_generic;
+# if SHA_X86
+	if (__builtin_cpu_supports("avx2"))
+		lanes = is_sha1(ctx[0]) ? sha1_lanes_avx2 : sha256_lanes_avx2;
+# endif
+	for (i = 1; i < n; i++)
+		if (is_sha1(ctx[i]) != is_sha1(ctx[0]))
+			lanes = NULL;
+# if (ENABLE_SHA1_HWACCEL || ENABLE_SHA256_HWACCEL) && SHA_X86
+	/* One SHA-NI lane is about as fast as 8 AVX2 ones */
+	if (ctx[0]->process_block != sha1_process_block64
+	 && ctx[0]->process_block != sha256_process_block64
+	) {
+		lanes = NULL;
+	}
+# endif
+
+	hash_multi((void **)ctx, data, len, n, lanes, &sha1_ops);
+}
+#endif
+
 void FAST_FUNC sha512_hash(const void *buffer, size_t len, sha512_ctx_t *ctx)
 {
 	unsigned in_buf = ctx->total64[0] & 127;
@@ -432,7 +810,7 @@ void FAST_FUNC sha1_end(void *resbuf, sha1_ctx_t *ctx)
 			break;
 	}
 
-	in_buf = (ctx->process_block == sha1_process_block64) ? 5 : 8;
+	in_buf = is_sha1(ctx) ? 5 : 8;
 	/* This way we do not impose alignment constraints on resbuf: */
 	if (BB_LITTLE_ENDIAN) {
 		unsigned i;
@@ -54,3 +54,11 @@ FILE* FAST_FUNC xfdopen_for_write(int fd)
 {
 	return xfdopen_helper((fd << 1) + 1);
 }
+/* For writing through a FILE and reading fd back afterwards */
+FILE* FAST_FUNC xfdopen_dup_for_write(int fd)
+{
+	int fd2 = dup(fd);
+	if (fd2 < 0)
+		bb_perror_msg_and_die("dup");
+	return xfdopen_for_write(fd2);
+}
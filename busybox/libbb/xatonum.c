@@ -68,3 +68,24 @@ uint16_t FAST_FUNC xatou16(const char *numstr)
 {
 	return xatou_range(numstr, 0, 0xffff);
 }
+
+/* Memory size as in GNU sort -S: b, k, M or G suffix,
+ * no suffix means kilobytes */
+unsigned long long FAST_FUNC xatoull_memsize(const char *numstr)
+{
+	static const struct suffix_mult memsize_suffixes[] = {
+		{ "b", 1 },
+		{ "k", 1024 },
+		{ "K", 1024 },
+		{ "m", 1024*1024 },
+		{ "M", 1024*1024 },
+		{ "g", 1024*1024*1024 },
+		{ "G", 1024*1024*1024 },
+		{ "", 0 }
+	};
+	unsigned long long size = xatoull_sfx(numstr, memsize_suffixes);
+
+	if (isdigit(numstr[strlen(numstr) - 1]))
+		size *= 1024;
+	return size;
+}
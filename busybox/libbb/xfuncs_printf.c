@@ -167,6 +167,28 @@ int FAST_FUNC open_or_warn(const char *pathname, int flags)
 	return open3_or_warn(pathname, flags, 0666);
 }
 
+/* Scratch file in dir (NULL: $TMPDIR, or /tmp), already unlinked,
+ * so it goes away with its last fd */
+int FAST_FUNC xmkstemp_unlinked(const char *dir, const char *prefix)
+{
+	char *tmpl, *name;
+	int fd;
+
+	if (!dir || !dir[0])
+		dir = getenv("TMPDIR");
+	if (!dir || !dir[0])
+		dir = "/tmp";
+	tmpl = xasprintf("%sXXXXXX", prefix);
+	name = concat_path_file(dir, tmpl);
+	free(tmpl);
+	fd = mkstemp(name);
+	if (fd < 0)
+		bb_perror_msg_and_die("can't create temporary file in '%s'", dir);
+	unlink(name);
+	free(name);
+	return fd;
+}
+
 void FAST_FUNC xunlink(const char *pathname)
 {
 	if (unlink(pathname))